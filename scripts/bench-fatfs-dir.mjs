@@ -0,0 +1,79 @@
+import { readFile } from "node:fs/promises";
+import path from "node:path";
+import { performance } from "node:perf_hooks";
+import { fileURLToPath, pathToFileURL } from "node:url";
+
+const repoRoot = process.cwd();
+const wasmURL = pathToFileURL(path.join(repoRoot, "dist", "fatfs", "fatfs.wasm"));
+const moduleUrl = pathToFileURL(path.join(repoRoot, "dist", "fatfs", "index.js"));
+
+const counts = process.argv.slice(2).map(Number).filter((n) => n > 0);
+const fileCounts = counts.length ? counts : [1000, 2500, 5000, 10000];
+
+const originalFetch = globalThis.fetch;
+if (typeof originalFetch !== "function") {
+  throw new Error("fetch is not available in this Node runtime");
+}
+
+globalThis.fetch = async (input, init) => {
+  const url =
+    typeof input === "string"
+      ? new URL(input)
+      : input instanceof URL
+      ? input
+      : new URL(input.url);
+
+  if (url.protocol === "file:") {
+    const filePath = fileURLToPath(url);
+    const data = await readFile(filePath);
+    return new Response(data, { status: 200, headers: { "Content-Type": "application/wasm" } });
+  }
+
+  return originalFetch(input, init);
+};
+
+async function benchDirectory(createFatFS, count) {
+  // 128 MiB volume so the directory, not free space, is the limiting factor.
+  const fs = await createFatFS({ wasmURL, blockCount: 32768, formatOnInit: true });
+  fs.mkdir("/fatfs/bench");
+  const payload = "x";
+
+  let start = performance.now();
+  for (let i = 0; i < count; i++) {
+    fs.writeFile(`/fatfs/bench/file_${i}.txt`, payload);
+  }
+  const createMs = performance.now() - start;
+
+  start = performance.now();
+  for (let i = 0; i < count; i++) {
+    fs.readFile(`/fatfs/bench/file_${(i * 7919) % count}.txt`);
+  }
+  const readMs = performance.now() - start;
+
+  start = performance.now();
+  const entries = fs.list("/fatfs/bench");
+  const listMs = performance.now() - start;
+  if (entries.length !== count) {
+    throw new Error(`expected ${count} entries, found ${entries.length}`);
+  }
+
+  console.log(
+    `files=${count} create=${createMs.toFixed(1)}ms read=${readMs.toFixed(1)}ms list=${listMs.toFixed(1)}ms`
+  );
+}
+
+async function main() {
+  const { createFatFS } = await import(moduleUrl.href);
+  for (const count of fileCounts) {
+    await benchDirectory(createFatFS, count);
+  }
+}
+
+try {
+  await main();
+  console.log("RESULT: PASS");
+} catch (error) {
+  console.error("RESULT: FAIL");
+  console.error(error);
+  process.exitCode = 1;
+}
@@ -0,0 +1,112 @@
+import { closeSync, ftruncateSync, openSync, readSync, rmSync, writeSync } from "node:fs";
+import { readFile } from "node:fs/promises";
+import { tmpdir } from "node:os";
+import path from "node:path";
+import { performance } from "node:perf_hooks";
+import { fileURLToPath, pathToFileURL } from "node:url";
+
+const repoRoot = process.cwd();
+const wasmURL = pathToFileURL(path.join(repoRoot, "dist", "fatfs", "fatfs64.wasm"));
+const moduleUrl = pathToFileURL(path.join(repoRoot, "dist", "fatfs", "index.js"));
+
+const volumeGiB = Number(process.argv[2] ?? 32);
+const fileMiB = Number(process.argv[3] ?? 1024);
+const imagePath = path.join(tmpdir(), `fatfs-bench-${process.pid}.img`);
+
+const originalFetch = globalThis.fetch;
+if (typeof originalFetch !== "function") {
+  throw new Error("fetch is not available in this Node runtime");
+}
+
+globalThis.fetch = async (input, init) => {
+  const url =
+    typeof input === "string"
+      ? new URL(input)
+      : input instanceof URL
+      ? input
+      : new URL(input.url);
+
+  if (url.protocol === "file:") {
+    const filePath = fileURLToPath(url);
+    const data = await readFile(filePath);
+    return new Response(data, { status: 200, headers: { "Content-Type": "application/wasm" } });
+  }
+
+  return originalFetch(input, init);
+};
+
+function fileDevice(fd) {
+  const counters = { calls: 0 };
+  return {
+    counters,
+    read: (offset, target) => {
+      counters.calls++;
+      target.fill(0, readSync(fd, target, 0, target.length, offset));
+    },
+    write: (offset, data) => {
+      counters.calls++;
+      writeSync(fd, data, 0, data.length, offset);
+    },
+  };
+}
+
+async function main() {
+  const { createFatFSOnDevice } = await import(moduleUrl.href);
+  // A sparse backing file stands in for an SD card; only written sectors take disk space.
+  const fd = openSync(imagePath, "w+");
+  try {
+    ftruncateSync(fd, volumeGiB * 1024 ** 3);
+    const device = fileDevice(fd);
+    const options = {
+      wasmURL,
+      memory64: true,
+      blockCount: (volumeGiB * 1024 ** 3) / 4096,
+      format: { type: "exfat" },
+      cacheBlocks: 1024,
+      readAheadBlocks: 32,
+    };
+    const payload = new Uint8Array(fileMiB * 1024 ** 2);
+    for (let i = 0; i < payload.length; i += 4096) {
+      payload.fill((i >>> 12) & 0xff, i, i + 4096);
+    }
+
+    let start = performance.now();
+    const card = await createFatFSOnDevice(device, { ...options, formatOnInit: true });
+    card.writeFile("/fatfs/big.bin", payload);
+    card.flush();
+    const writeMs = performance.now() - start;
+    const writeCalls = device.counters.calls;
+
+    device.counters.calls = 0;
+    start = performance.now();
+    const remounted = await createFatFSOnDevice(device, options);
+    const readBack = remounted.readFile("/fatfs/big.bin");
+    const readMs = performance.now() - start;
+    if (!Buffer.from(readBack).equals(Buffer.from(payload))) {
+      throw new Error("read back differs from the written file");
+    }
+
+    const usage = remounted.getUsage();
+    console.log(
+      `volume=${volumeGiB}GiB file=${fileMiB}MiB ` +
+        `write=${writeMs.toFixed(0)}ms (${((fileMiB * 1000) / writeMs).toFixed(0)} MiB/s, ${writeCalls} host calls) ` +
+        `read=${readMs.toFixed(0)}ms (${((fileMiB * 1000) / readMs).toFixed(0)} MiB/s, ${device.counters.calls} host calls) ` +
+        `capacity=${usage.capacityBytes} used=${usage.usedBytes}`
+    );
+    if (usage.capacityBytes <= 2 ** 32) {
+      throw new Error("getUsage() truncated the volume capacity");
+    }
+  } finally {
+    closeSync(fd);
+    rmSync(imagePath, { force: true });
+  }
+}
+
+try {
+  await main();
+  console.log("RESULT: PASS");
+} catch (error) {
+  console.error("RESULT: FAIL");
+  console.error(error);
+  process.exitCode = 1;
+}
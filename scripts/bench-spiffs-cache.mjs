@@ -0,0 +1,92 @@
+import { readFile } from "node:fs/promises";
+import path from "node:path";
+import { performance } from "node:perf_hooks";
+import { fileURLToPath, pathToFileURL } from "node:url";
+
+const repoRoot = process.cwd();
+const wasmURL = pathToFileURL(path.join(repoRoot, "dist", "spiffs", "spiffs.wasm"));
+const moduleUrl = pathToFileURL(path.join(repoRoot, "dist", "spiffs", "index.js"));
+
+const counts = process.argv.slice(2).map(Number).filter((n) => n > 0);
+const cacheSizes = counts.length ? counts : [32, 256, 4096];
+const FILE_COUNT = 1500;
+const ROUNDS = 3;
+
+const originalFetch = globalThis.fetch;
+if (typeof originalFetch !== "function") {
+  throw new Error("fetch is not available in this Node runtime");
+}
+
+globalThis.fetch = async (input, init) => {
+  const url =
+    typeof input === "string"
+      ? new URL(input)
+      : input instanceof URL
+      ? input
+      : new URL(input.url);
+
+  if (url.protocol === "file:") {
+    const filePath = fileURLToPath(url);
+    const data = await readFile(filePath);
+    return new Response(data, { status: 200, headers: { "Content-Type": "application/wasm" } });
+  }
+
+  return originalFetch(input, init);
+};
+
+async function benchCache(createSpiffs, cachePages, ramDirect) {
+  // 4 MiB volume filled to roughly a third, rewritten so GC has to run.
+  const fs = await createSpiffs({
+    wasmURL,
+    pageSize: 256,
+    blockSize: 4096,
+    blockCount: 1024,
+    cachePages,
+    ramDirect,
+    formatOnInit: true,
+  });
+  const payload = new Uint8Array(2048).map((_, i) => i * 7);
+
+  let bytes = 0;
+  let start = performance.now();
+  for (let round = 0; round < ROUNDS; round++) {
+    for (let i = 0; i < FILE_COUNT; i++) {
+      const length = 300 + ((i * 97 + round * 31) % 1400);
+      await fs.write(`/f${i}`, payload.subarray(0, length));
+      bytes += length;
+    }
+  }
+  const writeMs = performance.now() - start;
+
+  let readBytes = 0;
+  start = performance.now();
+  for (let i = 0; i < FILE_COUNT; i++) {
+    readBytes += (await fs.read(`/f${i}`)).length;
+  }
+  const readMs = performance.now() - start;
+
+  const mbps = (count, ms) => (count / 1048576 / (ms / 1000)).toFixed(2);
+  console.log(
+    `cachePages=${cachePages} ramDirect=${ramDirect} write=${mbps(bytes, writeMs)}MB/s (${writeMs.toFixed(0)}ms) read=${mbps(
+      readBytes,
+      readMs
+    )}MB/s (${readMs.toFixed(0)}ms)`
+  );
+}
+
+async function main() {
+  const { createSpiffs } = await import(moduleUrl.href);
+  for (const cachePages of cacheSizes) {
+    await benchCache(createSpiffs, cachePages, false);
+    await benchCache(createSpiffs, cachePages, true);
+  }
+}
+
+try {
+  await main();
+  console.log("RESULT: PASS");
+} catch (error) {
+  console.error("RESULT: FAIL");
+  console.error(error);
+  process.exitCode = 1;
+}
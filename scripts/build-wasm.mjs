@@ -10,32 +10,75 @@ const __dirname = dirname(__filename);
 const projectRoot = dirname(__dirname);
 const distDir = join(projectRoot, "dist");
 
+const fatfsSources = [
+  join(projectRoot, "src", "c", "fatfs_wasm.c"),
+  join(projectRoot, "third_party", "fatfs", "ff.c"),
+  join(projectRoot, "third_party", "fatfs", "ffunicode.c")
+];
+const fatfsExports =
+  "['_fatfsjs_init','_fatfsjs_init_from_image','_fatfsjs_format','_fatfsjs_set_format_options','_fatfsjs_features','_fatfsjs_set_time','_fatfsjs_write_file','_fatfsjs_delete_file','_fatfsjs_remove','_fatfsjs_mkdir','_fatfsjs_rename','_fatfsjs_list','_fatfsjs_file_size','_fatfsjs_read_file','_fatfsjs_export_image','_fatfsjs_storage_size','_fatfsjs_storage_ptr','_fatfsjs_import_begin','_fatfsjs_import_end','_fatfsjs_init_host','_fatfsjs_flush','_fatfsjs_get_usage','_fatfsjs_set_io_stats','_fatfsjs_reset_io_stats','_fatfsjs_get_io_stats','_fatfsjs_snapshot','_fatfsjs_restore_snapshot','_fatfsjs_release_snapshot','_fatfsjs_snapshot_blocks','_fatfsjs_diff_snapshot','_fatfsjs_diff_image','_fatfsjs_apply_patch','_fatfsjs_export_sparse','_fatfsjs_hash_blocks','_fatfsjs_hash_range','_fatfsjs_hash_file','_malloc','_free']";
+
+const littlefsSources = [
+  join(projectRoot, "src", "c", "littlefs_wasm.c"),
+  join(projectRoot, "third_party", "littlefs", "lfs.c"),
+  join(projectRoot, "third_party", "littlefs", "lfs_util.c")
+];
+const littlefsExports =
+  "['_lfsjs_init','_lfsjs_init_from_image','_lfsjs_format','_lfsjs_add_file','_lfsjs_append_file','_lfsjs_append_batch','_lfsjs_delete_file','_lfsjs_remove','_lfsjs_mkdir','_lfsjs_rename','_lfsjs_list','_lfsjs_file_size','_lfsjs_read_file','_lfsjs_export_image','_lfsjs_storage_size','_lfsjs_storage_ptr','_lfsjs_import_begin','_lfsjs_import_end','_lfsjs_init_host','_lfsjs_flush','_lfsjs_set_io_stats','_lfsjs_reset_io_stats','_lfsjs_get_io_stats','_lfsjs_snapshot','_lfsjs_restore_snapshot','_lfsjs_release_snapshot','_lfsjs_snapshot_blocks','_lfsjs_diff_snapshot','_lfsjs_diff_image','_lfsjs_apply_patch','_lfsjs_export_sparse','_lfsjs_hash_blocks','_lfsjs_hash_range','_lfsjs_hash_file','_malloc','_free']";
+
+const hostImportsLibrary = join(projectRoot, "src", "c", "host_imports.js");
+
 const targets = [
   {
     name: "littlefs",
     outputDir: join(distDir, "littlefs"),
     outputWasm: join(distDir, "littlefs", "littlefs.wasm"),
-    sources: [
-      join(projectRoot, "src", "c", "littlefs_wasm.c"),
-      join(projectRoot, "third_party", "littlefs", "lfs.c"),
-      join(projectRoot, "third_party", "littlefs", "lfs_util.c")
-    ],
+    sources: littlefsSources,
     includes: [join(projectRoot, "third_party", "littlefs")],
-    exports:
-      "['_lfsjs_init','_lfsjs_init_from_image','_lfsjs_format','_lfsjs_add_file','_lfsjs_delete_file','_lfsjs_remove','_lfsjs_mkdir','_lfsjs_rename','_lfsjs_list','_lfsjs_file_size','_lfsjs_read_file','_lfsjs_export_image','_lfsjs_storage_size','_malloc','_free']"
+    defines: ["LFS_CRC=lfsjs_crc"],
+    hostImports: true,
+    exports: littlefsExports
+  },
+  {
+    name: "littlefs64",
+    outputDir: join(distDir, "littlefs"),
+    outputWasm: join(distDir, "littlefs", "littlefs64.wasm"),
+    sources: littlefsSources,
+    includes: [join(projectRoot, "third_party", "littlefs")],
+    defines: ["LFS_CRC=lfsjs_crc"],
+    hostImports: true,
+    memory64: true,
+    exports: littlefsExports
   },
   {
     name: "fatfs",
     outputDir: join(distDir, "fatfs"),
     outputWasm: join(distDir, "fatfs", "fatfs.wasm"),
-    sources: [
-      join(projectRoot, "src", "c", "fatfs_wasm.c"),
-      join(projectRoot, "third_party", "fatfs", "ff.c"),
-      join(projectRoot, "third_party", "fatfs", "ffunicode.c")
-    ],
+    sources: fatfsSources,
     includes: [join(projectRoot, "third_party", "fatfs")],
-    exports:
-      "['_fatfsjs_init','_fatfsjs_init_from_image','_fatfsjs_format','_fatfsjs_write_file','_fatfsjs_delete_file','_fatfsjs_mkdir','_fatfsjs_rename','_fatfsjs_list','_fatfsjs_file_size','_fatfsjs_read_file','_fatfsjs_export_image','_fatfsjs_storage_size','_malloc','_free']"
+    hostImports: true,
+    exports: fatfsExports
+  },
+  {
+    name: "fatfs-exfat",
+    outputDir: join(distDir, "fatfs"),
+    outputWasm: join(distDir, "fatfs", "fatfs-exfat.wasm"),
+    sources: fatfsSources,
+    includes: [join(projectRoot, "third_party", "fatfs")],
+    defines: ["FF_FS_EXFAT=1"],
+    hostImports: true,
+    exports: fatfsExports
+  },
+  {
+    name: "fatfs64",
+    outputDir: join(distDir, "fatfs"),
+    outputWasm: join(distDir, "fatfs", "fatfs64.wasm"),
+    sources: fatfsSources,
+    includes: [join(projectRoot, "third_party", "fatfs")],
+    defines: ["FF_FS_EXFAT=1", "FF_LBA64=1"],
+    hostImports: true,
+    memory64: true,
+    exports: fatfsExports
   },
   {
     name: "spiffs",
@@ -51,25 +94,43 @@ const targets = [
     ],
     includes: [join(projectRoot, "third_party", "spiffs")],
     exports:
-      "['_spiffsjs_init','_spiffsjs_init_from_image','_spiffsjs_format','_spiffsjs_list','_spiffsjs_file_size','_spiffsjs_read_file','_spiffsjs_write_file','_spiffsjs_remove_file','_spiffsjs_storage_size','_spiffsjs_export_image','_spiffsjs_get_usage','_spiffsjs_can_fit','_malloc','_free']"
+      "['_spiffsjs_set_ram_direct','_spiffsjs_init','_spiffsjs_init_from_image','_spiffsjs_format','_spiffsjs_list','_spiffsjs_list_prefix','_spiffsjs_file_size','_spiffsjs_read_file','_spiffsjs_read_file_alloc','_spiffsjs_read_range','_spiffsjs_write_file','_spiffsjs_append_file','_spiffsjs_append_batch','_spiffsjs_remove_file','_spiffsjs_remove_prefix','_spiffsjs_storage_size','_spiffsjs_storage_ptr','_spiffsjs_import_begin','_spiffsjs_import_end','_spiffsjs_export_image','_spiffsjs_get_usage','_spiffsjs_can_fit','_spiffsjs_can_fit_batch','_spiffsjs_gc','_spiffsjs_gc_quick','_spiffsjs_reserve','_spiffsjs_check_pass','_spiffsjs_check_report','_spiffsjs_set_io_stats','_spiffsjs_reset_io_stats','_spiffsjs_get_io_stats','_spiffsjs_snapshot','_spiffsjs_restore_snapshot','_spiffsjs_release_snapshot','_spiffsjs_snapshot_blocks','_spiffsjs_diff_snapshot','_spiffsjs_diff_image','_spiffsjs_apply_patch','_spiffsjs_export_sparse','_spiffsjs_hash_blocks','_spiffsjs_hash_range','_spiffsjs_hash_file','_malloc','_free']"
   }
 ];
 
+// Every module also ships as a -simd flavor; the clients pick it only where the runtime validates SIMD128.
+const flavors = targets.flatMap((target) => [
+  target,
+  {
+    ...target,
+    name: `${target.name}-simd`,
+    outputWasm: target.outputWasm.replace(/\.wasm$/, "-simd.wasm"),
+    simd: true
+  }
+]);
+
 mkdirSync(distDir, { recursive: true });
 
-for (const target of targets) {
+for (const target of flavors) {
   mkdirSync(target.outputDir, { recursive: true });
   const emccArgs = [
     ...target.sources,
     ...target.includes.flatMap((inc) => ["-I", inc]),
+    ...(target.defines ?? []).map((define) => `-D${define}`),
+    ...(target.simd ? ["-msimd128", "-mbulk-memory"] : []),
     "-O3",
     "--no-entry",
     "-s",
     "STANDALONE_WASM=1",
     "-s",
     "ALLOW_MEMORY_GROWTH=1",
+    // wasm64 builds pass pointers and size_t as i64 so RAM-backed images can outgrow 4 GB.
+    ...(target.memory64 ? ["-s", "MEMORY64=1", "-s", "MAXIMUM_MEMORY=16GB"] : ["-s", "MAXIMUM_MEMORY=4GB"]),
     "-s",
     "FILESYSTEM=0",
+    // The host block device callbacks are env imports the JS client supplies; the
+    // library lists them so every other undefined symbol still fails the link.
+    ...(target.hostImports ? ["--js-library", hostImportsLibrary] : []),
     "-s",
     `EXPORTED_FUNCTIONS=${target.exports}`,
     "-o",
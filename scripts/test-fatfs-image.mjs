@@ -1,3 +1,4 @@
+import { createHash } from "node:crypto";
 import { readFile } from "node:fs/promises";
 import path from "node:path";
 import { fileURLToPath, pathToFileURL } from "node:url";
@@ -58,8 +59,19 @@ globalThis.fetch = async (input, init) => {
   return originalFetch(input, init);
 };
 
+function supportsMemory64() {
+  try {
+    new WebAssembly.Memory({ initial: 1, index: "i64" });
+    return true;
+  } catch {
+    return false;
+  }
+}
+
 async function main() {
-const { createFatFS, createFatFSFromImage, FAT_MOUNT } = await import(moduleUrl.href);
+const { createFatFS, createFatFSFromCompressedImage, createFatFSFromImage, createFatFSOnDevice, FAT_MOUNT } = await import(
+  moduleUrl.href
+);
 
   const image = await readFile(imagePath);
   const hasBootMirror = isBootSector(image, 0) && isBootSector(image, 4096);
@@ -107,7 +119,7 @@ const { createFatFS, createFatFSFromImage, FAT_MOUNT } = await import(moduleUrl.
     }
   }
 
-  const scratch = await createFatFS({ wasmURL, formatOnInit: true });
+  const scratch = await createFatFS({ wasmURL, formatOnInit: true, ioStats: true });
   scratch.format();
   scratch.mkdir("/fatfs/test_dir");
   scratch.writeFile("/fatfs/test_dir/hello.txt", "fatfs wasm test");
@@ -120,8 +132,142 @@ const { createFatFS, createFatFSFromImage, FAT_MOUNT } = await import(moduleUrl.
   console.log("scratch read:", JSON.stringify(new TextDecoder().decode(readBack)));
   scratch.deleteFile("/fatfs/test_dir/renamed.txt");
   console.log("scratch usage:", scratch.getUsage());
+  const ioStats = scratch.getIoStats();
+  console.log("scratch I/O:", ioStats.totalErases, "sector writes,", ioStats.totalReadBytes, "bytes read");
+  if (ioStats.totalProgBytes !== ioStats.totalErases * 4096 || ioStats.totalReadBytes === 0) {
+    throw new Error("I/O statistics do not match the sector writes");
+  }
   console.log("scratch image bytes:", scratch.toImage().length);
 
+  const tree = await createFatFS({ wasmURL, formatOnInit: true });
+  const emptyUsed = tree.getUsage({ forceScan: true }).usedBytes;
+  tree.writeFile("/fatfs/keep.txt", "keep");
+  const keepUsed = tree.getUsage({ forceScan: true }).usedBytes;
+  tree.writeFile("/fatfs/tree/top.txt", "top");
+  tree.writeFile("/fatfs/tree/a/mid.txt", "mid");
+  tree.writeFile("/fatfs/tree/a/b/deep.bin", new Uint8Array(20000).fill(7));
+  tree.mkdir("/fatfs/tree/empty");
+  if (tree.getUsage({ forceScan: true }).usedBytes <= keepUsed) {
+    throw new Error("nested tree did not take any clusters");
+  }
+  let refused = false;
+  try {
+    tree.delete("/fatfs/tree");
+  } catch {
+    refused = true;
+  }
+  if (!refused) {
+    throw new Error("non-recursive delete removed a non-empty directory");
+  }
+  tree.delete("/fatfs/tree", { recursive: true });
+  const treeLeft = tree.list(FAT_MOUNT).map((entry) => entry.path);
+  console.log("after recursive delete:", treeLeft);
+  if (treeLeft.some((path) => path.includes("tree")) || !treeLeft.some((path) => path.endsWith("keep.txt"))) {
+    throw new Error("recursive delete removed the wrong entries");
+  }
+  if (tree.getUsage({ forceScan: true }).usedBytes !== keepUsed) {
+    throw new Error("recursive delete did not free the tree's clusters");
+  }
+  tree.writeFile("/fatfs/tree/again.txt", "again");
+  tree.delete(FAT_MOUNT, { recursive: true });
+  if (tree.list(FAT_MOUNT).length !== 0) {
+    throw new Error("recursive delete of the mount root left entries behind");
+  }
+  if (tree.getUsage({ forceScan: true }).usedBytes !== emptyUsed) {
+    throw new Error("recursive delete of the mount root did not free every cluster");
+  }
+  tree.writeFile("/fatfs/after.txt", "still mounted");
+  if (new TextDecoder().decode(tree.readFile("/fatfs/after.txt")) !== "still mounted") {
+    throw new Error("volume unusable after deleting the mount root");
+  }
+
+  const snap = scratch.snapshot();
+  scratch.writeFile("/fatfs/variant.cfg", "sku=1");
+  console.log("snapshot holds", scratch.snapshotBlocks(snap), "sectors after one write");
+  scratch.restore(snap);
+  if (scratch.list("/fatfs").some((entry) => entry.path.endsWith("variant.cfg"))) {
+    throw new Error("restore() did not roll back the write");
+  }
+  const beforePatch = scratch.toImage();
+  scratch.writeFile("/fatfs/variant.cfg", "sku=2");
+  const patch = scratch.diff(snap, { granularity: 512 });
+  const patched = await createFatFSFromImage(beforePatch, { wasmURL });
+  patched.applyPatch(patch);
+  console.log("patch bytes:", patch.length, "for a", beforePatch.length, "byte image");
+  if (new TextDecoder().decode(patched.readFile("/fatfs/variant.cfg")) !== "sku=2") {
+    throw new Error("applyPatch() did not reproduce the write");
+  }
+  const sparse = scratch.toSparseImage({ skipErased: true });
+  const sparseBytes = sparse.extents.reduce((sum, extent) => sum + extent.data.length, 0);
+  console.log("sparse export:", sparse.extents.length, "extents,", sparseBytes, "of", sparse.imageBytes, "bytes");
+  const rebuilt = new Uint8Array(sparse.imageBytes).fill(0xff);
+  sparse.extents.forEach((extent) => rebuilt.set(extent.data, extent.offset));
+  const fromSparse = await createFatFSFromImage(rebuilt, { wasmURL });
+  if (new TextDecoder().decode(fromSparse.readFile("/fatfs/variant.cfg")) !== "sku=2" || sparseBytes >= sparse.imageBytes) {
+    throw new Error("toSparseImage() did not keep exactly the allocated sectors");
+  }
+  const scratchImage = scratch.toImage();
+  const compressed = new Uint8Array(await new Response(scratch.toCompressedStream()).arrayBuffer());
+  const inflated = await createFatFSFromCompressedImage(compressed, { wasmURL, blockCount: scratchImage.length / 4096 });
+  console.log("gzip image:", compressed.length, "bytes for", scratchImage.length);
+  if (!Buffer.from(inflated.toImage()).equals(Buffer.from(scratchImage))) {
+    throw new Error("compressed round trip changed the image");
+  }
+  const variantHash = Buffer.from(scratch.hashFile("/fatfs/variant.cfg", "sha256")).toString("hex");
+  if (variantHash !== createHash("sha256").update("sku=2").digest("hex")) {
+    throw new Error("hashFile() does not match the file contents");
+  }
+  const sectorHashes = scratch.hashBlocks("sha256", { first: 1, count: 2 });
+  const secondSector = createHash("sha256").update(scratchImage.subarray(2 * 4096, 3 * 4096)).digest();
+  if (sectorHashes.length !== 64 || !Buffer.from(sectorHashes.subarray(32)).equals(secondSector)) {
+    throw new Error("hashBlocks() does not match the image sectors");
+  }
+  const imageHash = createHash("sha256").update(scratchImage).digest();
+  if (!Buffer.from(scratch.hashRange("sha256", 0, scratchImage.length)).equals(imageHash)) {
+    throw new Error("hashRange() does not match the exported image");
+  }
+  scratch.restore(snap);
+  scratch.releaseSnapshot(snap);
+
+  const backing = new Uint8Array(scratchImage);
+  let flushed = false;
+  const card = await createFatFSOnDevice(
+    {
+      read: (offset, target) => target.set(backing.subarray(offset, offset + target.length)),
+      write: (offset, data) => backing.set(data, offset),
+      flush: () => {
+        flushed = true;
+      },
+    },
+    { wasmURL, blockCount: backing.length / 4096, cacheBlocks: 16, readAheadBlocks: 4 }
+  );
+  card.writeFile("/fatfs/device.txt", "on the host");
+  card.flush();
+  const fromDevice = await createFatFSFromImage(backing, { wasmURL });
+  console.log("host device list:", fromDevice.list("/fatfs").map((entry) => entry.path));
+  if (!flushed || new TextDecoder().decode(fromDevice.readFile("/fatfs/device.txt")) !== "on the host") {
+    throw new Error("createFatFSOnDevice() did not write back through the host device");
+  }
+
+  if (supportsMemory64()) {
+    const wide = await createFatFS({
+      wasmURL: new URL("fatfs64.wasm", wasmURL),
+      memory64: true,
+      formatOnInit: true,
+      format: { type: "exfat" },
+      blockCount: 4096,
+    });
+    wide.writeFile("/fatfs/wide.bin", new Uint8Array(300000).fill(7));
+    const wideUsage = wide.getUsage();
+    const wideSparse = wide.toSparseImage();
+    console.log("memory64 usage:", wideUsage, "sparse extents:", wideSparse.extents.length);
+    if (wide.readFile("/fatfs/wide.bin").length !== 300000 || wideUsage.capacityBytes > 4096 * 4096) {
+      throw new Error("memory64 build disagrees with the wasm32 one");
+    }
+  } else {
+    console.log("memory64 not supported by this runtime, skipping fatfs64.wasm");
+  }
+
   scratch.writeFile("/fatfs/wipe_check.txt", "wipe me");
   scratch.format();
   const wipedList = scratch.list("/fatfs");
@@ -1,8 +1,16 @@
 #!/usr/bin/env node
 
 import assert from "node:assert";
+import { createHash } from "node:crypto";
 import { readFile } from "node:fs/promises";
-import { createLittleFS, createLittleFSFromImage } from "../dist/littlefs/index.js";
+import zlib from "node:zlib";
+import {
+  createLittleFS,
+  createLittleFSFromCompressedImage,
+  createLittleFSFromImage,
+  createLittleFSOnDevice,
+  LittleFSError,
+} from "../dist/littlefs/index.js";
 
 // Minimal file:// fetch support for Node so the wasm loader works in tests.
 const originalFetch = globalThis.fetch;
@@ -46,6 +54,126 @@ async function main() {
   const remaining = fs2.list("/").map((e) => e.path);
   assert(!remaining.some((p) => p.startsWith("notes")), "recursive delete failed");
 
+  // Appends
+  fs2.appendFile("docs/readme.txt", " world");
+  fs2.appendFiles([
+    { path: "docs/readme.txt", data: "!" },
+    { path: "docs/app.log", data: "a\n" },
+    { path: "docs/readme.txt", data: "?" },
+  ]);
+  assert.strictEqual(new TextDecoder().decode(fs2.readFile("docs/readme.txt")), "hello world!?");
+  assert.strictEqual(new TextDecoder().decode(fs2.readFile("docs/app.log")), "a\n");
+
+  // I/O statistics
+  assert.strictEqual(fs2.getIoStats(), null, "I/O statistics should be off by default");
+  const counted = await createLittleFS({ formatOnInit: true, ioStats: true });
+  counted.resetIoStats();
+  counted.writeFile("counted.bin", new Uint8Array(4096));
+  counted.readFile("counted.bin");
+  const stats = counted.getIoStats();
+  assert.strictEqual(stats.blockCount, 512);
+  assert(stats.totalErases > 0 && stats.totalProgBytes >= 4096 && stats.totalReadBytes >= 4096);
+  assert.strictEqual(stats.erases.reduce((a, b) => a + b, 0), stats.totalErases);
+  counted.resetIoStats();
+  assert.strictEqual(counted.getIoStats().totalProgBytes, 0);
+
+  // Snapshots
+  const before = fs2.toImage();
+  const snap = fs2.snapshot();
+  assert.strictEqual(fs2.snapshotBlocks(snap), 0);
+  fs2.writeFile("docs/config.json", "{\"sku\":1}");
+  assert(fs2.snapshotBlocks(snap) > 0, "snapshot did not record the changed blocks");
+  fs2.restore(snap);
+  assert.deepStrictEqual(fs2.toImage(), before, "restore did not bring back the snapshot image");
+  assert(!fs2.list("/").some((e) => e.path === "docs/config.json"), "restored volume still has the new file");
+  fs2.releaseSnapshot(snap);
+  assert.throws(() => fs2.restore(snap), LittleFSError);
+
+  // Block patches
+  const patchBase = fs2.snapshot();
+  fs2.writeFile("docs/config.json", "{\"sku\":2}");
+  const patch = fs2.diff(patchBase, { granularity: 256 });
+  assert.deepStrictEqual(fs2.diff(before, { granularity: 256 }), patch, "snapshot and image diffs disagree");
+  assert(patch.length < before.length / 4, "patch should only carry the changed blocks");
+  const target = await createLittleFSFromImage(before, { blockSize: 512, blockCount: before.length / 512 });
+  target.applyPatch(patch);
+  assert.deepStrictEqual(target.toImage(), fs2.toImage(), "patched image differs");
+  assert.strictEqual(new TextDecoder().decode(target.readFile("docs/config.json")), "{\"sku\":2}");
+  assert.throws(() => target.applyPatch(patch.subarray(0, patch.length - 1)), LittleFSError);
+
+  // Sparse export
+  const live = fs2.toImage();
+  const sparse = fs2.toSparseImage();
+  assert.strictEqual(sparse.imageBytes, live.length);
+  const rebuilt = new Uint8Array(live.length).fill(0x5a);
+  for (const extent of sparse.extents) {
+    assert.deepStrictEqual(extent.data, live.subarray(extent.offset, extent.offset + extent.data.length));
+    rebuilt.set(extent.data, extent.offset);
+  }
+  const fromSparse = await createLittleFSFromImage(rebuilt, { blockSize: 512, blockCount: rebuilt.length / 512 });
+  assert.strictEqual(new TextDecoder().decode(fromSparse.readFile("docs/config.json")), "{\"sku\":2}");
+  const sparseBytes = (image) => image.extents.reduce((sum, extent) => sum + extent.data.length, 0);
+  assert(sparseBytes(sparse) < live.length, "sparse export should leave out free blocks");
+  assert(sparseBytes(fs2.toSparseImage({ skipErased: true })) <= sparseBytes(sparse));
+
+  // Compressed streams
+  const geometry = { blockSize: 512, blockCount: live.length / 512 };
+  const compressed = new Uint8Array(await new Response(fs2.toCompressedStream()).arrayBuffer());
+  assert(compressed.length < live.length, "compressed image should be smaller than the raw one");
+  assert.deepStrictEqual((await createLittleFSFromCompressedImage(compressed, geometry)).toImage(), live);
+  const streamed = await createLittleFSFromCompressedImage(
+    fs2.toCompressedStream({ compression: "deflate-raw", chunkSize: 1000 }),
+    { ...geometry, compression: "deflate-raw" }
+  );
+  assert.deepStrictEqual(streamed.toImage(), live, "streamed import differs");
+  await assert.rejects(createLittleFSFromCompressedImage(compressed, { ...geometry, blockCount: geometry.blockCount + 1 }));
+
+  // Hashing inside wasm
+  const sha256 = (bytes) => new Uint8Array(createHash("sha256").update(bytes).digest());
+  assert.deepStrictEqual(fs2.hashFile("docs/config.json", "sha256"), sha256(fs2.readFile("docs/config.json")));
+  assert.deepStrictEqual(fs2.hashRange("sha256", 512, 4096), sha256(live.subarray(512, 4608)));
+  const blockDigests = fs2.hashBlocks("sha256", { first: 2, count: 3 });
+  assert.strictEqual(blockDigests.length, 3 * 32);
+  assert.deepStrictEqual(blockDigests.subarray(32, 64), sha256(live.subarray(3 * 512, 4 * 512)));
+  const blockCrcs = fs2.hashBlocks("crc32");
+  assert.strictEqual(blockCrcs.length, geometry.blockCount);
+  if (typeof zlib.crc32 === "function") {
+    assert.strictEqual(blockCrcs[5], zlib.crc32(live.subarray(5 * 512, 6 * 512)));
+    assert.strictEqual(fs2.hashRange("crc32", 0, live.length)[0], zlib.crc32(live));
+  }
+  assert.throws(() => fs2.hashFile("missing.bin", "crc32"), LittleFSError);
+  assert.throws(() => fs2.hashBlocks("crc32", { first: geometry.blockCount, count: 1 }), LittleFSError);
+
+  // Scalar and SIMD modules produce the same image
+  const scalar = await createLittleFSFromImage(live, { ...geometry, simd: false });
+  scalar.writeFile("docs/config.json", "{\"sku\":3}");
+  fs2.writeFile("docs/config.json", "{\"sku\":3}");
+  assert.deepStrictEqual(scalar.toImage(), fs2.toImage(), "scalar and SIMD builds diverged");
+
+  // Host block device behind the wasm block cache
+  const backing = new Uint8Array(live.length).fill(0x5a);
+  let hostCalls = 0;
+  const device = {
+    read: (offset, target) => {
+      hostCalls++;
+      target.set(backing.subarray(offset, offset + target.length));
+    },
+    write: (offset, data) => {
+      hostCalls++;
+      backing.set(data, offset);
+    },
+  };
+  await assert.rejects(createLittleFSOnDevice(device, geometry), "unformatted device should not mount");
+  const onDevice = await createLittleFSOnDevice(device, { ...geometry, formatOnInit: true, cacheBlocks: 8, readAheadBlocks: 4 });
+  const payload = new Uint8Array(64 * 1024).map((_, i) => (i * 13) & 0xff);
+  onDevice.writeFile("big.bin", payload);
+  onDevice.flush();
+  assert(hostCalls < (2 * payload.length) / 512, "block cache should batch host calls");
+  assert.deepStrictEqual((await createLittleFSFromImage(backing, geometry)).readFile("big.bin"), payload);
+  const remounted = await createLittleFSOnDevice(device, { ...geometry, cacheBlocks: 4, readAheadBlocks: 2 });
+  assert.deepStrictEqual(remounted.readFile("big.bin"), payload);
+  assert.throws(() => remounted.toImage(), LittleFSError);
+
   console.log("littlefs self-test passed");
 }
 
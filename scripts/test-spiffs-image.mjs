@@ -1,3 +1,4 @@
+import { createHash } from 'node:crypto';
 import { readFile, stat } from 'node:fs/promises';
 import { resolve } from 'node:path';
 import { fileURLToPath } from 'node:url';
@@ -33,13 +34,22 @@ try {
   const bytes = await readFile(imagePath);
   const trimmed = bytes.slice(0, blockCount * blockSize);
 
-  const { createSpiffsFromImage } = await import('../dist/spiffs/index.js');
+  const { createSpiffs, createSpiffsFromCompressedImage, createSpiffsFromImage } = await import('../dist/spiffs/index.js');
+  const progress = [];
   const spiffs = await createSpiffsFromImage(trimmed, {
     blockSize,
     blockCount,
     pageSize: 256,
+    check: 'full',
+    onCheckProgress: (step) => progress.push(step.pass),
+    ioStats: true,
+    ramDirect: false,
   });
   console.log('Mounted SPIFFS image', blockCount, 'blocks');
+  console.log('Check passes', progress.join(', '), 'report', spiffs.getCheckReport());
+  if (progress.join(',') !== 'lookup,index,page' || spiffs.getCheckReport()?.mode !== 'full') {
+    throw new Error('full check did not report its passes');
+  }
 
   const entries = await spiffs.list();
   console.log('Entry count', entries.length);
@@ -70,6 +80,19 @@ try {
   if (typeof spiffs.canFit === 'function') {
     const fit = spiffs.canFit('/conformance.txt', 64);
     console.log('canFit /conformance.txt for 64 bytes?', fit);
+    const usage = await spiffs.getUsage();
+    const oversized = spiffs.canFit('/conformance.txt', usage.capacityBytes + 1);
+    if (!fit || oversized) {
+      throw new Error('canFit disagrees with an empty filesystem');
+    }
+    const batch = spiffs.canFitAll([
+      { name: '/a.bin', size: 1024 },
+      { name: '/b.bin', size: 4096 },
+    ]);
+    console.log('canFitAll for two files?', batch);
+    if (!batch.fits || batch.requiredPages > batch.availablePages) {
+      throw new Error('canFitAll rejected two small files on an empty filesystem');
+    }
   } else {
     console.log('canFit not available on this instance');
   }
@@ -80,11 +103,233 @@ try {
   console.log('Wrote', testFile, testPayload.length, 'bytes');
   const readBack = await spiffs.read(testFile);
   console.log('Read back', testFile, readBack.length, 'bytes ->', Buffer.from(readBack).toString('utf8'));
+  const middle = await spiffs.readRange(testFile, 7, 7);
+  const tail = await spiffs.readRange(testFile, testPayload.length - 3, 100);
+  console.log('readRange', testFile, '->', Buffer.from(middle).toString('utf8'), Buffer.from(tail).toString('utf8'));
+  if (
+    !Buffer.from(middle).equals(testPayload.subarray(7, 14)) ||
+    !Buffer.from(tail).equals(testPayload.subarray(testPayload.length - 3))
+  ) {
+    throw new Error('readRange returned the wrong bytes');
+  }
+  const whole = await spiffs.readRange(testFile, 0, 0x7fffffff);
+  const pastEnd = await spiffs.readRange(testFile, testPayload.length + 10, 0x7fffffff);
+  if (!Buffer.from(whole).equals(testPayload) || pastEnd.length !== 0) {
+    throw new Error('readRange did not clamp a length past the end of the file');
+  }
+  await spiffs.appendFile(testFile, '+1');
+  await spiffs.appendFiles([
+    { name: testFile, data: '+2' },
+    { name: '/spiffs-test-log.txt', data: 'line\n' },
+    { name: testFile, data: '+3' },
+  ]);
+  const appended = Buffer.from(await spiffs.read(testFile));
+  if (!appended.equals(Buffer.concat([testPayload, Buffer.from('+1+2+3')]))) {
+    throw new Error('appendFile/appendFiles produced the wrong contents');
+  }
+  console.log('Appended to', testFile, '->', appended.length, 'bytes');
+  await spiffs.remove('/spiffs-test-log.txt');
   await spiffs.remove(testFile);
   console.log('Removed', testFile);
 
+  await spiffs.write('/www/css/site.css', 'body{}');
+  await spiffs.write('/www/index.html', '<html></html>');
+  await spiffs.write('/wwwroot.txt', 'not in www');
+  const tree = await spiffs.list('/www/', { directories: true });
+  console.log('list /www/', tree.map((e) => e.type + ' ' + e.name).join(', '));
+  const expectedTree = ['dir /www/css', 'file /www/css/site.css', 'file /www/index.html'];
+  if (tree.map((e) => e.type + ' ' + e.name).join('|') !== expectedTree.join('|')) {
+    throw new Error('list(prefix) returned the wrong entries');
+  }
+  if ((await spiffs.removePrefix('/www/')) !== 2) {
+    throw new Error('removePrefix did not remove the /www files');
+  }
+  await spiffs.remove('/wwwroot.txt');
+
+  const ioStats = await spiffs.getIoStats();
+  console.log('I/O since mount', ioStats.totalErases, 'erases', ioStats.totalProgBytes, 'bytes programmed');
+  if (ioStats.blockCount !== blockCount || ioStats.totalErases === 0 || ioStats.totalReadBytes === 0) {
+    throw new Error('I/O statistics missed the test writes');
+  }
+  await spiffs.resetIoStats();
+
+  const beforeSnapshot = await spiffs.toImage();
+  const snap = await spiffs.snapshot();
+  await spiffs.write('/variant.cfg', 'sku=1');
+  console.log('Snapshot holds', await spiffs.snapshotBlocks(snap), 'blocks after one write');
+  await spiffs.restore(snap);
+  if (!Buffer.from(await spiffs.toImage()).equals(Buffer.from(beforeSnapshot))) {
+    throw new Error('restore did not bring back the snapshot image');
+  }
+  await spiffs.write('/variant.cfg', 'sku=2');
+  const patch = await spiffs.diff(snap, { granularity: 256 });
+  const patched = await createSpiffsFromImage(beforeSnapshot, { blockSize, blockCount, pageSize: 256 });
+  await patched.applyPatch(patch);
+  console.log('Patch bytes', patch.length, 'for a', beforeSnapshot.length, 'byte image');
+  if (!Buffer.from(await patched.toImage()).equals(Buffer.from(await spiffs.toImage()))) {
+    throw new Error('applyPatch did not reproduce the live image');
+  }
+  const sparse = await spiffs.toSparseImage();
+  const rebuilt = new Uint8Array(sparse.imageBytes).fill(0xff);
+  sparse.extents.forEach((extent) => rebuilt.set(extent.data, extent.offset));
+  console.log('Sparse export', sparse.extents.length, 'extents for a', sparse.imageBytes, 'byte image');
+  if (!Buffer.from(rebuilt).equals(Buffer.from(await spiffs.toImage()))) {
+    throw new Error('toSparseImage dropped pages that are not erased');
+  }
+  const compressed = new Uint8Array(await new Response(spiffs.toCompressedStream({ compression: 'deflate' })).arrayBuffer());
+  const inflated = await createSpiffsFromCompressedImage(compressed, { blockSize, blockCount, pageSize: 256, compression: 'deflate' });
+  console.log('Deflated image', compressed.length, 'bytes for', blockCount * blockSize);
+  if (!Buffer.from(await inflated.toImage()).equals(Buffer.from(await spiffs.toImage()))) {
+    throw new Error('compressed round trip changed the image');
+  }
+  const variantHash = Buffer.from(await spiffs.hashFile('/variant.cfg', 'sha256')).toString('hex');
+  if (variantHash !== createHash('sha256').update('sku=2').digest('hex')) {
+    throw new Error('hashFile does not match the file contents');
+  }
+  const liveImage = await spiffs.toImage();
+  const blockHashes = await spiffs.hashBlocks('sha256');
+  const lastBlock = createHash('sha256').update(liveImage.subarray((blockCount - 1) * blockSize)).digest();
+  if (blockHashes.length !== blockCount * 32 || !Buffer.from(blockHashes.subarray((blockCount - 1) * 32)).equals(lastBlock)) {
+    throw new Error('hashBlocks does not match the image blocks');
+  }
+  const rangeHash = createHash('sha256').update(liveImage.subarray(blockSize, 2 * blockSize)).digest();
+  if (!Buffer.from(await spiffs.hashRange('sha256', blockSize, blockSize)).equals(rangeHash)) {
+    throw new Error('hashRange does not match the image bytes');
+  }
+  await spiffs.restore(snap);
+  await spiffs.releaseSnapshot(snap);
+
   const exported = await spiffs.toImage();
   console.log('Exported image size after cleanup', exported.length);
+
+  const tight = await createSpiffs({ blockSize: 4096, blockCount: 16, pageSize: 256, fdCount: 4, formatOnInit: true });
+  let appends = 0;
+  let failures = 0;
+  for (let i = 0; failures < 8 && i < 2000; i++) {
+    const chunk = Buffer.alloc(233, i & 0xff);
+    try {
+      await tight.appendFile('/full.log', chunk);
+    } catch (error) {
+      failures++;
+      continue;
+    }
+    appends++;
+    const log = Buffer.from(await tight.read('/full.log'));
+    if (!log.subarray(log.length - chunk.length).equals(chunk)) {
+      throw new Error(`append ${i} on a nearly full volume reported success but lost its data`);
+    }
+  }
+  console.log('Nearly full volume took', appends, 'appends before', failures, 'failures');
+  if (failures === 0) {
+    throw new Error('appending never filled the volume');
+  }
+  await tight.remove('/full.log');
+  await tight.write('/after-full.txt', 'ok');
+  if (Buffer.from(await tight.read('/after-full.txt')).toString('utf8') !== 'ok') {
+    throw new Error('failed appends leaked file descriptors');
+  }
+
+  // Random churn on a small volume keeps it close to full, so most canFit
+  // answers come from the dry run rather than from free pages alone.
+  for (const seed of [7, 20]) {
+    const churn = await createSpiffs({ blockSize: 4096, blockCount: 16, pageSize: 256, formatOnInit: true });
+    let state = seed;
+    const next = () => {
+      state = (state + 0x6d2b79f5) | 0;
+      let t = Math.imul(state ^ (state >>> 15), state | 1);
+      t ^= t + Math.imul(t ^ (t >>> 7), t | 61);
+      return (t ^ (t >>> 14)) >>> 0;
+    };
+    for (let op = 0; op < 400; op++) {
+      const name = `/f${next() % 12}`;
+      const kind = next() % 10;
+      if (kind < 2) {
+        await churn.remove(name).catch(() => {});
+        continue;
+      }
+      if (kind < 4) {
+        await churn.appendFile(name, new Uint8Array(next() % 700)).catch(() => {});
+        continue;
+      }
+      const size = next() % 12000;
+      const fits = churn.canFit(name, size);
+      let wrote = true;
+      try {
+        await churn.write(name, new Uint8Array(size));
+      } catch (error) {
+        if (error.code !== -10001) {
+          throw error;
+        }
+        wrote = false;
+      }
+      if (fits !== wrote) {
+        throw new Error(`canFit(${name}, ${size}) answered ${fits} but the write ${wrote ? 'succeeded' : 'ran out of space'} (seed ${seed}, op ${op})`);
+      }
+    }
+  }
+  console.log('canFit agreed with every write during churn');
+
+  // Rewriting a file leaves its old pages deleted; gc() and gcQuick() turn
+  // them back into erased pages without touching live data.
+  const collected = await createSpiffs({ blockSize: 4096, blockCount: 16, pageSize: 256, formatOnInit: true });
+  const erasedPages = (image) => {
+    let count = 0;
+    for (let offset = 0; offset < image.length; offset += 256) {
+      if (image.subarray(offset, offset + 256).every((byte) => byte === 0xff)) {
+        count++;
+      }
+    }
+    return count;
+  };
+  await collected.write('/keep.txt', Buffer.alloc(1000, 0x4b));
+  for (let i = 0; i < 9; i++) {
+    await collected.write('/churn.bin', Buffer.alloc(4000, i));
+  }
+  const churned = erasedPages(await collected.toImage());
+  const quick = await collected.gcQuick();
+  if (typeof quick !== 'boolean') {
+    throw new Error(`gcQuick() returned ${typeof quick}, expected a boolean`);
+  }
+  const afterQuick = erasedPages(await collected.toImage());
+  if (quick ? afterQuick <= churned : afterQuick !== churned) {
+    throw new Error(`gcQuick() returned ${quick} but erased pages went from ${churned} to ${afterQuick}`);
+  }
+  const { freeBytes } = await collected.getUsage();
+  await collected.gc({ targetFreeBytes: freeBytes - 2 * 4096 });
+  const afterGc = erasedPages(await collected.toImage());
+  console.log('Erased pages after churn', churned, 'gcQuick', afterQuick, 'gc', afterGc);
+  if (afterGc <= afterQuick) {
+    throw new Error('gc({ targetFreeBytes }) did not free any pages');
+  }
+  if (!Buffer.from(await collected.read('/churn.bin')).equals(Buffer.alloc(4000, 8))) {
+    throw new Error('gc() damaged a live file');
+  }
+  await collected.write('/reserved.bin', Buffer.alloc(8000, 0x52), { reserve: true });
+  if (!Buffer.from(await collected.read('/reserved.bin')).equals(Buffer.alloc(8000, 0x52))) {
+    throw new Error('write(..., { reserve: true }) did not store the file');
+  }
+
+  // Images from other tools may store names without the leading slash; list()
+  // finds those, so removePrefix() has to delete them too.
+  const seeded = await createSpiffs({ blockSize: 4096, blockCount: 16, pageSize: 256, formatOnInit: true });
+  await seeded.write('/seed/slashed.txt', 'a');
+  await seeded.write('/seed/unslashed.txt', 'b');
+  await seeded.write('/other.txt', 'c');
+  const seededImage = await seeded.toImage();
+  const slashedName = Buffer.from('/seed/unslashed.txt\0');
+  const nameAt = Buffer.from(seededImage).indexOf(slashedName);
+  if (nameAt < 0) {
+    throw new Error('seeded object name not found in the image');
+  }
+  seededImage.set(Buffer.from('seed/unslashed.txt\0\0'), nameAt);
+  for (const prefix of ['seed', '/seed/', '']) {
+    const mixed = await createSpiffsFromImage(seededImage, { blockSize: 4096, blockCount: 16, pageSize: 256 });
+    const listed = (await mixed.list(prefix)).length;
+    const removed = await mixed.removePrefix(prefix);
+    if (removed !== listed || (await mixed.list(prefix)).length !== 0) {
+      throw new Error(`removePrefix("${prefix}") removed ${removed} of the ${listed} files list() returned`);
+    }
+  }
 } finally {
   globalThis.fetch = originalFetch;
 }
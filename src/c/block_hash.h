@@ -0,0 +1,241 @@
+#ifndef BLOCK_HASH_H
+#define BLOCK_HASH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * CRC32 and SHA-256 over wasm memory, shared by the LittleFS, FatFS and
+ * SPIFFS modules so volumes and files can be hashed where they live instead
+ * of being exported to JS first. Digests are written out as they are usually
+ * printed: CRC32 (IEEE, as in zlib) as a little-endian u32, SHA-256 as its
+ * 32 bytes.
+ */
+#define BLOCKHASH_CRC32 1u
+#define BLOCKHASH_SHA256 2u
+
+#define BLOCKHASH_OK 0
+#define BLOCKHASH_ERR_INVAL -1
+
+typedef struct {
+    uint32_t algorithm;
+    uint32_t crc;
+    uint32_t state[8];
+    uint64_t bytes;
+    uint8_t pending[64];
+    uint32_t pending_len;
+} blockhash_ctx;
+
+static uint32_t g_blockhash_crc_table[8][256];
+static bool g_blockhash_crc_ready = false;
+
+static void blockhash_crc32_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1u)));
+        }
+        g_blockhash_crc_table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) {
+            uint32_t prev = g_blockhash_crc_table[k - 1][i];
+            g_blockhash_crc_table[k][i] =
+                (prev >> 8) ^ g_blockhash_crc_table[0][prev & 0xff];
+        }
+    }
+    g_blockhash_crc_ready = true;
+}
+
+static inline uint32_t blockhash_load_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+/* Slicing-by-8 over the reflected polynomial, without pre/post inversion. */
+static inline uint32_t blockhash_crc32_update(uint32_t crc, const uint8_t *data,
+                                              size_t size) {
+    if (!g_blockhash_crc_ready) {
+        blockhash_crc32_init();
+    }
+    uint32_t (*t)[256] = g_blockhash_crc_table;
+    while (size >= 8) {
+        uint32_t lo = blockhash_load_le32(data) ^ crc;
+        uint32_t hi = blockhash_load_le32(data + 4);
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^
+              t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^ t[3][hi & 0xff] ^
+              t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+        data += 8;
+        size -= 8;
+    }
+    while (size--) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xff];
+    }
+    return crc;
+}
+
+static const uint32_t g_blockhash_sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static inline uint32_t blockhash_rotr(uint32_t x, unsigned n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+static void blockhash_sha256_block(uint32_t *state, const uint8_t *p) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)p[4 * i] << 24) | ((uint32_t)p[4 * i + 1] << 16) |
+               ((uint32_t)p[4 * i + 2] << 8) | (uint32_t)p[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = blockhash_rotr(w[i - 15], 7) ^
+                      blockhash_rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = blockhash_rotr(w[i - 2], 17) ^
+                      blockhash_rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t s1 = blockhash_rotr(e, 6) ^ blockhash_rotr(e, 11) ^
+                      blockhash_rotr(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + ch + g_blockhash_sha256_k[i] + w[i];
+        uint32_t s0 = blockhash_rotr(a, 2) ^ blockhash_rotr(a, 13) ^
+                      blockhash_rotr(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + s0 + maj;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+static inline size_t blockhash_digest_bytes(uint32_t algorithm) {
+    return algorithm == BLOCKHASH_CRC32    ? 4
+           : algorithm == BLOCKHASH_SHA256 ? 32
+                                           : 0;
+}
+
+static int blockhash_init(blockhash_ctx *ctx, uint32_t algorithm) {
+    static const uint32_t iv[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                   0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                   0x1f83d9ab, 0x5be0cd19};
+    if (blockhash_digest_bytes(algorithm) == 0) {
+        return BLOCKHASH_ERR_INVAL;
+    }
+    ctx->algorithm = algorithm;
+    ctx->crc = 0xffffffffu;
+    memcpy(ctx->state, iv, sizeof(iv));
+    ctx->bytes = 0;
+    ctx->pending_len = 0;
+    return BLOCKHASH_OK;
+}
+
+static void blockhash_update(blockhash_ctx *ctx, const uint8_t *data,
+                             size_t len) {
+    if (ctx->algorithm == BLOCKHASH_CRC32) {
+        ctx->crc = blockhash_crc32_update(ctx->crc, data, len);
+        return;
+    }
+    ctx->bytes += len;
+    if (ctx->pending_len > 0) {
+        size_t take = 64 - ctx->pending_len;
+        if (take > len) {
+            take = len;
+        }
+        memcpy(ctx->pending + ctx->pending_len, data, take);
+        ctx->pending_len += (uint32_t)take;
+        data += take;
+        len -= take;
+        if (ctx->pending_len < 64) {
+            return;
+        }
+        blockhash_sha256_block(ctx->state, ctx->pending);
+        ctx->pending_len = 0;
+    }
+    while (len >= 64) {
+        blockhash_sha256_block(ctx->state, data);
+        data += 64;
+        len -= 64;
+    }
+    memcpy(ctx->pending, data, len);
+    ctx->pending_len = (uint32_t)len;
+}
+
+static void blockhash_final(blockhash_ctx *ctx, uint8_t *out) {
+    if (ctx->algorithm == BLOCKHASH_CRC32) {
+        uint32_t crc = ~ctx->crc;
+        out[0] = (uint8_t)crc;
+        out[1] = (uint8_t)(crc >> 8);
+        out[2] = (uint8_t)(crc >> 16);
+        out[3] = (uint8_t)(crc >> 24);
+        return;
+    }
+    uint64_t bits = ctx->bytes * 8;
+    uint8_t pad[72] = {0x80};
+    size_t pad_len = (ctx->pending_len < 56 ? 56 : 120) - ctx->pending_len;
+    for (int i = 0; i < 8; i++) {
+        pad[pad_len + i] = (uint8_t)(bits >> (56 - 8 * i));
+    }
+    blockhash_update(ctx, pad, pad_len + 8);
+    for (int i = 0; i < 8; i++) {
+        out[4 * i] = (uint8_t)(ctx->state[i] >> 24);
+        out[4 * i + 1] = (uint8_t)(ctx->state[i] >> 16);
+        out[4 * i + 2] = (uint8_t)(ctx->state[i] >> 8);
+        out[4 * i + 3] = (uint8_t)ctx->state[i];
+    }
+}
+
+/* One digest per unit_size bytes from base, written back to back into out. */
+static int blockhash_units(uint32_t algorithm, const uint8_t *base,
+                           size_t unit_size, uint32_t count, uint8_t *out) {
+    size_t digest = blockhash_digest_bytes(algorithm);
+    if (digest == 0 || !out) {
+        return BLOCKHASH_ERR_INVAL;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        blockhash_ctx ctx;
+        blockhash_init(&ctx, algorithm);
+        blockhash_update(&ctx, base + (size_t)i * unit_size, unit_size);
+        blockhash_final(&ctx, out + (size_t)i * digest);
+    }
+    return BLOCKHASH_OK;
+}
+
+static int blockhash_range(uint32_t algorithm, const uint8_t *data, size_t len,
+                           uint8_t *out) {
+    blockhash_ctx ctx;
+    if (!out || blockhash_init(&ctx, algorithm) != BLOCKHASH_OK) {
+        return BLOCKHASH_ERR_INVAL;
+    }
+    blockhash_update(&ctx, data, len);
+    blockhash_final(&ctx, out);
+    return BLOCKHASH_OK;
+}
+
+#endif /* BLOCK_HASH_H */
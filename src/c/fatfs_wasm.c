@@ -1,5 +1,6 @@
 #include <emscripten/emscripten.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,24 +8,84 @@
 
 #include "ff.h"
 #include "diskio.h"
+#include "block_hash.h"
+#include "block_ops.h"
+#include "host_block_cache.h"
+#include "image_patch.h"
 
 #define FATFSJS_SECTOR_SIZE 4096
 #define FATFSJS_PATH_MAX 512
 #define FATFSJS_MAX_READ_CHUNK 4096
+#define FATFSJS_MKFS_WORK_SECTORS 16
+
+#define FATFSJS_FEATURE_EXFAT 0x01
 
 #define FATFSJS_ERR_INVAL -1
 #define FATFSJS_ERR_NOT_MOUNTED -2
 #define FATFSJS_ERR_NOSPC -3
 #define FATFSJS_ERR_IO -4
 
+#define FATFSJS_DIRENT_SIZE 32
+#define FATFSJS_DIRINDEX_DIR_BUCKETS 1024
+#define FATFSJS_DIRINDEX_MIN_BUCKETS 1024
+
+/* One directory entry known to the name index. Entries are reachable by
+ * upper-cased long name, by 8.3 name and by table offset. */
+typedef struct fatfsjs_dirent {
+    struct fatfsjs_dirent *lfn_next;
+    struct fatfsjs_dirent *sfn_next;
+    struct fatfsjs_dirent *ofs_next;
+    struct fatfsjs_dirent *dir_prev;
+    struct fatfsjs_dirent *dir_next;
+    DWORD sclust;
+    DWORD ofs;
+    DWORD blk_ofs;
+    uint32_t lfn_hash;
+    BYTE sfn[11];
+    uint16_t lfn_len;
+    WCHAR lfn[];
+} fatfsjs_dirent;
+
+typedef struct fatfsjs_dirindex {
+    struct fatfsjs_dirindex *next;
+    DWORD sclust;
+    DWORD free_ofs;
+    bool ready;
+    fatfsjs_dirent *entries;
+} fatfsjs_dirindex;
+
 static FATFS g_fs;
 static bool g_is_mounted = false;
 static uint8_t *g_storage = NULL;
+static hostcache *g_host = NULL;
 static uint32_t g_sector_count = 0;
 static uint32_t g_volume_sector_count = 0;
 static uint32_t g_sector_offset = 0;
 static bool g_boot_mirror = false;
-static uint32_t g_total_bytes = 0;
+static size_t g_total_bytes = 0;
+static bool g_io_stats_enabled = false;
+static uint64_t *g_io_stats = NULL;
+static uint32_t g_io_stats_sectors = 0;
+
+typedef struct fatfsjs_snapshot {
+    struct fatfsjs_snapshot *older;
+    uint32_t id;
+    uint32_t saved;
+    uint8_t **sectors;
+} fatfsjs_snapshot_t;
+
+static fatfsjs_snapshot_t *g_snapshots = NULL;
+static uint32_t g_next_snapshot_id = 1;
+static DWORD g_fattime =
+    ((DWORD)(2025 - 1980) << 25) | ((DWORD)1 << 21) | ((DWORD)1 << 16);
+static MKFS_PARM g_format_options = {FM_FAT | FM_SFD, 0, 0, 0, 0};
+
+static fatfsjs_dirindex *g_dir_buckets[FATFSJS_DIRINDEX_DIR_BUCKETS];
+static fatfsjs_dirent **g_lfn_buckets = NULL;
+static fatfsjs_dirent **g_sfn_buckets = NULL;
+static fatfsjs_dirent **g_ofs_buckets = NULL;
+static uint32_t g_entry_buckets = 0;
+static uint32_t g_entry_count = 0;
 
 static int fatfsjs_result(FRESULT res) {
     return res == FR_OK ? 0 : -((int)res);
@@ -38,6 +99,11 @@ static uint16_t fatfsjs_read_u16(const uint8_t *ptr) {
     return (uint16_t)ptr[0] | ((uint16_t)ptr[1] << 8);
 }
 
+static uint32_t fatfsjs_read_u32(const uint8_t *ptr) {
+    return (uint32_t)fatfsjs_read_u16(ptr) |
+           ((uint32_t)fatfsjs_read_u16(ptr + 2) << 16);
+}
+
 static bool fatfsjs_starts_with_ci(const char *value, const char *prefix) {
     while (*prefix) {
         if (*value == '\0') {
@@ -65,20 +131,40 @@ static bool fatfsjs_is_boot_sector(const uint8_t *sector) {
     if (sector[510] != 0x55 || sector[511] != 0xAA) {
         return false;
     }
+    if (memcmp(sector + 3, "EXFAT   ", 8) == 0) {
+        /* exFAT keeps the BPB zeroed and stores log2(sector size) instead */
+        return (1u << sector[108]) == FATFSJS_SECTOR_SIZE;
+    }
     return fatfsjs_read_u16(sector + 11) == FATFSJS_SECTOR_SIZE;
 }
 
+/* Physical sector as stored, or read through the host cache into scratch.
+ * NULL when the host read fails. */
+static const uint8_t *fatfsjs_peek_sector(uint32_t sector, uint8_t *scratch) {
+    if (g_storage) {
+        return g_storage + (size_t)sector * FATFSJS_SECTOR_SIZE;
+    }
+    if (!g_host || !scratch ||
+        hostcache_read(g_host, (uint64_t)sector * FATFSJS_SECTOR_SIZE, scratch,
+                       FATFSJS_SECTOR_SIZE)) {
+        return NULL;
+    }
+    return scratch;
+}
+
 static void fatfsjs_detect_offset(void) {
     g_sector_offset = 0;
     g_volume_sector_count = g_sector_count;
     g_boot_mirror = false;
-    if (!g_storage || g_sector_count < 2) {
+    if ((!g_storage && !g_host) || g_sector_count < 2) {
         return;
     }
-    const uint8_t *s0 = g_storage;
-    const uint8_t *s1 = g_storage + FATFSJS_SECTOR_SIZE;
-    bool boot0 = fatfsjs_is_boot_sector(s0);
-    bool boot1 = fatfsjs_is_boot_sector(s1);
+    uint8_t *scratch =
+        g_host ? (uint8_t *)malloc(2 * FATFSJS_SECTOR_SIZE) : NULL;
+    bool boot0 = fatfsjs_is_boot_sector(fatfsjs_peek_sector(0, scratch));
+    bool boot1 = fatfsjs_is_boot_sector(fatfsjs_peek_sector(
+        1, scratch ? scratch + FATFSJS_SECTOR_SIZE : NULL));
+    free(scratch);
     if (boot1 && !boot0) {
         g_sector_offset = 1;
     } else if (boot0 && boot1) {
@@ -153,10 +239,14 @@ static int fatfsjs_build_ff_path(const char *path, char *out, size_t out_len) {
     return 0;
 }
 
-static int fatfsjs_emit_entry(const char *path, FSIZE_t size, char type,
+static int fatfsjs_emit_entry(const char *path, const FILINFO *info,
                               char **cursor, const char *end) {
-    int needed = snprintf(NULL, 0, "%s\t%lu\t%c\n", path ? path : "",
-                          (unsigned long)size, type);
+    char type = (info->fattrib & AM_DIR) ? 'd' : 'f';
+    unsigned long long size = (unsigned long long)info->fsize;
+    /* Packed FAT date/time: date in the high half, time in the low half */
+    unsigned long mtime = ((unsigned long)info->fdate << 16) | info->ftime;
+    int needed = snprintf(NULL, 0, "%s\t%llu\t%c\t%lu\n", path ? path : "",
+                          size, type, mtime);
     if (needed < 0) {
         return FATFSJS_ERR_IO;
     }
@@ -164,8 +254,8 @@ static int fatfsjs_emit_entry(const char *path, FSIZE_t size, char type,
         return FATFSJS_ERR_NOSPC;
     }
     int written =
-        snprintf(*cursor, (size_t)(end - *cursor), "%s\t%lu\t%c\n",
-                 path ? path : "", (unsigned long)size, type);
+        snprintf(*cursor, (size_t)(end - *cursor), "%s\t%llu\t%c\t%lu\n",
+                 path ? path : "", size, type, mtime);
     if (written != needed) {
         return FATFSJS_ERR_IO;
     }
@@ -223,8 +313,7 @@ static int fatfsjs_list_dir(const char *ff_path, const char *rel_prefix,
             return err;
         }
 
-        char type = (info.fattrib & AM_DIR) ? 'd' : 'f';
-        err = fatfsjs_emit_entry(rel_path, info.fsize, type, cursor, end);
+        err = fatfsjs_emit_entry(rel_path, &info, cursor, end);
         if (err) {
             f_closedir(&dir);
             return err;
@@ -273,7 +362,7 @@ static int fatfsjs_ensure_parent_dirs(const char *ff_path) {
         return 0;
     }
 
-    for (char *ptr = slash; ptr < last; ptr++) {
+    for (char *ptr = slash; ptr <= last; ptr++) {
         if (*ptr == '/') {
             *ptr = '\0';
             FRESULT res = f_mkdir(temp);
@@ -288,29 +377,39 @@ static int fatfsjs_ensure_parent_dirs(const char *ff_path) {
 }
 
 static int fatfsjs_format_internal(void) {
-    MKFS_PARM options;
-    options.fmt = (FM_FAT | FM_SFD);
-    options.n_fat = 0;
-    options.align = 0;
-    options.n_root = 0;
-    options.au_size = 0;
-
-    uint8_t *work = (uint8_t *)malloc(FATFSJS_SECTOR_SIZE);
+    MKFS_PARM options = g_format_options;
+
+    /* A larger work buffer lets f_mkfs clear the FAT/bitmap in fewer writes */
+    UINT work_len = FATFSJS_SECTOR_SIZE * FATFSJS_MKFS_WORK_SECTORS;
+    uint8_t *work = (uint8_t *)malloc(work_len);
+    if (!work) {
+        work_len = FATFSJS_SECTOR_SIZE;
+        work = (uint8_t *)malloc(work_len);
+    }
     if (!work) {
         return FATFSJS_ERR_NOSPC;
     }
-    FRESULT res = f_mkfs("0:", &options, work, FATFSJS_SECTOR_SIZE);
+    FRESULT res = f_mkfs("0:", &options, work, work_len);
     free(work);
     return fatfsjs_result(res);
 }
 
+static void fatfsjs_snapshots_free(void);
+
 static void fatfsjs_release(void) {
+    fatfsjs_snapshots_free();
     if (g_is_mounted) {
         f_mount(NULL, "0:", 0);
         g_is_mounted = false;
     }
+    ff_dirindex_clear(&g_fs);
     free(g_storage);
     g_storage = NULL;
+    if (g_host) {
+        hostcache_flush(g_host);
+        hostcache_destroy(g_host);
+        g_host = NULL;
+    }
     g_sector_count = 0;
     g_volume_sector_count = 0;
     g_sector_offset = 0;
@@ -319,6 +418,95 @@ static void fatfsjs_release(void) {
     memset(&g_fs, 0, sizeof(g_fs));
 }
 
+/* I/O counters per physical sector. While enabled, g_io_stats holds three
+ * totals (erases, programmed bytes, read bytes) followed by one array per
+ * counter. A RAM disk has no erase step, so every sector write counts as one
+ * erase, as it would on flash with 4 KB erase units. Disabled, disk_read and
+ * disk_write pay a single NULL check. */
+enum { FATFSJS_IO_ERASES, FATFSJS_IO_PROG, FATFSJS_IO_READ, FATFSJS_IO_KINDS };
+
+static void fatfsjs_io_stats_free(void) {
+    free(g_io_stats);
+    g_io_stats = NULL;
+    g_io_stats_sectors = 0;
+}
+
+static int fatfsjs_io_stats_alloc(uint32_t sector_count) {
+    fatfsjs_io_stats_free();
+    if (!g_io_stats_enabled || sector_count == 0) {
+        return 0;
+    }
+    g_io_stats = (uint64_t *)calloc(
+        FATFSJS_IO_KINDS * ((size_t)sector_count + 1), sizeof(uint64_t));
+    if (!g_io_stats) {
+        return FATFSJS_ERR_NOSPC;
+    }
+    g_io_stats_sectors = sector_count;
+    return 0;
+}
+
+static void fatfsjs_io_count(int kind, uint32_t sector, uint32_t count,
+                             uint64_t amount) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (sector + i >= g_io_stats_sectors) {
+            break;
+        }
+        g_io_stats[kind] += amount;
+        g_io_stats[FATFSJS_IO_KINDS + (size_t)kind * g_io_stats_sectors +
+                   sector + i] += amount;
+    }
+}
+
+/* Copy-on-write snapshots at sector granularity. The live image stays one
+ * buffer and a snapshot keeps the pre-image of each physical sector written
+ * after it was taken, so memory grows only with the sectors that change.
+ * Only the newest snapshot records pre-images; an older snapshot's view of a
+ * sector is the copy held by the oldest snapshot at or after it. */
+static void fatfsjs_snapshot_free(fatfsjs_snapshot_t *snap) {
+    for (uint32_t i = 0; snap->saved && i < g_sector_count; i++) {
+        if (snap->sectors[i]) {
+            free(snap->sectors[i]);
+            snap->saved--;
+        }
+    }
+    free(snap->sectors);
+    free(snap);
+}
+
+static void fatfsjs_snapshots_free(void) {
+    while (g_snapshots) {
+        fatfsjs_snapshot_t *older = g_snapshots->older;
+        fatfsjs_snapshot_free(g_snapshots);
+        g_snapshots = older;
+    }
+}
+
+static bool fatfsjs_snapshot_preserve(uint32_t sector, uint32_t count) {
+    fatfsjs_snapshot_t *snap = g_snapshots;
+    for (uint32_t i = 0; snap && i < count && sector + i < g_sector_count; i++) {
+        if (snap->sectors[sector + i]) {
+            continue;
+        }
+        uint8_t *copy = (uint8_t *)malloc(FATFSJS_SECTOR_SIZE);
+        if (!copy) {
+            return false;
+        }
+        memcpy(copy, g_storage + (size_t)(sector + i) * FATFSJS_SECTOR_SIZE,
+               FATFSJS_SECTOR_SIZE);
+        snap->sectors[sector + i] = copy;
+        snap->saved++;
+    }
+    return true;
+}
+
+static fatfsjs_snapshot_t **fatfsjs_snapshot_find(uint32_t id) {
+    fatfsjs_snapshot_t **cursor = &g_snapshots;
+    while (*cursor && (*cursor)->id != id) {
+        cursor = &(*cursor)->older;
+    }
+    return *cursor ? cursor : NULL;
+}
+
 static int fatfsjs_configure(uint32_t block_size, uint32_t block_count,
                              bool clear_storage) {
     if (block_size != FATFSJS_SECTOR_SIZE || block_count == 0) {
@@ -326,7 +514,7 @@ static int fatfsjs_configure(uint32_t block_size, uint32_t block_count,
     }
 
     uint64_t total = (uint64_t)block_size * block_count;
-    if (total == 0 || total > UINT32_MAX) {
+    if (total == 0 || total > SIZE_MAX) {
         return FATFSJS_ERR_INVAL;
     }
 
@@ -336,14 +524,44 @@ static int fatfsjs_configure(uint32_t block_size, uint32_t block_count,
         return FATFSJS_ERR_NOSPC;
     }
     if (clear_storage) {
-        memset(g_storage, 0xFF, (size_t)total);
+        blockops_fill_erased(g_storage, (size_t)total);
     }
     g_sector_count = block_count;
     g_volume_sector_count = block_count;
     g_sector_offset = 0;
     g_boot_mirror = false;
-    g_total_bytes = (uint32_t)total;
-    return 0;
+    g_total_bytes = (size_t)total;
+    return fatfsjs_io_stats_alloc(block_count);
+}
+
+/* Host block device: the volume lives with the JS client and FatFS reaches it
+ * through g_host, the write-back cache in host_block_cache.h. The imports
+ * move whole sectors; FatFS never erases. */
+__attribute__((import_module("env"), import_name("fatfsjs_host_read")))
+int fatfsjs_host_read(uint32_t sector, uint32_t count, uint8_t *data);
+__attribute__((import_module("env"), import_name("fatfsjs_host_write")))
+int fatfsjs_host_write(uint32_t sector, uint32_t count, uint8_t *data);
+
+static int fatfsjs_configure_host(uint32_t block_count, uint32_t cache_blocks,
+                                  uint32_t read_ahead) {
+    if (block_count == 0) {
+        return FATFSJS_ERR_INVAL;
+    }
+
+    fatfsjs_release();
+    g_host = hostcache_create(FATFSJS_SECTOR_SIZE, block_count, cache_blocks,
+                              read_ahead, fatfsjs_host_read, fatfsjs_host_write,
+                              NULL);
+    if (!g_host) {
+        return FATFSJS_ERR_NOSPC;
+    }
+    g_sector_count = block_count;
+    g_volume_sector_count = block_count;
+    return fatfsjs_io_stats_alloc(block_count);
+}
+
+static DRESULT fatfsjs_host_result(int err) {
+    return err ? RES_ERROR : RES_OK;
 }
 
 static int fatfsjs_mount_internal(bool allow_format) {
@@ -361,25 +579,25 @@ static int fatfsjs_mount_internal(bool allow_format) {
 }
 
 DWORD get_fattime(void) {
-    return ((DWORD)(2025 - 1980) << 25) | ((DWORD)1 << 21) | ((DWORD)1 << 16);
+    return g_fattime;
 }
 
 DSTATUS disk_initialize(BYTE pdrv) {
-    if (pdrv != 0 || !g_storage) {
+    if (pdrv != 0 || (!g_storage && !g_host)) {
         return STA_NOINIT;
     }
     return 0;
 }
 
 DSTATUS disk_status(BYTE pdrv) {
-    if (pdrv != 0 || !g_storage) {
+    if (pdrv != 0 || (!g_storage && !g_host)) {
         return STA_NOINIT;
     }
     return 0;
 }
 
 DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
-    if (pdrv != 0 || !g_storage || !buff || count == 0) {
+    if (pdrv != 0 || (!g_storage && !g_host) || !buff || count == 0) {
         return RES_PARERR;
     }
     if (sector + count > g_volume_sector_count) {
@@ -388,15 +606,26 @@ DRESULT disk_read(BYTE pdrv, BYTE *buff, LBA_t sector, UINT count) {
     uint64_t offset =
         (uint64_t)(sector + g_sector_offset) * FATFSJS_SECTOR_SIZE;
     uint64_t length = (uint64_t)count * FATFSJS_SECTOR_SIZE;
-    if (offset + length > g_total_bytes) {
+    if (g_host) {
+        DRESULT res =
+            fatfsjs_host_result(hostcache_read(g_host, offset, buff, length));
+        if (res != RES_OK) {
+            return res;
+        }
+    } else if (offset + length > g_total_bytes) {
         return RES_PARERR;
+    } else {
+        memcpy(buff, g_storage + offset, (size_t)length);
+    }
+    if (g_io_stats) {
+        fatfsjs_io_count(FATFSJS_IO_READ, (uint32_t)(sector + g_sector_offset),
+                         count, FATFSJS_SECTOR_SIZE);
     }
-    memcpy(buff, g_storage + offset, (size_t)length);
     return RES_OK;
 }
 
 DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count) {
-    if (pdrv != 0 || !g_storage || !buff || count == 0) {
+    if (pdrv != 0 || (!g_storage && !g_host) || !buff || count == 0) {
         return RES_PARERR;
     }
     if (sector + count > g_volume_sector_count) {
@@ -405,18 +634,44 @@ DRESULT disk_write(BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count) {
     uint64_t offset =
         (uint64_t)(sector + g_sector_offset) * FATFSJS_SECTOR_SIZE;
     uint64_t length = (uint64_t)count * FATFSJS_SECTOR_SIZE;
-    if (offset + length > g_total_bytes) {
+    if (g_host) {
+        DRESULT res =
+            fatfsjs_host_result(hostcache_write(g_host, offset, buff, length));
+        if (res == RES_OK && g_boot_mirror && sector == 0) {
+            res = fatfsjs_host_result(
+                hostcache_write(g_host, 0, buff, FATFSJS_SECTOR_SIZE));
+        }
+        if (res != RES_OK) {
+            return res;
+        }
+    } else if (offset + length > g_total_bytes) {
         return RES_PARERR;
+    } else {
+        if (!fatfsjs_snapshot_preserve((uint32_t)(sector + g_sector_offset),
+                                       count) ||
+            (g_boot_mirror && sector == 0 &&
+             !fatfsjs_snapshot_preserve(0, 1))) {
+            return RES_ERROR;
+        }
+        memcpy(g_storage + offset, buff, (size_t)length);
+        if (g_boot_mirror && sector == 0) {
+            memcpy(g_storage, buff, FATFSJS_SECTOR_SIZE);
+        }
     }
-    memcpy(g_storage + offset, buff, (size_t)length);
-    if (g_boot_mirror && sector == 0) {
-        memcpy(g_storage, buff, FATFSJS_SECTOR_SIZE);
+    if (g_io_stats) {
+        uint32_t physical = (uint32_t)(sector + g_sector_offset);
+        fatfsjs_io_count(FATFSJS_IO_ERASES, physical, count, 1);
+        fatfsjs_io_count(FATFSJS_IO_PROG, physical, count, FATFSJS_SECTOR_SIZE);
+        if (g_boot_mirror && sector == 0) {
+            fatfsjs_io_count(FATFSJS_IO_ERASES, 0, 1, 1);
+            fatfsjs_io_count(FATFSJS_IO_PROG, 0, 1, FATFSJS_SECTOR_SIZE);
+        }
     }
     return RES_OK;
 }
 
 DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff) {
-    if (pdrv != 0 || !g_storage) {
+    if (pdrv != 0 || (!g_storage && !g_host)) {
         return RES_PARERR;
     }
     switch (cmd) {
@@ -445,6 +700,351 @@ DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff) {
     }
 }
 
+static uint32_t fatfsjs_hash_step(uint32_t hash, uint32_t value) {
+    return (hash ^ value) * 16777619u;
+}
+
+static uint32_t fatfsjs_hash_sfn(DWORD sclust, const BYTE *sfn) {
+    uint32_t hash = fatfsjs_hash_step(2166136261u, sclust);
+    for (int i = 0; i < 11; i++) {
+        hash = fatfsjs_hash_step(hash, sfn[i]);
+    }
+    return hash;
+}
+
+static uint32_t fatfsjs_hash_ofs(DWORD sclust, DWORD ofs) {
+    return fatfsjs_hash_step(fatfsjs_hash_step(2166136261u, sclust), ofs);
+}
+
+static uint32_t fatfsjs_hash_lfn(DWORD sclust, const WCHAR *lfn,
+                                 uint16_t *len_out) {
+    uint32_t hash = fatfsjs_hash_step(2166136261u, sclust);
+    uint16_t len = 0;
+    while (lfn[len] && len < FF_MAX_LFN) {
+        hash = fatfsjs_hash_step(hash, (uint32_t)ff_wtoupper(lfn[len]));
+        len++;
+    }
+    *len_out = len;
+    return hash;
+}
+
+static fatfsjs_dirindex *fatfsjs_dirindex_get(DWORD sclust, bool create) {
+    uint32_t slot = sclust % FATFSJS_DIRINDEX_DIR_BUCKETS;
+    for (fatfsjs_dirindex *dir = g_dir_buckets[slot]; dir; dir = dir->next) {
+        if (dir->sclust == sclust) {
+            return dir;
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    fatfsjs_dirindex *dir = (fatfsjs_dirindex *)calloc(1, sizeof(*dir));
+    if (!dir) {
+        return NULL;
+    }
+    dir->sclust = sclust;
+    dir->next = g_dir_buckets[slot];
+    g_dir_buckets[slot] = dir;
+    return dir;
+}
+
+static void fatfsjs_dirent_link(fatfsjs_dirent *entry) {
+    uint32_t mask = g_entry_buckets - 1;
+    uint32_t slot = fatfsjs_hash_sfn(entry->sclust, entry->sfn) & mask;
+    entry->sfn_next = g_sfn_buckets[slot];
+    g_sfn_buckets[slot] = entry;
+
+    slot = fatfsjs_hash_ofs(entry->sclust, entry->ofs) & mask;
+    entry->ofs_next = g_ofs_buckets[slot];
+    g_ofs_buckets[slot] = entry;
+
+    entry->lfn_next = NULL;
+    if (entry->lfn_len) {
+        slot = entry->lfn_hash & mask;
+        entry->lfn_next = g_lfn_buckets[slot];
+        g_lfn_buckets[slot] = entry;
+    }
+}
+
+static void fatfsjs_dirent_unlink_chain(fatfsjs_dirent **head,
+                                        fatfsjs_dirent *entry, size_t link) {
+    fatfsjs_dirent **cursor = head;
+    while (*cursor) {
+        fatfsjs_dirent **next = (fatfsjs_dirent **)((char *)*cursor + link);
+        if (*cursor == entry) {
+            *cursor = *next;
+            return;
+        }
+        cursor = next;
+    }
+}
+
+static void fatfsjs_dirent_free(fatfsjs_dirindex *dir, fatfsjs_dirent *entry) {
+    uint32_t mask = g_entry_buckets - 1;
+    fatfsjs_dirent_unlink_chain(
+        &g_sfn_buckets[fatfsjs_hash_sfn(entry->sclust, entry->sfn) & mask],
+        entry, offsetof(fatfsjs_dirent, sfn_next));
+    fatfsjs_dirent_unlink_chain(
+        &g_ofs_buckets[fatfsjs_hash_ofs(entry->sclust, entry->ofs) & mask],
+        entry, offsetof(fatfsjs_dirent, ofs_next));
+    if (entry->lfn_len) {
+        fatfsjs_dirent_unlink_chain(&g_lfn_buckets[entry->lfn_hash & mask],
+                                    entry, offsetof(fatfsjs_dirent, lfn_next));
+    }
+    if (entry->dir_prev) {
+        entry->dir_prev->dir_next = entry->dir_next;
+    } else {
+        dir->entries = entry->dir_next;
+    }
+    if (entry->dir_next) {
+        entry->dir_next->dir_prev = entry->dir_prev;
+    }
+    g_entry_count--;
+    free(entry);
+}
+
+static void fatfsjs_dirindex_forget(fatfsjs_dirindex *dir) {
+    while (dir->entries) {
+        fatfsjs_dirent_free(dir, dir->entries);
+    }
+    dir->ready = false;
+    dir->free_ofs = 0;
+}
+
+static fatfsjs_dirent *fatfsjs_dirent_at(DWORD sclust, DWORD ofs) {
+    if (!g_entry_buckets) {
+        return NULL;
+    }
+    uint32_t slot = fatfsjs_hash_ofs(sclust, ofs) & (g_entry_buckets - 1);
+    for (fatfsjs_dirent *entry = g_ofs_buckets[slot]; entry;
+         entry = entry->ofs_next) {
+        if (entry->sclust == sclust && entry->ofs == ofs) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static bool fatfsjs_dirent_grow(void) {
+    uint32_t buckets = g_entry_buckets ? g_entry_buckets * 2
+                                       : FATFSJS_DIRINDEX_MIN_BUCKETS;
+    fatfsjs_dirent **lfn = (fatfsjs_dirent **)calloc(buckets, sizeof(*lfn));
+    fatfsjs_dirent **sfn = (fatfsjs_dirent **)calloc(buckets, sizeof(*sfn));
+    fatfsjs_dirent **ofs = (fatfsjs_dirent **)calloc(buckets, sizeof(*ofs));
+    if (!lfn || !sfn || !ofs) {
+        free(lfn);
+        free(sfn);
+        free(ofs);
+        return false;
+    }
+
+    fatfsjs_dirent **old_ofs = g_ofs_buckets;
+    uint32_t old_buckets = g_entry_buckets;
+    free(g_lfn_buckets);
+    free(g_sfn_buckets);
+    g_lfn_buckets = lfn;
+    g_sfn_buckets = sfn;
+    g_ofs_buckets = ofs;
+    g_entry_buckets = buckets;
+
+    for (uint32_t i = 0; i < old_buckets; i++) {
+        fatfsjs_dirent *entry = old_ofs[i];
+        while (entry) {
+            fatfsjs_dirent *next = entry->ofs_next;
+            fatfsjs_dirent_link(entry);
+            entry = next;
+        }
+    }
+    free(old_ofs);
+    return true;
+}
+
+int ff_dirindex_ready(FATFS *fs, DWORD sclust) {
+    (void)fs;
+    fatfsjs_dirindex *dir = fatfsjs_dirindex_get(sclust, false);
+    return dir && dir->ready;
+}
+
+void ff_dirindex_reset(FATFS *fs, DWORD sclust) {
+    (void)fs;
+    fatfsjs_dirindex *dir = fatfsjs_dirindex_get(sclust, false);
+    if (dir) {
+        fatfsjs_dirindex_forget(dir);
+    }
+}
+
+int ff_dirindex_add(FATFS *fs, DWORD sclust, const WCHAR *lfn,
+                    const BYTE *sfn, DWORD ofs, DWORD blk_ofs) {
+    (void)fs;
+    fatfsjs_dirindex *dir = fatfsjs_dirindex_get(sclust, true);
+    if (!dir) {
+        return 0;
+    }
+    if (g_entry_count >= g_entry_buckets && !fatfsjs_dirent_grow() &&
+        !g_entry_buckets) {
+        return 0;
+    }
+
+    fatfsjs_dirent *stale = fatfsjs_dirent_at(sclust, ofs);
+    if (stale) {
+        fatfsjs_dirent_free(dir, stale);
+    }
+
+    uint16_t lfn_len = 0;
+    uint32_t lfn_hash = lfn ? fatfsjs_hash_lfn(sclust, lfn, &lfn_len) : 0;
+    fatfsjs_dirent *entry = (fatfsjs_dirent *)malloc(
+        sizeof(*entry) + (size_t)lfn_len * sizeof(WCHAR));
+    if (!entry) {
+        return 0;
+    }
+    entry->sclust = sclust;
+    entry->ofs = ofs;
+    entry->blk_ofs = blk_ofs;
+    entry->lfn_hash = lfn_hash;
+    entry->lfn_len = lfn_len;
+    memcpy(entry->sfn, sfn, sizeof(entry->sfn));
+    for (uint16_t i = 0; i < lfn_len; i++) {
+        entry->lfn[i] = (WCHAR)ff_wtoupper(lfn[i]);
+    }
+    fatfsjs_dirent_link(entry);
+
+    entry->dir_prev = NULL;
+    entry->dir_next = dir->entries;
+    if (dir->entries) {
+        dir->entries->dir_prev = entry;
+    }
+    dir->entries = entry;
+    g_entry_count++;
+
+    if (dir->ready) {
+        DWORD start = blk_ofs != 0xFFFFFFFF ? blk_ofs : ofs;
+        if (start <= dir->free_ofs && ofs + FATFSJS_DIRENT_SIZE > dir->free_ofs) {
+            dir->free_ofs = ofs + FATFSJS_DIRENT_SIZE;
+        }
+    }
+    return 1;
+}
+
+void ff_dirindex_commit(FATFS *fs, DWORD sclust, DWORD free_ofs) {
+    (void)fs;
+    fatfsjs_dirindex *dir = fatfsjs_dirindex_get(sclust, true);
+    if (dir) {
+        dir->ready = true;
+        dir->free_ofs = free_ofs;
+    }
+}
+
+int ff_dirindex_find(FATFS *fs, DWORD sclust, const WCHAR *lfn,
+                     const BYTE *sfn, DWORD *ofs, DWORD *blk_ofs) {
+    (void)fs;
+    if (!g_entry_buckets) {
+        return 0;
+    }
+    uint32_t mask = g_entry_buckets - 1;
+    const fatfsjs_dirent *found = NULL;
+
+    if (lfn) {
+        uint16_t len = 0;
+        uint32_t hash = fatfsjs_hash_lfn(sclust, lfn, &len);
+        for (const fatfsjs_dirent *entry = g_lfn_buckets[hash & mask]; entry;
+             entry = entry->lfn_next) {
+            if (entry->lfn_hash != hash || entry->sclust != sclust ||
+                entry->lfn_len != len) {
+                continue;
+            }
+            uint16_t i = 0;
+            while (i < len && entry->lfn[i] == (WCHAR)ff_wtoupper(lfn[i])) {
+                i++;
+            }
+            if (i == len && (!found || entry->ofs < found->ofs)) {
+                found = entry;
+            }
+        }
+    }
+    if (sfn) {
+        uint32_t slot = fatfsjs_hash_sfn(sclust, sfn) & mask;
+        for (const fatfsjs_dirent *entry = g_sfn_buckets[slot]; entry;
+             entry = entry->sfn_next) {
+            if (entry->sclust == sclust && memcmp(entry->sfn, sfn, 11) == 0 &&
+                (!found || entry->ofs < found->ofs)) {
+                found = entry;
+            }
+        }
+    }
+
+    if (!found) {
+        return 0;
+    }
+    *ofs = found->ofs;
+    *blk_ofs = found->blk_ofs;
+    return 1;
+}
+
+void ff_dirindex_remove(FATFS *fs, DWORD sclust, DWORD ofs, DWORD blk_ofs) {
+    (void)fs;
+    fatfsjs_dirindex *dir = fatfsjs_dirindex_get(sclust, false);
+    if (!dir) {
+        return;
+    }
+    fatfsjs_dirent *entry = fatfsjs_dirent_at(sclust, ofs);
+    if (entry) {
+        fatfsjs_dirent_free(dir, entry);
+    }
+    DWORD start = blk_ofs != 0xFFFFFFFF ? blk_ofs : ofs;
+    if (start < dir->free_ofs) {
+        dir->free_ofs = start;
+    }
+}
+
+DWORD ff_dirindex_free(FATFS *fs, DWORD sclust) {
+    (void)fs;
+    fatfsjs_dirindex *dir = fatfsjs_dirindex_get(sclust, false);
+    return dir ? dir->free_ofs : 0;
+}
+
+void ff_dirindex_drop(FATFS *fs, DWORD sclust) {
+    (void)fs;
+    uint32_t slot = sclust % FATFSJS_DIRINDEX_DIR_BUCKETS;
+    fatfsjs_dirindex **cursor = &g_dir_buckets[slot];
+    while (*cursor) {
+        fatfsjs_dirindex *dir = *cursor;
+        if (dir->sclust == sclust) {
+            fatfsjs_dirindex_forget(dir);
+            *cursor = dir->next;
+            free(dir);
+            return;
+        }
+        cursor = &dir->next;
+    }
+}
+
+void ff_dirindex_clear(FATFS *fs) {
+    (void)fs;
+    for (uint32_t i = 0; i < FATFSJS_DIRINDEX_DIR_BUCKETS; i++) {
+        fatfsjs_dirindex *dir = g_dir_buckets[i];
+        while (dir) {
+            fatfsjs_dirindex *next = dir->next;
+            fatfsjs_dirent *entry = dir->entries;
+            while (entry) {
+                fatfsjs_dirent *following = entry->dir_next;
+                free(entry);
+                entry = following;
+            }
+            free(dir);
+            dir = next;
+        }
+        g_dir_buckets[i] = NULL;
+    }
+    free(g_lfn_buckets);
+    free(g_sfn_buckets);
+    free(g_ofs_buckets);
+    g_lfn_buckets = NULL;
+    g_sfn_buckets = NULL;
+    g_ofs_buckets = NULL;
+    g_entry_buckets = 0;
+    g_entry_count = 0;
+}
+
 EMSCRIPTEN_KEEPALIVE
 int fatfsjs_init(uint32_t block_size, uint32_t block_count) {
     int err = fatfsjs_configure(block_size, block_count, true);
@@ -458,31 +1058,122 @@ int fatfsjs_init(uint32_t block_size, uint32_t block_count) {
     return err;
 }
 
+/* Allocates storage for an image the host writes in place through
+ * fatfsjs_storage_ptr; fatfsjs_import_end then mounts it. Streaming imports
+ * use this so the raw image never exists twice. */
+EMSCRIPTEN_KEEPALIVE
+int fatfsjs_import_begin(uint32_t block_count) {
+    return fatfsjs_configure(FATFSJS_SECTOR_SIZE, block_count, false);
+}
+
+EMSCRIPTEN_KEEPALIVE
+int fatfsjs_import_end(void) {
+    if (!g_storage) {
+        return FATFSJS_ERR_NOT_MOUNTED;
+    }
+    fatfsjs_detect_offset();
+    int err = fatfsjs_mount_internal(false);
+    if (err) {
+        fatfsjs_release();
+    }
+    return err;
+}
+
+/* Mounts a volume of block_count sectors on the host block device, behind a
+ * cache of cache_blocks sectors that reads ahead and writes back up to
+ * read_ahead sectors per host call. Only the cache lives in wasm memory, so
+ * the volume may exceed the 4 GB a RAM image is limited to. With format set
+ * the device is formatted first with the current format options. */
 EMSCRIPTEN_KEEPALIVE
-int fatfsjs_init_from_image(const uint8_t *image, uint32_t image_len) {
+int fatfsjs_init_host(uint32_t block_count, uint32_t cache_blocks,
+                      uint32_t read_ahead, uint32_t format) {
+    int err = fatfsjs_configure_host(block_count, cache_blocks, read_ahead);
+    if (!err && format) {
+        err = fatfsjs_format_internal();
+    } else if (!err) {
+        fatfsjs_detect_offset();
+    }
+    if (!err) {
+        err = fatfsjs_mount_internal(false);
+    }
+    if (err) {
+        fatfsjs_release();
+    }
+    return err;
+}
+
+/* Writes sectors the host device cache holds dirty back to the host. */
+EMSCRIPTEN_KEEPALIVE
+int fatfsjs_flush(void) {
+    if (g_host && hostcache_flush(g_host)) {
+        return FATFSJS_ERR_IO;
+    }
+    return 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int fatfsjs_init_from_image(const uint8_t *image, size_t image_len) {
     if (!image || image_len == 0) {
         return FATFSJS_ERR_INVAL;
     }
     if (image_len % FATFSJS_SECTOR_SIZE != 0) {
         return FATFSJS_ERR_INVAL;
     }
-    uint32_t block_count = image_len / FATFSJS_SECTOR_SIZE;
-    int err = fatfsjs_configure(FATFSJS_SECTOR_SIZE, block_count, false);
+    int err = fatfsjs_import_begin(image_len / FATFSJS_SECTOR_SIZE);
     if (err) {
         return err;
     }
     memcpy(g_storage, image, image_len);
-    fatfsjs_detect_offset();
-    err = fatfsjs_mount_internal(false);
-    if (err) {
-        fatfsjs_release();
+    return fatfsjs_import_end();
+}
+
+EMSCRIPTEN_KEEPALIVE
+int fatfsjs_set_time(uint32_t fattime) {
+    /* There is no RTC in the module; the host pushes its clock (or a caller
+     * supplied mtime) before each change. */
+    if (((fattime >> 21) & 0x0F) == 0 || ((fattime >> 16) & 0x1F) == 0) {
+        return FATFSJS_ERR_INVAL;
     }
-    return err;
+    g_fattime = (DWORD)fattime;
+    return 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+uint32_t fatfsjs_features(void) {
+    uint32_t features = 0;
+#if FF_FS_EXFAT
+    features |= FATFSJS_FEATURE_EXFAT;
+#endif
+    return features;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int fatfsjs_set_format_options(uint32_t fmt, uint32_t au_size, uint32_t n_fat,
+                               uint32_t n_root) {
+    fmt &= FM_ANY;
+    if (fmt == 0 || n_fat > 2 || n_root > 32768) {
+        return FATFSJS_ERR_INVAL;
+    }
+    if (au_size != 0 &&
+        ((au_size & (au_size - 1)) != 0 || au_size < FATFSJS_SECTOR_SIZE)) {
+        return FATFSJS_ERR_INVAL;
+    }
+#if !FF_FS_EXFAT
+    if (fmt == FM_EXFAT) {
+        return FATFSJS_ERR_INVAL;
+    }
+#endif
+    g_format_options.fmt = (BYTE)(fmt | FM_SFD);
+    g_format_options.au_size = au_size;
+    g_format_options.n_fat = (BYTE)n_fat;
+    g_format_options.n_root = n_root;
+    g_format_options.align = 0;
+    return 0;
 }
 
 EMSCRIPTEN_KEEPALIVE
 int fatfsjs_format(void) {
-    if (!g_storage || g_sector_count == 0) {
+    if ((!g_storage && !g_host) || g_sector_count == 0) {
         return FATFSJS_ERR_NOT_MOUNTED;
     }
     if (g_is_mounted) {
@@ -497,7 +1188,7 @@ int fatfsjs_format(void) {
 }
 
 EMSCRIPTEN_KEEPALIVE
-int fatfsjs_list(const char *path, uint32_t buffer_ptr, uint32_t buffer_len) {
+int fatfsjs_list(const char *path, uintptr_t buffer_ptr, uint32_t buffer_len) {
     int err = fatfsjs_ensure_mounted();
     if (err) {
         return err;
@@ -512,21 +1203,21 @@ int fatfsjs_list(const char *path, uint32_t buffer_ptr, uint32_t buffer_len) {
         return err;
     }
 
-    char *cursor = (char *)(uintptr_t)buffer_ptr;
+    char *cursor = (char *)buffer_ptr;
     const char *end = cursor + buffer_len;
     *cursor = '\0';
 
     FILINFO info;
     FRESULT res = f_stat(ff_path, &info);
     if (res == FR_OK && !(info.fattrib & AM_DIR)) {
-        err = fatfsjs_emit_entry("", info.fsize, 'f', &cursor, end);
+        err = fatfsjs_emit_entry("", &info, &cursor, end);
         if (err) {
             return err;
         }
         if (cursor < end) {
             *cursor = '\0';
         }
-        return (int)(cursor - (char *)(uintptr_t)buffer_ptr);
+        return (int)(cursor - (char *)buffer_ptr);
     }
 
     err = fatfsjs_list_dir(ff_path, "", &cursor, end);
@@ -537,11 +1228,11 @@ int fatfsjs_list(const char *path, uint32_t buffer_ptr, uint32_t buffer_len) {
     if (cursor < end) {
         *cursor = '\0';
     }
-    return (int)(cursor - (char *)(uintptr_t)buffer_ptr);
+    return (int)(cursor - (char *)buffer_ptr);
 }
 
 EMSCRIPTEN_KEEPALIVE
-int fatfsjs_file_size(const char *path) {
+int64_t fatfsjs_file_size(const char *path) {
     int err = fatfsjs_ensure_mounted();
     if (err) {
         return err;
@@ -560,12 +1251,12 @@ int fatfsjs_file_size(const char *path) {
     if (info.fattrib & AM_DIR) {
         return FATFSJS_ERR_INVAL;
     }
-    return (int)info.fsize;
+    return (int64_t)info.fsize;
 }
 
 EMSCRIPTEN_KEEPALIVE
-int fatfsjs_read_file(const char *path, uint32_t buffer_ptr,
-                      uint32_t buffer_len) {
+int64_t fatfsjs_read_file(const char *path, uintptr_t buffer_ptr,
+                          size_t buffer_len) {
     int err = fatfsjs_ensure_mounted();
     if (err) {
         return err;
@@ -598,13 +1289,13 @@ int fatfsjs_read_file(const char *path, uint32_t buffer_ptr,
         return fatfsjs_result(res);
     }
 
-    uint8_t *dest = (uint8_t *)(uintptr_t)buffer_ptr;
-    UINT remaining = (UINT)info.fsize;
-    UINT total_read = 0;
+    uint8_t *dest = (uint8_t *)buffer_ptr;
+    FSIZE_t remaining = info.fsize;
+    FSIZE_t total_read = 0;
     while (remaining > 0) {
         UINT chunk = remaining > FATFSJS_MAX_READ_CHUNK
                          ? FATFSJS_MAX_READ_CHUNK
-                         : remaining;
+                         : (UINT)remaining;
         UINT read = 0;
         res = f_read(&file, dest + total_read, chunk, &read);
         if (res != FR_OK) {
@@ -622,12 +1313,12 @@ int fatfsjs_read_file(const char *path, uint32_t buffer_ptr,
     if (total_read != info.fsize) {
         return FATFSJS_ERR_IO;
     }
-    return (int)info.fsize;
+    return (int64_t)info.fsize;
 }
 
 EMSCRIPTEN_KEEPALIVE
 int fatfsjs_write_file(const char *path, const uint8_t *data,
-                       uint32_t length) {
+                       size_t length) {
     int err = fatfsjs_ensure_mounted();
     if (err) {
         return err;
@@ -653,18 +1344,36 @@ int fatfsjs_write_file(const char *path, const uint8_t *data,
         return fatfsjs_result(res);
     }
 
-    UINT remaining = length;
-    UINT written_total = 0;
+    if ((FSIZE_t)length != length) {
+        f_close(&file);
+        return FATFSJS_ERR_NOSPC;
+    }
+    if (length > (uint32_t)g_fs.csize * FATFSJS_SECTOR_SIZE) {
+        /* Reserve one contiguous run up front; exFAT then needs no FAT
+         * chain at all. Fragmented volumes fall back to cluster-by-cluster
+         * allocation in f_write. */
+        res = f_expand(&file, (FSIZE_t)length, 1);
+        if (res != FR_OK && res != FR_DENIED) {
+            f_close(&file);
+            return fatfsjs_result(res);
+        }
+    }
+
+    size_t remaining = length;
+    size_t written_total = 0;
     while (remaining > 0) {
         UINT chunk = remaining > FATFSJS_MAX_READ_CHUNK
                          ? FATFSJS_MAX_READ_CHUNK
-                         : remaining;
+                         : (UINT)remaining;
         UINT written = 0;
         res = f_write(&file, data + written_total, chunk, &written);
         if (res != FR_OK) {
             f_close(&file);
             return fatfsjs_result(res);
         }
+        if (written == 0) {
+            break; /* volume full */
+        }
         written_total += written;
         remaining -= written;
     }
@@ -698,6 +1407,85 @@ int fatfsjs_delete_file(const char *path) {
     return fatfsjs_result(f_unlink(ff_path));
 }
 
+/* Removes everything below the directory in path[0..len). The same buffer is
+ * extended in place for each child, so the walk does no path rebuilding. */
+static int fatfsjs_remove_tree(char *path, size_t len, size_t cap) {
+    static FILINFO info; /* name is copied out before recursing */
+    FF_DIR dir;
+    FRESULT res = f_opendir(&dir, path);
+    if (res != FR_OK) {
+        return fatfsjs_result(res);
+    }
+    while (true) {
+        res = f_readdir(&dir, &info);
+        if (res != FR_OK || info.fname[0] == '\0') {
+            break;
+        }
+        size_t name_len = strlen(info.fname);
+        bool need_sep = len > 0 && path[len - 1] != '/';
+        size_t child_len = len + (need_sep ? 1 : 0) + name_len;
+        if (child_len >= cap) {
+            f_closedir(&dir);
+            return FATFSJS_ERR_INVAL;
+        }
+        if (need_sep) {
+            path[len] = '/';
+        }
+        memcpy(path + len + (need_sep ? 1 : 0), info.fname, name_len + 1);
+        if (info.fattrib & AM_DIR) {
+            int err = fatfsjs_remove_tree(path, child_len, cap);
+            if (err) {
+                f_closedir(&dir);
+                return err;
+            }
+        }
+        res = f_unlink(path);
+        path[len] = '\0';
+        if (res != FR_OK) {
+            break;
+        }
+    }
+    f_closedir(&dir);
+    return fatfsjs_result(res);
+}
+
+EMSCRIPTEN_KEEPALIVE
+int fatfsjs_remove(const char *path, int recursive) {
+    int err = fatfsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    if (!path) {
+        return FATFSJS_ERR_INVAL;
+    }
+
+    char ff_path[FATFSJS_PATH_MAX];
+    err = fatfsjs_build_ff_path(path, ff_path, sizeof(ff_path));
+    if (err) {
+        return err;
+    }
+    bool is_root = strcmp(ff_path, "0:/") == 0;
+    if (!recursive) {
+        return is_root ? FATFSJS_ERR_INVAL : fatfsjs_result(f_unlink(ff_path));
+    }
+
+    if (!is_root) {
+        FILINFO info;
+        FRESULT res = f_stat(ff_path, &info);
+        if (res != FR_OK) {
+            return fatfsjs_result(res);
+        }
+        if (!(info.fattrib & AM_DIR)) {
+            return fatfsjs_result(f_unlink(ff_path));
+        }
+    }
+    err = fatfsjs_remove_tree(ff_path, strlen(ff_path), sizeof(ff_path));
+    if (err || is_root) {
+        return err; /* the root itself stays */
+    }
+    return fatfsjs_result(f_unlink(ff_path));
+}
+
 EMSCRIPTEN_KEEPALIVE
 int fatfsjs_mkdir(const char *path) {
     int err = fatfsjs_ensure_mounted();
@@ -742,18 +1530,436 @@ int fatfsjs_rename(const char *old_path, const char *new_path) {
 }
 
 EMSCRIPTEN_KEEPALIVE
-uint32_t fatfsjs_storage_size(void) {
+int fatfsjs_get_usage(uintptr_t usage_ptr, uint32_t force_scan) {
+    int err = fatfsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    if (!usage_ptr) {
+        return FATFSJS_ERR_INVAL;
+    }
+    if (force_scan) {
+        /* Forget the cached/FSINFO count so f_getfree walks the FAT */
+        g_fs.free_clst = 0xFFFFFFFF;
+    }
+    FATFS *fs = NULL;
+    DWORD free_clusters = 0;
+    FRESULT res = f_getfree("0:", &free_clusters, &fs);
+    if (res != FR_OK) {
+        return fatfsjs_result(res);
+    }
+    uint64_t cluster_bytes = (uint64_t)fs->csize * FATFSJS_SECTOR_SIZE;
+    uint64_t total = (uint64_t)(fs->n_fatent - 2) * cluster_bytes;
+    uint64_t free_bytes = (uint64_t)free_clusters * cluster_bytes;
+    uint64_t *dest = (uint64_t *)usage_ptr;
+    dest[0] = total;
+    dest[1] = total - free_bytes;
+    dest[2] = free_bytes;
+    return 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+size_t fatfsjs_storage_size(void) {
     return g_total_bytes;
 }
 
+/* The live image, for hosts that stream it in or out without a copy. */
+EMSCRIPTEN_KEEPALIVE
+uintptr_t fatfsjs_storage_ptr(void) {
+    return (uintptr_t)g_storage;
+}
+
 EMSCRIPTEN_KEEPALIVE
-int fatfsjs_export_image(uint32_t buffer_ptr, uint32_t buffer_len) {
+int fatfsjs_export_image(uintptr_t buffer_ptr, size_t buffer_len) {
     if (!g_storage || g_total_bytes == 0) {
         return FATFSJS_ERR_INVAL;
     }
     if (!buffer_ptr || buffer_len < g_total_bytes) {
         return FATFSJS_ERR_NOSPC;
     }
-    memcpy((void *)(uintptr_t)buffer_ptr, g_storage, g_total_bytes);
-    return (int)g_total_bytes;
+    memcpy((void *)buffer_ptr, g_storage, g_total_bytes);
+    return 0;
+}
+
+/* Enabling allocates zeroed counters for the current volume; volumes created
+ * afterwards get fresh counters. Disabling frees them. */
+EMSCRIPTEN_KEEPALIVE
+int fatfsjs_set_io_stats(uint32_t enabled) {
+    g_io_stats_enabled = enabled != 0;
+    return fatfsjs_io_stats_alloc(g_storage || g_host ? g_sector_count : 0);
+}
+
+EMSCRIPTEN_KEEPALIVE
+int fatfsjs_reset_io_stats(void) {
+    if (!g_io_stats) {
+        return FATFSJS_ERR_INVAL;
+    }
+    memset(g_io_stats, 0,
+           FATFSJS_IO_KINDS * ((size_t)g_io_stats_sectors + 1) * sizeof(uint64_t));
+    return 0;
+}
+
+/* Copies the counters as laid out in g_io_stats and returns the sector count,
+ * which is all it returns for a NULL buffer. */
+EMSCRIPTEN_KEEPALIVE
+int fatfsjs_get_io_stats(uintptr_t buffer_ptr, uint32_t buffer_len) {
+    if (!g_io_stats) {
+        return FATFSJS_ERR_INVAL;
+    }
+    size_t bytes =
+        FATFSJS_IO_KINDS * ((size_t)g_io_stats_sectors + 1) * sizeof(uint64_t);
+    if (buffer_ptr == 0) {
+        return (int)g_io_stats_sectors;
+    }
+    if (buffer_len < bytes) {
+        return FATFSJS_ERR_NOSPC;
+    }
+    memcpy((void *)buffer_ptr, g_io_stats, bytes);
+    return (int)g_io_stats_sectors;
+}
+
+/* Returns the id of a new snapshot of the current image. Files are closed and
+ * the volume synced at the end of every call, so the image is consistent. */
+EMSCRIPTEN_KEEPALIVE
+int fatfsjs_snapshot(void) {
+    int err = fatfsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    if (!g_storage) {
+        return FATFSJS_ERR_INVAL;
+    }
+    fatfsjs_snapshot_t *snap = (fatfsjs_snapshot_t *)calloc(1, sizeof(*snap));
+    if (!snap) {
+        return FATFSJS_ERR_NOSPC;
+    }
+    snap->sectors = (uint8_t **)calloc(g_sector_count, sizeof(uint8_t *));
+    if (!snap->sectors) {
+        free(snap);
+        return FATFSJS_ERR_NOSPC;
+    }
+    snap->id = g_next_snapshot_id++;
+    snap->older = g_snapshots;
+    g_snapshots = snap;
+    return (int)snap->id;
+}
+
+/* Rolls the image back to the snapshot and remounts. Snapshots taken after it
+ * are released; the snapshot itself stays valid with nothing to undo. */
+EMSCRIPTEN_KEEPALIVE
+int fatfsjs_restore_snapshot(uint32_t id) {
+    fatfsjs_snapshot_t **found = fatfsjs_snapshot_find(id);
+    if (!found) {
+        return FATFSJS_ERR_INVAL;
+    }
+    fatfsjs_snapshot_t *target = *found;
+    if (g_is_mounted) {
+        f_mount(NULL, "0:", 0);
+        g_is_mounted = false;
+    }
+    for (fatfsjs_snapshot_t *snap = g_snapshots;; snap = snap->older) {
+        for (uint32_t i = 0; snap->saved && i < g_sector_count; i++) {
+            if (snap->sectors[i]) {
+                memcpy(g_storage + (size_t)i * FATFSJS_SECTOR_SIZE,
+                       snap->sectors[i], FATFSJS_SECTOR_SIZE);
+                free(snap->sectors[i]);
+                snap->sectors[i] = NULL;
+                snap->saved--;
+            }
+        }
+        if (snap == target) {
+            break;
+        }
+    }
+    while (g_snapshots != target) {
+        fatfsjs_snapshot_t *older = g_snapshots->older;
+        fatfsjs_snapshot_free(g_snapshots);
+        g_snapshots = older;
+    }
+    fatfsjs_detect_offset();
+    return fatfsjs_mount_internal(false);
+}
+
+/* Drops a snapshot, handing pre-images the next older snapshot lacks down to
+ * it, since they are that snapshot's view as well. */
+EMSCRIPTEN_KEEPALIVE
+int fatfsjs_release_snapshot(uint32_t id) {
+    fatfsjs_snapshot_t **found = fatfsjs_snapshot_find(id);
+    if (!found) {
+        return FATFSJS_ERR_INVAL;
+    }
+    fatfsjs_snapshot_t *snap = *found;
+    fatfsjs_snapshot_t *older = snap->older;
+    for (uint32_t i = 0; older && snap->saved && i < g_sector_count; i++) {
+        if (snap->sectors[i] && !older->sectors[i]) {
+            older->sectors[i] = snap->sectors[i];
+            older->saved++;
+            snap->sectors[i] = NULL;
+            snap->saved--;
+        }
+    }
+    *found = older;
+    fatfsjs_snapshot_free(snap);
+    return 0;
+}
+
+/* Number of sectors the snapshot holds a pre-image for. */
+EMSCRIPTEN_KEEPALIVE
+int fatfsjs_snapshot_blocks(uint32_t id) {
+    fatfsjs_snapshot_t **found = fatfsjs_snapshot_find(id);
+    if (!found) {
+        return FATFSJS_ERR_INVAL;
+    }
+    return (int)(*found)->saved;
+}
+
+static const uint8_t *fatfsjs_snapshot_view(uint32_t sector, void *ctx) {
+    fatfsjs_snapshot_t *target = (fatfsjs_snapshot_t *)ctx;
+    const uint8_t *view = NULL;
+    for (fatfsjs_snapshot_t *snap = g_snapshots;; snap = snap->older) {
+        if (snap->sectors[sector]) {
+            view = snap->sectors[sector];
+        }
+        if (snap == target) {
+            return view;
+        }
+    }
+}
+
+static const uint8_t *fatfsjs_image_view(uint32_t sector, void *ctx) {
+    return (const uint8_t *)ctx + (size_t)sector * FATFSJS_SECTOR_SIZE;
+}
+
+static int fatfsjs_patch_result(int err) {
+    if (err == IMGPATCH_ERR_NOMEM) {
+        return FATFSJS_ERR_NOSPC;
+    }
+    return err ? FATFSJS_ERR_INVAL : 0;
+}
+
+static void fatfsjs_hand_over(uintptr_t result_ptr, uint8_t *data,
+                              uint32_t len) {
+    uintptr_t *dest = (uintptr_t *)result_ptr;
+    dest[0] = (uintptr_t)data;
+    dest[1] = len;
+}
+
+static int fatfsjs_diff(imgpatch_view_fn view, void *ctx, uint32_t granularity,
+                        uintptr_t result_ptr) {
+    if (!g_storage || !result_ptr || g_total_bytes > UINT32_MAX) {
+        return FATFSJS_ERR_INVAL;
+    }
+    imgpatch_source src = {g_storage, (uint32_t)g_total_bytes,
+                           FATFSJS_SECTOR_SIZE, view, ctx};
+    uint8_t *patch = NULL;
+    uint32_t patch_len = 0;
+    int err = imgpatch_diff(&src, granularity, &patch, &patch_len);
+    if (err) {
+        return fatfsjs_patch_result(err);
+    }
+    fatfsjs_hand_over(result_ptr, patch, patch_len);
+    return 0;
+}
+
+/* Patch from the snapshot's image to the live one, comparing only sectors
+ * written since the snapshot. Writes {patch pointer, length} to result_ptr;
+ * the caller frees the patch. */
+EMSCRIPTEN_KEEPALIVE
+int fatfsjs_diff_snapshot(uint32_t id, uint32_t granularity,
+                          uintptr_t result_ptr) {
+    fatfsjs_snapshot_t **found = fatfsjs_snapshot_find(id);
+    if (!found) {
+        return FATFSJS_ERR_INVAL;
+    }
+    return fatfsjs_diff(fatfsjs_snapshot_view, *found, granularity, result_ptr);
+}
+
+/* Patch from an image of the same size to the live one. */
+EMSCRIPTEN_KEEPALIVE
+int fatfsjs_diff_image(const uint8_t *image, size_t image_len,
+                       uint32_t granularity, uintptr_t result_ptr) {
+    if (!image || !g_storage || image_len != g_total_bytes) {
+        return FATFSJS_ERR_INVAL;
+    }
+    return fatfsjs_diff(fatfsjs_image_view, (void *)image, granularity,
+                        result_ptr);
+}
+
+static int fatfsjs_patch_write(uint32_t offset, const uint8_t *data,
+                               uint32_t len, void *ctx) {
+    (void)ctx;
+    uint32_t first = offset / FATFSJS_SECTOR_SIZE;
+    uint32_t last = (offset + len - 1) / FATFSJS_SECTOR_SIZE;
+    if (!fatfsjs_snapshot_preserve(first, last - first + 1)) {
+        return FATFSJS_ERR_NOSPC;
+    }
+    memcpy(g_storage + offset, data, len);
+    return 0;
+}
+
+/* Validates the whole patch, writes it straight into the image (partition
+ * table and boot mirror included, since offsets are physical) and remounts. */
+EMSCRIPTEN_KEEPALIVE
+int fatfsjs_apply_patch(const uint8_t *patch, uint32_t patch_len) {
+    if (!g_storage) {
+        return FATFSJS_ERR_NOT_MOUNTED;
+    }
+    if (g_total_bytes > UINT32_MAX) {
+        return FATFSJS_ERR_INVAL;
+    }
+    int err = imgpatch_validate(patch, patch_len, (uint32_t)g_total_bytes);
+    if (err) {
+        return fatfsjs_patch_result(err);
+    }
+    if (g_is_mounted) {
+        f_mount(NULL, "0:", 0);
+        g_is_mounted = false;
+    }
+    err = imgpatch_apply(patch, fatfsjs_patch_write, NULL);
+    fatfsjs_detect_offset();
+    int mount_err = fatfsjs_mount_internal(false);
+    return err ? err : mount_err;
+}
+
+/* Reads the FAT (or the exFAT allocation bitmap) straight from the image, so
+ * it sees exactly what toImage would export. */
+static bool fatfsjs_cluster_used(const uint8_t *table, DWORD cluster) {
+    switch (g_fs.fs_type) {
+        case FS_FAT12: {
+            uint32_t offset = cluster + cluster / 2;
+            uint16_t entry = fatfsjs_read_u16(table + offset);
+            return ((cluster & 1) ? entry >> 4 : entry & 0xFFF) != 0;
+        }
+        case FS_FAT16:
+            return fatfsjs_read_u16(table + cluster * 2) != 0;
+        case FS_FAT32:
+            return (fatfsjs_read_u32(table + cluster * 4) & 0x0FFFFFFF) != 0;
+        default:
+            /* exFAT: one bit per cluster, starting at cluster 2 */
+            return (table[(cluster - 2) / 8] >> ((cluster - 2) % 8)) & 1;
+    }
+}
+
+/* Image patch holding the sectors in use: everything outside the data area
+ * (boot sectors, partition table, FATs, root directory) plus the clusters
+ * the allocation table marks as allocated. Free clusters are never read
+ * back before FatFS writes them. Writes {patch pointer, length} to
+ * result_ptr; the caller frees the patch. */
+EMSCRIPTEN_KEEPALIVE
+int fatfsjs_export_sparse(uint32_t flags, uintptr_t result_ptr) {
+    int err = fatfsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    if (!g_storage || !result_ptr || g_total_bytes > UINT32_MAX) {
+        return FATFSJS_ERR_INVAL;
+    }
+    LBA_t table_sector = g_fs.fatbase;
+#if FF_FS_EXFAT
+    if (g_fs.fs_type == FS_EXFAT) {
+        table_sector = g_fs.bitbase;
+    }
+#endif
+    uint32_t data_start = (uint32_t)(g_sector_offset + g_fs.database);
+    uint32_t clusters = g_fs.n_fatent - 2;
+    if ((uint64_t)data_start + (uint64_t)clusters * g_fs.csize >
+        g_sector_count) {
+        return FATFSJS_ERR_IO;
+    }
+    uint32_t data_end = data_start + clusters * g_fs.csize;
+    uint8_t *used = (uint8_t *)calloc((g_sector_count + 7) / 8, 1);
+    if (!used) {
+        return FATFSJS_ERR_NOSPC;
+    }
+    imgpatch_mark_range(used, 0, data_start);
+    imgpatch_mark_range(used, data_end, g_sector_count - data_end);
+    const uint8_t *table =
+        g_storage + (size_t)(g_sector_offset + table_sector) * FATFSJS_SECTOR_SIZE;
+    for (DWORD cluster = 2; cluster < g_fs.n_fatent; cluster++) {
+        if (fatfsjs_cluster_used(table, cluster)) {
+            imgpatch_mark_range(used, data_start + (cluster - 2) * g_fs.csize,
+                                g_fs.csize);
+        }
+    }
+    uint8_t *sparse = NULL;
+    uint32_t sparse_len = 0;
+    err = fatfsjs_patch_result(
+        imgpatch_sparse(g_storage, (uint32_t)g_total_bytes, FATFSJS_SECTOR_SIZE,
+                        used, flags, &sparse, &sparse_len));
+    free(used);
+    if (err) {
+        return err;
+    }
+    fatfsjs_hand_over(result_ptr, sparse, sparse_len);
+    return 0;
+}
+
+/* Digests over the live volume, written to out_ptr back to back (4 bytes per
+ * CRC32, 32 per SHA-256). Sectors and ranges are hashed in place in the RAM
+ * disk; files stream through f_read, so they also work on a host device.
+ * hash_blocks with out_ptr 0 returns the sector count. */
+EMSCRIPTEN_KEEPALIVE
+int fatfsjs_hash_blocks(uint32_t algorithm, uint32_t first, uint32_t count,
+                        uintptr_t out_ptr) {
+    if (!g_storage || first > g_sector_count ||
+        count > g_sector_count - first) {
+        return FATFSJS_ERR_INVAL;
+    }
+    if (!out_ptr) {
+        return (int)g_sector_count;
+    }
+    return blockhash_units(algorithm,
+                           g_storage + (size_t)first * FATFSJS_SECTOR_SIZE,
+                           FATFSJS_SECTOR_SIZE, count, (uint8_t *)out_ptr)
+               ? FATFSJS_ERR_INVAL
+               : 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int fatfsjs_hash_range(uint32_t algorithm, size_t offset, size_t length,
+                       uintptr_t out_ptr) {
+    if (!g_storage || offset > g_total_bytes ||
+        length > g_total_bytes - offset) {
+        return FATFSJS_ERR_INVAL;
+    }
+    return blockhash_range(algorithm, g_storage + offset, length,
+                           (uint8_t *)out_ptr)
+               ? FATFSJS_ERR_INVAL
+               : 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int fatfsjs_hash_file(uint32_t algorithm, const char *path,
+                      uintptr_t out_ptr) {
+    int err = fatfsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    blockhash_ctx ctx;
+    if (!path || !out_ptr || blockhash_init(&ctx, algorithm)) {
+        return FATFSJS_ERR_INVAL;
+    }
+
+    char ff_path[FATFSJS_PATH_MAX];
+    err = fatfsjs_build_ff_path(path, ff_path, sizeof(ff_path));
+    if (err) {
+        return err;
+    }
+    FIL file;
+    FRESULT res = f_open(&file, ff_path, FA_READ);
+    if (res != FR_OK) {
+        return fatfsjs_result(res);
+    }
+    uint8_t chunk[FATFSJS_SECTOR_SIZE];
+    UINT read = 0;
+    while ((res = f_read(&file, chunk, sizeof(chunk), &read)) == FR_OK &&
+           read > 0) {
+        blockhash_update(&ctx, chunk, read);
+    }
+    f_close(&file);
+    if (res != FR_OK) {
+        return fatfsjs_result(res);
+    }
+    blockhash_final(&ctx, (uint8_t *)out_ptr);
+    return 0;
 }
@@ -0,0 +1,383 @@
+#ifndef HOST_BLOCK_CACHE_H
+#define HOST_BLOCK_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "block_ops.h"
+
+/*
+ * Write-back LRU block cache in front of a block device provided by the host,
+ * shared by the LittleFS and FatFS modules. The volume itself stays outside
+ * wasm memory (a file descriptor, an SD card) and the working set is the
+ * cache, whatever the size of the image.
+ *
+ * The host moves runs of whole blocks per call. A miss reads ahead into the
+ * uncached blocks that follow, and writing back a dirty block takes its dirty
+ * cached neighbours along, so each boundary crossing covers up to read_ahead
+ * blocks. Blocks erased and not programmed since go back as erase calls.
+ */
+#define HOSTCACHE_NONE UINT32_MAX
+
+#define HOSTCACHE_OK 0
+#define HOSTCACHE_ERR_IO -1
+#define HOSTCACHE_ERR_NOMEM -2
+
+/* Host calls move count whole blocks starting at block; 0 means success.
+ * erase may be NULL when the filesystem never erases. */
+typedef int (*hostcache_io_fn)(uint32_t block, uint32_t count, uint8_t *data);
+typedef int (*hostcache_erase_fn)(uint32_t block, uint32_t count);
+
+typedef struct {
+    uint32_t block;
+    uint32_t newer;
+    uint32_t older;
+    uint32_t chain;
+    bool dirty;
+    bool erased;
+} hostcache_slot;
+
+typedef struct {
+    uint32_t block_size;
+    uint32_t block_count;
+    uint32_t slot_count;
+    uint32_t read_ahead;
+    uint32_t newest;
+    uint32_t oldest;
+    uint32_t free_slots;
+    uint32_t bucket_mask;
+    uint32_t *buckets;
+    uint32_t *batch;
+    hostcache_slot *slots;
+    uint8_t *data;
+    uint8_t *staging;
+    hostcache_io_fn read;
+    hostcache_io_fn write;
+    hostcache_erase_fn erase;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t host_calls;
+} hostcache;
+
+static inline uint8_t *hostcache_slot_data(const hostcache *c, uint32_t slot) {
+    return c->data + (size_t)slot * c->block_size;
+}
+
+static inline uint32_t *hostcache_bucket(const hostcache *c, uint32_t block) {
+    return &c->buckets[(block * 2654435761u) & c->bucket_mask];
+}
+
+static uint32_t hostcache_find(const hostcache *c, uint32_t block) {
+    uint32_t slot = *hostcache_bucket(c, block);
+    while (slot != HOSTCACHE_NONE && c->slots[slot].block != block) {
+        slot = c->slots[slot].chain;
+    }
+    return slot;
+}
+
+static void hostcache_unlink(hostcache *c, uint32_t slot) {
+    hostcache_slot *s = &c->slots[slot];
+    if (s->newer != HOSTCACHE_NONE) {
+        c->slots[s->newer].older = s->older;
+    } else {
+        c->newest = s->older;
+    }
+    if (s->older != HOSTCACHE_NONE) {
+        c->slots[s->older].newer = s->newer;
+    } else {
+        c->oldest = s->newer;
+    }
+}
+
+static void hostcache_push(hostcache *c, uint32_t slot) {
+    hostcache_slot *s = &c->slots[slot];
+    s->newer = HOSTCACHE_NONE;
+    s->older = c->newest;
+    if (c->newest != HOSTCACHE_NONE) {
+        c->slots[c->newest].newer = slot;
+    } else {
+        c->oldest = slot;
+    }
+    c->newest = slot;
+}
+
+static void hostcache_unhash(hostcache *c, uint32_t slot) {
+    uint32_t *link = hostcache_bucket(c, c->slots[slot].block);
+    while (*link != slot) {
+        link = &c->slots[*link].chain;
+    }
+    *link = c->slots[slot].chain;
+}
+
+/* Forgets a cached block without writing it back. */
+static void hostcache_drop(hostcache *c, uint32_t slot) {
+    hostcache_unlink(c, slot);
+    hostcache_unhash(c, slot);
+    c->slots[slot].chain = c->free_slots;
+    c->free_slots = slot;
+}
+
+static bool hostcache_joins_run(const hostcache *c, uint32_t block,
+                                bool erased) {
+    uint32_t slot = hostcache_find(c, block);
+    return slot != HOSTCACHE_NONE && c->slots[slot].dirty &&
+           c->slots[slot].erased == erased;
+}
+
+/* Writes back the dirty run around slot, up to read_ahead blocks at once. */
+static int hostcache_write_run(hostcache *c, uint32_t slot) {
+    bool erased = c->slots[slot].erased;
+    uint32_t first = c->slots[slot].block;
+    uint32_t last = first;
+    while (last - first + 1 < c->read_ahead) {
+        if (first > 0 && hostcache_joins_run(c, first - 1, erased)) {
+            first--;
+        } else if (last + 1 < c->block_count &&
+                   hostcache_joins_run(c, last + 1, erased)) {
+            last++;
+        } else {
+            break;
+        }
+    }
+    uint32_t count = last - first + 1;
+    int err;
+    if (erased) {
+        err = c->erase(first, count);
+    } else if (count == 1) {
+        err = c->write(first, 1, hostcache_slot_data(c, slot));
+    } else {
+        for (uint32_t i = 0; i < count; i++) {
+            memcpy(c->staging + (size_t)i * c->block_size,
+                   hostcache_slot_data(c, hostcache_find(c, first + i)),
+                   c->block_size);
+        }
+        err = c->write(first, count, c->staging);
+    }
+    c->host_calls++;
+    if (err) {
+        return HOSTCACHE_ERR_IO;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        c->slots[hostcache_find(c, first + i)].dirty = false;
+    }
+    return HOSTCACHE_OK;
+}
+
+/* Takes a free slot, or evicts the least recently used one, for block. */
+static int hostcache_claim(hostcache *c, uint32_t block, uint32_t *out) {
+    uint32_t slot = c->free_slots;
+    if (slot != HOSTCACHE_NONE) {
+        c->free_slots = c->slots[slot].chain;
+    } else {
+        slot = c->oldest;
+        if (c->slots[slot].dirty) {
+            int err = hostcache_write_run(c, slot);
+            if (err) {
+                return err;
+            }
+        }
+        hostcache_unlink(c, slot);
+        hostcache_unhash(c, slot);
+    }
+    hostcache_slot *s = &c->slots[slot];
+    s->block = block;
+    s->dirty = false;
+    s->erased = false;
+    uint32_t *head = hostcache_bucket(c, block);
+    s->chain = *head;
+    *head = slot;
+    hostcache_push(c, slot);
+    *out = slot;
+    return HOSTCACHE_OK;
+}
+
+/*
+ * Returns the cached slot for block. On a miss the block is read from the
+ * host together with the uncached blocks after it, unless fill is false
+ * because the caller overwrites the whole block anyway.
+ */
+static int hostcache_get(hostcache *c, uint32_t block, bool fill,
+                         uint32_t *out) {
+    uint32_t slot = hostcache_find(c, block);
+    if (slot != HOSTCACHE_NONE) {
+        c->hits++;
+        hostcache_unlink(c, slot);
+        hostcache_push(c, slot);
+        *out = slot;
+        return HOSTCACHE_OK;
+    }
+    c->misses++;
+    uint32_t count = 1;
+    while (fill && count < c->read_ahead && block + count < c->block_count &&
+           hostcache_find(c, block + count) == HOSTCACHE_NONE) {
+        count++;
+    }
+    /* Claimed last to first, so the requested block ends up the newest. */
+    for (uint32_t i = count; i-- > 0;) {
+        int err = hostcache_claim(c, block + i, &c->batch[i]);
+        if (err) {
+            while (++i < count) {
+                hostcache_drop(c, c->batch[i]);
+            }
+            return err;
+        }
+    }
+    if (fill) {
+        int err;
+        if (count == 1) {
+            err = c->read(block, 1, hostcache_slot_data(c, c->batch[0]));
+        } else {
+            err = c->read(block, count, c->staging);
+            for (uint32_t i = 0; !err && i < count; i++) {
+                memcpy(hostcache_slot_data(c, c->batch[i]),
+                       c->staging + (size_t)i * c->block_size, c->block_size);
+            }
+        }
+        c->host_calls++;
+        if (err) {
+            for (uint32_t i = 0; i < count; i++) {
+                hostcache_drop(c, c->batch[i]);
+            }
+            return HOSTCACHE_ERR_IO;
+        }
+    }
+    *out = c->batch[0];
+    return HOSTCACHE_OK;
+}
+
+static int hostcache_read(hostcache *c, uint64_t offset, uint8_t *dst,
+                          size_t size) {
+    while (size > 0) {
+        uint32_t block = (uint32_t)(offset / c->block_size);
+        uint32_t within = (uint32_t)(offset % c->block_size);
+        size_t span = c->block_size - within;
+        if (span > size) {
+            span = size;
+        }
+        uint32_t slot;
+        int err = hostcache_get(c, block, true, &slot);
+        if (err) {
+            return err;
+        }
+        memcpy(dst, hostcache_slot_data(c, slot) + within, span);
+        dst += span;
+        offset += span;
+        size -= span;
+    }
+    return HOSTCACHE_OK;
+}
+
+static int hostcache_write(hostcache *c, uint64_t offset, const uint8_t *src,
+                           size_t size) {
+    while (size > 0) {
+        uint32_t block = (uint32_t)(offset / c->block_size);
+        uint32_t within = (uint32_t)(offset % c->block_size);
+        size_t span = c->block_size - within;
+        if (span > size) {
+            span = size;
+        }
+        uint32_t slot;
+        int err = hostcache_get(c, block, span != c->block_size, &slot);
+        if (err) {
+            return err;
+        }
+        memcpy(hostcache_slot_data(c, slot) + within, src, span);
+        c->slots[slot].dirty = true;
+        c->slots[slot].erased = false;
+        src += span;
+        offset += span;
+        size -= span;
+    }
+    return HOSTCACHE_OK;
+}
+
+static inline int hostcache_erase_block(hostcache *c, uint32_t block) {
+    uint32_t slot;
+    int err = hostcache_get(c, block, false, &slot);
+    if (err) {
+        return err;
+    }
+    blockops_fill_erased(hostcache_slot_data(c, slot), c->block_size);
+    c->slots[slot].dirty = true;
+    c->slots[slot].erased = true;
+    return HOSTCACHE_OK;
+}
+
+/* Writes every dirty block back; the blocks stay cached. */
+static int hostcache_flush(hostcache *c) {
+    for (uint32_t slot = c->newest; slot != HOSTCACHE_NONE;
+         slot = c->slots[slot].older) {
+        if (c->slots[slot].dirty) {
+            int err = hostcache_write_run(c, slot);
+            if (err) {
+                return err;
+            }
+        }
+    }
+    return HOSTCACHE_OK;
+}
+
+static void hostcache_destroy(hostcache *c) {
+    if (!c) {
+        return;
+    }
+    free(c->buckets);
+    free(c->batch);
+    free(c->slots);
+    free(c->data);
+    free(c->staging);
+    free(c);
+}
+
+/*
+ * slot_count blocks of cache, at least twice read_ahead so a read-ahead batch
+ * never evicts itself. Returns NULL when out of memory.
+ */
+static hostcache *hostcache_create(uint32_t block_size, uint32_t block_count,
+                                   uint32_t slot_count, uint32_t read_ahead,
+                                   hostcache_io_fn read, hostcache_io_fn write,
+                                   hostcache_erase_fn erase) {
+    if (read_ahead == 0) {
+        read_ahead = 1;
+    }
+    if (slot_count < read_ahead * 2) {
+        slot_count = read_ahead * 2;
+    }
+    hostcache *c = (hostcache *)calloc(1, sizeof(hostcache));
+    if (!c) {
+        return NULL;
+    }
+    uint32_t buckets = 1;
+    while (buckets < slot_count) {
+        buckets <<= 1;
+    }
+    c->block_size = block_size;
+    c->block_count = block_count;
+    c->slot_count = slot_count;
+    c->read_ahead = read_ahead;
+    c->newest = HOSTCACHE_NONE;
+    c->oldest = HOSTCACHE_NONE;
+    c->bucket_mask = buckets - 1;
+    c->read = read;
+    c->write = write;
+    c->erase = erase;
+    c->buckets = (uint32_t *)malloc(buckets * sizeof(uint32_t));
+    c->batch = (uint32_t *)malloc(read_ahead * sizeof(uint32_t));
+    c->slots = (hostcache_slot *)calloc(slot_count, sizeof(hostcache_slot));
+    c->data = (uint8_t *)malloc((size_t)slot_count * block_size);
+    c->staging = (uint8_t *)malloc((size_t)read_ahead * block_size);
+    if (!c->buckets || !c->batch || !c->slots || !c->data || !c->staging) {
+        hostcache_destroy(c);
+        return NULL;
+    }
+    memset(c->buckets, 0xFF, buckets * sizeof(uint32_t));
+    for (uint32_t i = 0; i < slot_count; i++) {
+        c->slots[i].chain = i + 1 < slot_count ? i + 1 : HOSTCACHE_NONE;
+    }
+    c->free_slots = 0;
+    return c;
+}
+
+#endif /* HOST_BLOCK_CACHE_H */
@@ -0,0 +1,21 @@
+// Host block device imports. The JS client passes the real callbacks in the
+// env import object when it instantiates the module; these entries only tell
+// emcc the symbols are expected. The standalone builds emit no JS, so the
+// stubs never run.
+addToLibrary({
+  lfsjs_host_read: () => {
+    throw new Error("lfsjs_host_read is supplied by the host block device");
+  },
+  lfsjs_host_write: () => {
+    throw new Error("lfsjs_host_write is supplied by the host block device");
+  },
+  lfsjs_host_erase: () => {
+    throw new Error("lfsjs_host_erase is supplied by the host block device");
+  },
+  fatfsjs_host_read: () => {
+    throw new Error("fatfsjs_host_read is supplied by the host block device");
+  },
+  fatfsjs_host_write: () => {
+    throw new Error("fatfsjs_host_write is supplied by the host block device");
+  },
+});
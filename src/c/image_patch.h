@@ -0,0 +1,288 @@
+#ifndef IMAGE_PATCH_H
+#define IMAGE_PATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "block_ops.h"
+
+/*
+ * Block-granular image patches, shared by the LittleFS, FatFS and SPIFFS
+ * modules so a patch has the same layout whichever filesystem produced it:
+ *
+ *   header  u32 magic "FSPT", u32 granularity, u32 image bytes, u32 ranges
+ *   range   u32 first unit, u32 unit count, count * granularity bytes
+ *
+ * Fields are little-endian, like wasm memory. A range carries the new
+ * contents of consecutive changed units, so applying the patch to the old
+ * image yields the new one.
+ */
+#define IMGPATCH_MAGIC 0x54505346u
+#define IMGPATCH_HEADER_BYTES 16u
+#define IMGPATCH_RANGE_BYTES 8u
+
+#define IMGPATCH_OK 0
+#define IMGPATCH_ERR_INVAL -1
+#define IMGPATCH_ERR_NOMEM -2
+
+/*
+ * Returns the old contents of a whole device block, or NULL when the block is
+ * known to be unchanged, which lets a diff against a snapshot skip it.
+ */
+typedef const uint8_t *(*imgpatch_view_fn)(uint32_t block, void *ctx);
+
+/* Writes patch data into the live image at a byte offset. */
+typedef int (*imgpatch_write_fn)(uint32_t offset, const uint8_t *data,
+                                 uint32_t len, void *ctx);
+
+typedef struct {
+    const uint8_t *live;
+    uint32_t image_bytes;
+    uint32_t block_size;
+    imgpatch_view_fn view;
+    void *ctx;
+} imgpatch_source;
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+} imgpatch_buffer;
+
+static inline void imgpatch_put_u32(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+static inline uint32_t imgpatch_get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+/* Units are whole blocks, or whole fractions of one, and tile the image. */
+static inline bool imgpatch_granularity_ok(uint32_t granularity,
+                                           uint32_t block_size,
+                                           uint32_t image_bytes) {
+    if (granularity == 0 || image_bytes % granularity != 0) {
+        return false;
+    }
+    return granularity % block_size == 0 || block_size % granularity == 0;
+}
+
+static bool imgpatch_unit_changed(const imgpatch_source *src, uint32_t offset,
+                                  uint32_t len) {
+    while (len > 0) {
+        uint32_t block = offset / src->block_size;
+        uint32_t within = offset % src->block_size;
+        uint32_t span = src->block_size - within;
+        if (span > len) {
+            span = len;
+        }
+        const uint8_t *old = src->view(block, src->ctx);
+        if (old && !blockops_equal(old + within, src->live + offset, span)) {
+            return true;
+        }
+        offset += span;
+        len -= span;
+    }
+    return false;
+}
+
+static bool imgpatch_reserve(imgpatch_buffer *buf, size_t extra) {
+    if (buf->len + extra <= buf->cap) {
+        return true;
+    }
+    size_t cap = buf->cap ? buf->cap : 4096;
+    while (cap < buf->len + extra) {
+        cap *= 2;
+    }
+    uint8_t *grown = (uint8_t *)realloc(buf->data, cap);
+    if (!grown) {
+        return false;
+    }
+    buf->data = grown;
+    buf->cap = cap;
+    return true;
+}
+
+/* Decides whether a unit goes into the output. */
+typedef bool (*imgpatch_keep_fn)(uint32_t unit, void *ctx);
+
+/*
+ * Emits every run of units that keep() selects, with their live contents.
+ * On success *out is a malloc'd buffer owned by the caller.
+ */
+static int imgpatch_collect(const uint8_t *live, uint32_t image_bytes,
+                            uint32_t granularity, imgpatch_keep_fn keep,
+                            void *ctx, uint8_t **out, uint32_t *out_len) {
+    imgpatch_buffer buf = {NULL, 0, 0};
+    if (!imgpatch_reserve(&buf, IMGPATCH_HEADER_BYTES)) {
+        return IMGPATCH_ERR_NOMEM;
+    }
+    buf.len = IMGPATCH_HEADER_BYTES;
+    uint32_t units = image_bytes / granularity;
+    uint32_t ranges = 0;
+    uint32_t unit = 0;
+    while (unit < units) {
+        if (!keep(unit, ctx)) {
+            unit++;
+            continue;
+        }
+        uint32_t first = unit++;
+        while (unit < units && keep(unit, ctx)) {
+            unit++;
+        }
+        size_t bytes = (size_t)(unit - first) * granularity;
+        if (!imgpatch_reserve(&buf, IMGPATCH_RANGE_BYTES + bytes)) {
+            free(buf.data);
+            return IMGPATCH_ERR_NOMEM;
+        }
+        imgpatch_put_u32(buf.data + buf.len, first);
+        imgpatch_put_u32(buf.data + buf.len + 4, unit - first);
+        memcpy(buf.data + buf.len + IMGPATCH_RANGE_BYTES,
+               live + (size_t)first * granularity, bytes);
+        buf.len += IMGPATCH_RANGE_BYTES + bytes;
+        ranges++;
+    }
+    imgpatch_put_u32(buf.data, IMGPATCH_MAGIC);
+    imgpatch_put_u32(buf.data + 4, granularity);
+    imgpatch_put_u32(buf.data + 8, image_bytes);
+    imgpatch_put_u32(buf.data + 12, ranges);
+    *out = buf.data;
+    *out_len = (uint32_t)buf.len;
+    return IMGPATCH_OK;
+}
+
+typedef struct {
+    const imgpatch_source *src;
+    uint32_t granularity;
+} imgpatch_diff_ctx;
+
+static bool imgpatch_diff_keep(uint32_t unit, void *ctx) {
+    const imgpatch_diff_ctx *diff = (const imgpatch_diff_ctx *)ctx;
+    return imgpatch_unit_changed(diff->src, unit * diff->granularity,
+                                 diff->granularity);
+}
+
+/*
+ * Builds a patch taking the old image seen through src->view to the live one.
+ * On success *out is a malloc'd buffer owned by the caller.
+ */
+static int imgpatch_diff(const imgpatch_source *src, uint32_t granularity,
+                         uint8_t **out, uint32_t *out_len) {
+    if (granularity == 0) {
+        granularity = src->block_size;
+    }
+    if (!imgpatch_granularity_ok(granularity, src->block_size,
+                                 src->image_bytes)) {
+        return IMGPATCH_ERR_INVAL;
+    }
+    imgpatch_diff_ctx diff = {src, granularity};
+    return imgpatch_collect(src->live, src->image_bytes, granularity,
+                            imgpatch_diff_keep, &diff, out, out_len);
+}
+
+/*
+ * Sparse exports share the layout. The ranges are the units the filesystem
+ * has in use, from a caller-built map with one bit per unit; everything else
+ * is free space whose old contents the filesystem never reads back.
+ */
+#define IMGPATCH_SPARSE_SKIP_ERASED 0x01u
+
+static inline void imgpatch_mark(uint8_t *map, uint32_t unit) {
+    map[unit >> 3] |= (uint8_t)(1u << (unit & 7));
+}
+
+static inline bool imgpatch_marked(const uint8_t *map, uint32_t unit) {
+    return (map[unit >> 3] >> (unit & 7)) & 1u;
+}
+
+static inline void imgpatch_mark_range(uint8_t *map, uint32_t first,
+                                       uint32_t count) {
+    while (count--) {
+        imgpatch_mark(map, first++);
+    }
+}
+
+typedef struct {
+    const uint8_t *live;
+    uint32_t granularity;
+    const uint8_t *used;
+    uint32_t flags;
+} imgpatch_sparse_ctx;
+
+static bool imgpatch_sparse_keep(uint32_t unit, void *ctx) {
+    const imgpatch_sparse_ctx *sparse = (const imgpatch_sparse_ctx *)ctx;
+    if (!imgpatch_marked(sparse->used, unit)) {
+        return false;
+    }
+    return !(sparse->flags & IMGPATCH_SPARSE_SKIP_ERASED) ||
+           !blockops_erased(sparse->live + (size_t)unit * sparse->granularity,
+                            sparse->granularity);
+}
+
+/* Emits the units marked in used, optionally leaving out all-0xFF ones. */
+static int imgpatch_sparse(const uint8_t *live, uint32_t image_bytes,
+                           uint32_t granularity, const uint8_t *used,
+                           uint32_t flags, uint8_t **out, uint32_t *out_len) {
+    if (granularity == 0 || image_bytes % granularity != 0 || !used) {
+        return IMGPATCH_ERR_INVAL;
+    }
+    imgpatch_sparse_ctx sparse = {live, granularity, used, flags};
+    return imgpatch_collect(live, image_bytes, granularity,
+                            imgpatch_sparse_keep, &sparse, out, out_len);
+}
+
+/* Checks the whole patch against an image of image_bytes before any write. */
+static int imgpatch_validate(const uint8_t *patch, uint32_t len,
+                             uint32_t image_bytes) {
+    if (!patch || len < IMGPATCH_HEADER_BYTES ||
+        imgpatch_get_u32(patch) != IMGPATCH_MAGIC ||
+        imgpatch_get_u32(patch + 8) != image_bytes) {
+        return IMGPATCH_ERR_INVAL;
+    }
+    uint32_t granularity = imgpatch_get_u32(patch + 4);
+    if (granularity == 0 || image_bytes % granularity != 0) {
+        return IMGPATCH_ERR_INVAL;
+    }
+    uint64_t units = image_bytes / granularity;
+    uint32_t ranges = imgpatch_get_u32(patch + 12);
+    uint64_t cursor = IMGPATCH_HEADER_BYTES;
+    for (uint32_t i = 0; i < ranges; i++) {
+        if (cursor + IMGPATCH_RANGE_BYTES > len) {
+            return IMGPATCH_ERR_INVAL;
+        }
+        uint64_t first = imgpatch_get_u32(patch + cursor);
+        uint64_t count = imgpatch_get_u32(patch + cursor + 4);
+        if (count == 0 || first + count > units) {
+            return IMGPATCH_ERR_INVAL;
+        }
+        cursor += IMGPATCH_RANGE_BYTES + count * granularity;
+    }
+    return cursor == len ? IMGPATCH_OK : IMGPATCH_ERR_INVAL;
+}
+
+/* Applies a patch that passed imgpatch_validate. */
+static int imgpatch_apply(const uint8_t *patch, imgpatch_write_fn write,
+                          void *ctx) {
+    uint32_t granularity = imgpatch_get_u32(patch + 4);
+    uint32_t ranges = imgpatch_get_u32(patch + 12);
+    const uint8_t *cursor = patch + IMGPATCH_HEADER_BYTES;
+    for (uint32_t i = 0; i < ranges; i++) {
+        uint32_t first = imgpatch_get_u32(cursor);
+        uint32_t bytes = imgpatch_get_u32(cursor + 4) * granularity;
+        int err = write(first * granularity, cursor + IMGPATCH_RANGE_BYTES,
+                        bytes, ctx);
+        if (err) {
+            return err;
+        }
+        cursor += IMGPATCH_RANGE_BYTES + bytes;
+    }
+    return IMGPATCH_OK;
+}
+
+#endif /* IMAGE_PATCH_H */
@@ -6,16 +6,35 @@
 
 #include <emscripten/emscripten.h>
 
+#include "block_hash.h"
+#include "block_ops.h"
+#include "host_block_cache.h"
+#include "image_patch.h"
 #include "lfs.h"
 #include "lfs_util.h"
 
 #define LFSJS_PATH_MAX 512
-#define LFSJS_DEFAULT_LOOKAHEAD 32
+#define LFSJS_MIN_LOOKAHEAD 16
+#define LFSJS_HOST_LOOKAHEAD (64 * 1024)
 
 static lfs_t g_lfs;
 static struct lfs_config g_cfg;
 static uint8_t *g_storage = NULL;
+static hostcache *g_host = NULL;
 static bool g_is_mounted = false;
+static bool g_io_stats_enabled = false;
+static uint64_t *g_io_stats = NULL;
+static uint32_t g_io_stats_blocks = 0;
+
+typedef struct lfsjs_snapshot {
+    struct lfsjs_snapshot *older;
+    uint32_t id;
+    uint32_t saved;
+    uint8_t **blocks;
+} lfsjs_snapshot_t;
+
+static lfsjs_snapshot_t *g_snapshots = NULL;
+static uint32_t g_next_snapshot_id = 1;
 
 static size_t lfsjs_total_bytes(const struct lfs_config *cfg);
 static int lfsjs_mount_internal(bool allow_format);
@@ -24,7 +43,10 @@ static int lfsjs_join_path(const char *base, const char *leaf, char *out,
 static int lfsjs_walk(const char *dir, char **cursor, const char *end,
                       bool include_dirs);
 
+static void lfsjs_snapshots_free(void);
+
 static void lfsjs_release(void) {
+    lfsjs_snapshots_free();
     if (g_is_mounted) {
         lfs_unmount(&g_lfs);
         g_is_mounted = false;
@@ -33,6 +55,11 @@ static void lfsjs_release(void) {
         free(g_storage);
         g_storage = NULL;
     }
+    if (g_host) {
+        hostcache_flush(g_host);
+        hostcache_destroy(g_host);
+        g_host = NULL;
+    }
 }
 
 static size_t lfsjs_total_bytes(const struct lfs_config *cfg) {
@@ -48,27 +75,126 @@ static size_t lfsjs_current_size(void) {
 
 static void lfsjs_fill_erased(void) {
     if (g_storage) {
-        memset(g_storage, 0xFF, lfsjs_total_bytes(&g_cfg));
+        blockops_fill_erased(g_storage, lfsjs_total_bytes(&g_cfg));
+    }
+}
+
+/*
+ * I/O counters, like lfs_emubd's wear, readed and proged. While enabled,
+ * g_io_stats holds three totals (erases, programmed bytes, read bytes)
+ * followed by the same three counters for every block, one array each.
+ * Disabled, the block device pays a single NULL check per call.
+ */
+enum { LFSJS_IO_ERASES, LFSJS_IO_PROG, LFSJS_IO_READ, LFSJS_IO_KINDS };
+
+static void lfsjs_io_stats_free(void) {
+    free(g_io_stats);
+    g_io_stats = NULL;
+    g_io_stats_blocks = 0;
+}
+
+static int lfsjs_io_stats_alloc(uint32_t block_count) {
+    lfsjs_io_stats_free();
+    if (!g_io_stats_enabled || block_count == 0) {
+        return 0;
+    }
+    g_io_stats = (uint64_t *)calloc(
+        LFSJS_IO_KINDS * ((size_t)block_count + 1), sizeof(uint64_t));
+    if (!g_io_stats) {
+        return LFS_ERR_NOMEM;
+    }
+    g_io_stats_blocks = block_count;
+    return 0;
+}
+
+static inline void lfsjs_io_count(int kind, lfs_block_t block, uint64_t amount) {
+    if (g_io_stats && block < g_io_stats_blocks) {
+        g_io_stats[kind] += amount;
+        g_io_stats[LFSJS_IO_KINDS + (size_t)kind * g_io_stats_blocks + block] +=
+            amount;
+    }
+}
+
+/*
+ * Copy-on-write snapshots. The live image stays one contiguous buffer and a
+ * snapshot keeps the pre-image of each block that is programmed or erased
+ * after it was taken, so taking one costs a zeroed block table and memory
+ * grows only with the blocks that change. Only the newest snapshot records
+ * pre-images: a block left alone between an older snapshot and a newer one
+ * reads the same in both, so the older snapshot's view of a block is the copy
+ * held by the oldest snapshot at or after it.
+ */
+static void lfsjs_snapshot_free(lfsjs_snapshot_t *snap) {
+    for (uint32_t i = 0; snap->saved && i < g_cfg.block_count; i++) {
+        if (snap->blocks[i]) {
+            free(snap->blocks[i]);
+            snap->saved--;
+        }
     }
+    free(snap->blocks);
+    free(snap);
+}
+
+static void lfsjs_snapshots_free(void) {
+    while (g_snapshots) {
+        lfsjs_snapshot_t *older = g_snapshots->older;
+        lfsjs_snapshot_free(g_snapshots);
+        g_snapshots = older;
+    }
+}
+
+static int lfsjs_snapshot_preserve(lfs_block_t block) {
+    lfsjs_snapshot_t *snap = g_snapshots;
+    if (!snap || block >= g_cfg.block_count || snap->blocks[block]) {
+        return 0;
+    }
+    uint8_t *copy = (uint8_t *)malloc(g_cfg.block_size);
+    if (!copy) {
+        return LFS_ERR_NOMEM;
+    }
+    memcpy(copy, &g_storage[(size_t)block * g_cfg.block_size],
+           g_cfg.block_size);
+    snap->blocks[block] = copy;
+    snap->saved++;
+    return 0;
+}
+
+static lfsjs_snapshot_t **lfsjs_snapshot_find(uint32_t id) {
+    lfsjs_snapshot_t **cursor = &g_snapshots;
+    while (*cursor && (*cursor)->id != id) {
+        cursor = &(*cursor)->older;
+    }
+    return *cursor ? cursor : NULL;
 }
 
 static int lfsjs_ram_read(const struct lfs_config *c, lfs_block_t block,
                           lfs_off_t off, void *buffer, lfs_size_t size) {
     size_t idx = (size_t)block * c->block_size + off;
     memcpy(buffer, &g_storage[idx], size);
+    lfsjs_io_count(LFSJS_IO_READ, block, size);
     return 0;
 }
 
 static int lfsjs_ram_prog(const struct lfs_config *c, lfs_block_t block,
                           lfs_off_t off, const void *buffer, lfs_size_t size) {
+    int err = lfsjs_snapshot_preserve(block);
+    if (err) {
+        return err;
+    }
     size_t idx = (size_t)block * c->block_size + off;
     memcpy(&g_storage[idx], buffer, size);
+    lfsjs_io_count(LFSJS_IO_PROG, block, size);
     return 0;
 }
 
 static int lfsjs_ram_erase(const struct lfs_config *c, lfs_block_t block) {
+    int err = lfsjs_snapshot_preserve(block);
+    if (err) {
+        return err;
+    }
     size_t idx = (size_t)block * c->block_size;
-    memset(&g_storage[idx], 0xFF, c->block_size);
+    blockops_fill_erased(&g_storage[idx], c->block_size);
+    lfsjs_io_count(LFSJS_IO_ERASES, block, 1);
     return 0;
 }
 
@@ -77,26 +203,99 @@ static int lfsjs_ram_sync(const struct lfs_config *c) {
     return 0;
 }
 
+/*
+ * Host block device: the volume lives with the JS client (a file descriptor,
+ * say) and littlefs reaches it through g_host, the write-back cache in
+ * host_block_cache.h. The imports move whole blocks.
+ */
+__attribute__((import_module("env"), import_name("lfsjs_host_read")))
+int lfsjs_host_read(uint32_t block, uint32_t count, uint8_t *data);
+__attribute__((import_module("env"), import_name("lfsjs_host_write")))
+int lfsjs_host_write(uint32_t block, uint32_t count, uint8_t *data);
+__attribute__((import_module("env"), import_name("lfsjs_host_erase")))
+int lfsjs_host_erase(uint32_t block, uint32_t count);
+
+static int lfsjs_host_result(int err) {
+    if (err == HOSTCACHE_ERR_NOMEM) {
+        return LFS_ERR_NOMEM;
+    }
+    return err ? LFS_ERR_IO : 0;
+}
+
+static int lfsjs_host_bd_read(const struct lfs_config *c, lfs_block_t block,
+                              lfs_off_t off, void *buffer, lfs_size_t size) {
+    int err = hostcache_read(g_host, (uint64_t)block * c->block_size + off,
+                             (uint8_t *)buffer, size);
+    lfsjs_io_count(LFSJS_IO_READ, block, size);
+    return lfsjs_host_result(err);
+}
+
+static int lfsjs_host_bd_prog(const struct lfs_config *c, lfs_block_t block,
+                              lfs_off_t off, const void *buffer,
+                              lfs_size_t size) {
+    int err = hostcache_write(g_host, (uint64_t)block * c->block_size + off,
+                              (const uint8_t *)buffer, size);
+    lfsjs_io_count(LFSJS_IO_PROG, block, size);
+    return lfsjs_host_result(err);
+}
+
+static int lfsjs_host_bd_erase(const struct lfs_config *c, lfs_block_t block) {
+    (void)c;
+    lfsjs_io_count(LFSJS_IO_ERASES, block, 1);
+    return lfsjs_host_result(hostcache_erase_block(g_host, block));
+}
+
+#ifdef LFS_CRC
+/*
+ * Slicing-by-8 replacement for the nibble-table lfs_crc, selected by building
+ * with -DLFS_CRC=lfsjs_crc. littlefs checksums every metadata commit and every
+ * fetched metadata block, so this is on the mount and directory paths. Same
+ * reflected polynomial and no pre/post inversion, so the results are
+ * bit-identical. The table is the one block_hash.h uses for CRC32 digests.
+ */
+uint32_t lfsjs_crc(uint32_t crc, const void *buffer, size_t size) {
+    return blockhash_crc32_update(crc, (const uint8_t *)buffer, size);
+}
+#endif
+
 static uint32_t lfsjs_choose_io_size(uint32_t block_size) {
     const uint32_t min_io = 16;
     return block_size < min_io ? block_size : min_io;
 }
 
-static uint32_t lfsjs_choose_lookahead(uint32_t requested) {
-    uint32_t value = requested ? requested : LFSJS_DEFAULT_LOOKAHEAD;
-    if (value < 16) {
-        value = 16;
+/*
+ * The lookahead buffer is a free-block bitmap covering 8 * lookahead_size
+ * blocks, and every time lfs_alloc exhausts it littlefs traverses the whole
+ * filesystem to refill it. With the stock 32 bytes that is one traversal per
+ * 256 allocated blocks, so bulk writes into a large image go quadratic. The
+ * image lives in host memory, so by default (requested == 0) size the bitmap
+ * to cover the entire device: one traversal per pass over the disk, then O(1)
+ * amortized per allocated block. Explicit sizes are honoured, but there is
+ * nothing to gain beyond whole-device coverage.
+ */
+static uint32_t lfsjs_choose_lookahead(uint32_t requested,
+                                       uint32_t block_count) {
+    uint32_t whole_device = (uint32_t)(((uint64_t)block_count + 7u) / 8u);
+    uint32_t value = requested ? requested : whole_device;
+    if (value > whole_device) {
+        value = whole_device;
+    }
+    if (value < LFSJS_MIN_LOOKAHEAD) {
+        value = LFSJS_MIN_LOOKAHEAD;
     }
     /* lookahead must be a multiple of 8 bytes */
     value = (value + 7u) & ~7u;
     return value;
 }
 
-static int lfsjs_configure(uint32_t block_size, uint32_t block_count,
-                           uint32_t lookahead_size) {
+static int lfsjs_configure_geometry(uint32_t block_size, uint32_t block_count,
+                                    uint32_t lookahead_size) {
     if (block_size == 0 || block_count == 0) {
         return LFS_ERR_INVAL;
     }
+    if ((uint64_t)block_size * block_count > SIZE_MAX) {
+        return LFS_ERR_NOMEM;
+    }
 
     lfsjs_release();
     memset(&g_cfg, 0, sizeof(g_cfg));
@@ -113,7 +312,16 @@ static int lfsjs_configure(uint32_t block_size, uint32_t block_count,
     g_cfg.block_size = block_size;
     g_cfg.block_count = block_count;
     g_cfg.block_cycles = 512;
-    g_cfg.lookahead_size = lfsjs_choose_lookahead(lookahead_size);
+    g_cfg.lookahead_size = lfsjs_choose_lookahead(lookahead_size, block_count);
+    return 0;
+}
+
+static int lfsjs_configure(uint32_t block_size, uint32_t block_count,
+                           uint32_t lookahead_size) {
+    int err = lfsjs_configure_geometry(block_size, block_count, lookahead_size);
+    if (err) {
+        return err;
+    }
 
     size_t total_bytes = lfsjs_total_bytes(&g_cfg);
     g_storage = (uint8_t *)malloc(total_bytes);
@@ -122,7 +330,7 @@ static int lfsjs_configure(uint32_t block_size, uint32_t block_count,
     }
 
     lfsjs_fill_erased();
-    return 0;
+    return lfsjs_io_stats_alloc(block_count);
 }
 
 static int lfsjs_mount_internal(bool allow_format) {
@@ -166,11 +374,37 @@ int lfsjs_init(uint32_t block_size, uint32_t block_count,
     return err;
 }
 
+/*
+ * Allocates storage for an image the host writes in place through
+ * lfsjs_storage_ptr, without formatting; lfsjs_import_end then mounts it.
+ * Streaming imports use this so the raw image never exists twice.
+ */
+EMSCRIPTEN_KEEPALIVE
+int lfsjs_import_begin(uint32_t block_size, uint32_t block_count,
+                       uint32_t lookahead_size) {
+    return lfsjs_configure(block_size, block_count, lookahead_size);
+}
+
+EMSCRIPTEN_KEEPALIVE
+int lfsjs_import_end(void) {
+    if (!g_storage) {
+        return LFS_ERR_INVAL;
+    }
+    int err = lfs_mount(&g_lfs, &g_cfg);
+    if (err) {
+        lfsjs_release();
+        return err;
+    }
+
+    g_is_mounted = true;
+    return 0;
+}
+
 EMSCRIPTEN_KEEPALIVE
 int lfsjs_init_from_image(uint32_t block_size, uint32_t block_count,
                           uint32_t lookahead_size, const uint8_t *image,
-                          uint32_t image_len) {
-    int err = lfsjs_configure(block_size, block_count, lookahead_size);
+                          size_t image_len) {
+    int err = lfsjs_import_begin(block_size, block_count, lookahead_size);
     if (err) {
         return err;
     }
@@ -182,15 +416,53 @@ int lfsjs_init_from_image(uint32_t block_size, uint32_t block_count,
     }
 
     memcpy(g_storage, image, total);
+    return lfsjs_import_end();
+}
 
-    err = lfs_mount(&g_lfs, &g_cfg);
+/*
+ * Mounts a volume on the host block device behind a cache of cache_blocks
+ * blocks that reads ahead and writes back up to read_ahead blocks per host
+ * call. Only the cache and the lookahead bitmap, which by default stops
+ * growing at LFSJS_HOST_LOOKAHEAD bytes, live in wasm memory. With format
+ * set the device is formatted first.
+ */
+EMSCRIPTEN_KEEPALIVE
+int lfsjs_init_host(uint32_t block_size, uint32_t block_count,
+                    uint32_t lookahead_size, uint32_t cache_blocks,
+                    uint32_t read_ahead, uint32_t format) {
+    int err = lfsjs_configure_geometry(
+        block_size, block_count,
+        lookahead_size ? lookahead_size : LFSJS_HOST_LOOKAHEAD);
     if (err) {
-        lfsjs_release();
         return err;
     }
 
-    g_is_mounted = true;
-    return 0;
+    g_cfg.read = lfsjs_host_bd_read;
+    g_cfg.prog = lfsjs_host_bd_prog;
+    g_cfg.erase = lfsjs_host_bd_erase;
+    g_host = hostcache_create(block_size, block_count, cache_blocks, read_ahead,
+                              lfsjs_host_read, lfsjs_host_write,
+                              lfsjs_host_erase);
+    if (!g_host) {
+        return LFS_ERR_NOMEM;
+    }
+    err = lfsjs_io_stats_alloc(block_count);
+    if (!err && format) {
+        err = lfs_format(&g_lfs, &g_cfg);
+    }
+    if (!err) {
+        err = lfsjs_mount_internal(false);
+    }
+    if (err) {
+        lfsjs_release();
+    }
+    return err;
+}
+
+/* Writes blocks the host device cache holds dirty back to the host. */
+EMSCRIPTEN_KEEPALIVE
+int lfsjs_flush(void) {
+    return g_host ? lfsjs_host_result(hostcache_flush(g_host)) : 0;
 }
 
 EMSCRIPTEN_KEEPALIVE
@@ -210,19 +482,10 @@ int lfsjs_format(void) {
     return lfsjs_mount_internal(false);
 }
 
-EMSCRIPTEN_KEEPALIVE
-int lfsjs_add_file(const char *path, const uint8_t *data, uint32_t length) {
-    int err = lfsjs_ensure_mounted();
-    if (err) {
-        return err;
-    }
-    if (!path) {
-        return LFS_ERR_INVAL;
-    }
-
+static int lfsjs_write_with_flags(const char *path, const uint8_t *data,
+                                  uint32_t length, int flags) {
     lfs_file_t file;
-    err = lfs_file_open(&g_lfs, &file, path,
-                        LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
+    int err = lfs_file_open(&g_lfs, &file, path, LFS_O_WRONLY | LFS_O_CREAT | flags);
     if (err < 0) {
         return err;
     }
@@ -243,6 +506,75 @@ int lfsjs_add_file(const char *path, const uint8_t *data, uint32_t length) {
     return err < 0 ? err : 0;
 }
 
+EMSCRIPTEN_KEEPALIVE
+int lfsjs_add_file(const char *path, const uint8_t *data, uint32_t length) {
+    int err = lfsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    if (!path) {
+        return LFS_ERR_INVAL;
+    }
+    return lfsjs_write_with_flags(path, data, length, LFS_O_TRUNC);
+}
+
+/* Appends to the end of path, creating it if needed. Only the new data is
+ * written; the existing blocks of the file are left alone. */
+EMSCRIPTEN_KEEPALIVE
+int lfsjs_append_file(const char *path, const uint8_t *data, uint32_t length) {
+    int err = lfsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    if (!path || (length > 0 && !data)) {
+        return LFS_ERR_INVAL;
+    }
+    return lfsjs_write_with_flags(path, data, length, LFS_O_APPEND);
+}
+
+/* Appends to several files in one call. manifest holds "path\tlength\n"
+ * lines and data the payloads back to back in the same order. Returns the
+ * number of files appended to. */
+EMSCRIPTEN_KEEPALIVE
+int lfsjs_append_batch(const char *manifest, const uint8_t *data,
+                       uint32_t data_len) {
+    int err = lfsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    if (!manifest || (data_len > 0 && !data)) {
+        return LFS_ERR_INVAL;
+    }
+
+    char path[LFSJS_PATH_MAX];
+    const char *line = manifest;
+    uint32_t offset = 0;
+    int count = 0;
+    while (*line) {
+        const char *tab = strchr(line, '\t');
+        if (!tab || (size_t)(tab - line) >= sizeof(path)) {
+            return LFS_ERR_INVAL;
+        }
+        memcpy(path, line, (size_t)(tab - line));
+        path[tab - line] = '\0';
+        char *end = NULL;
+        unsigned long length = strtoul(tab + 1, &end, 10);
+        if (end == tab + 1 || (*end != '\n' && *end != '\0') ||
+            length > data_len - offset) {
+            return LFS_ERR_INVAL;
+        }
+        err = lfsjs_write_with_flags(path, data ? data + offset : NULL,
+                                     (uint32_t)length, LFS_O_APPEND);
+        if (err) {
+            return err;
+        }
+        offset += (uint32_t)length;
+        count++;
+        line = *end ? end + 1 : end;
+    }
+    return count;
+}
+
 EMSCRIPTEN_KEEPALIVE
 int lfsjs_delete_file(const char *path) {
     int err = lfsjs_ensure_mounted();
@@ -377,7 +709,7 @@ int lfsjs_file_size(const char *path) {
 }
 
 EMSCRIPTEN_KEEPALIVE
-int lfsjs_read_file(const char *path, uint32_t buffer_ptr, uint32_t buffer_len) {
+int lfsjs_read_file(const char *path, uintptr_t buffer_ptr, uint32_t buffer_len) {
     int err = lfsjs_ensure_mounted();
     if (err) {
         return err;
@@ -404,7 +736,7 @@ int lfsjs_read_file(const char *path, uint32_t buffer_ptr, uint32_t buffer_len)
         return err;
     }
 
-    uint8_t *dest = (uint8_t *)(uintptr_t)buffer_ptr;
+    uint8_t *dest = (uint8_t *)buffer_ptr;
     lfs_size_t remaining = info.size;
     while (remaining > 0) {
         lfs_size_t chunk = remaining;
@@ -425,12 +757,18 @@ int lfsjs_read_file(const char *path, uint32_t buffer_ptr, uint32_t buffer_len)
 }
 
 EMSCRIPTEN_KEEPALIVE
-uint32_t lfsjs_storage_size(void) {
-    return (uint32_t)lfsjs_current_size();
+size_t lfsjs_storage_size(void) {
+    return lfsjs_current_size();
 }
 
+/* The live image, for hosts that stream it in or out without a copy. */
 EMSCRIPTEN_KEEPALIVE
-int lfsjs_export_image(uint32_t buffer_ptr, uint32_t buffer_len) {
+uintptr_t lfsjs_storage_ptr(void) {
+    return (uintptr_t)g_storage;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int lfsjs_export_image(uintptr_t buffer_ptr, size_t buffer_len) {
     size_t total = lfsjs_current_size();
     if (!g_storage || total == 0) {
         return LFS_ERR_INVAL;
@@ -439,14 +777,14 @@ int lfsjs_export_image(uint32_t buffer_ptr, uint32_t buffer_len) {
         return LFS_ERR_NOSPC;
     }
 
-    memcpy((void *)(uintptr_t)buffer_ptr, g_storage, total);
-    return (int)total;
+    memcpy((void *)buffer_ptr, g_storage, total);
+    return 0;
 }
 
 static int lfsjs_remove_recursive(const char *path);
 
 EMSCRIPTEN_KEEPALIVE
-int lfsjs_list(const char *path, uint32_t buffer_ptr, uint32_t buffer_len) {
+int lfsjs_list(const char *path, uintptr_t buffer_ptr, uint32_t buffer_len) {
     int err = lfsjs_ensure_mounted();
     if (err) {
         return err;
@@ -456,7 +794,7 @@ int lfsjs_list(const char *path, uint32_t buffer_ptr, uint32_t buffer_len) {
     }
 
     const char *root = (path && path[0]) ? path : "/";
-    char *cursor = (char *)(uintptr_t)buffer_ptr;
+    char *cursor = (char *)buffer_ptr;
     const char *end = cursor + buffer_len;
     *cursor = '\0';
 
@@ -478,7 +816,7 @@ int lfsjs_list(const char *path, uint32_t buffer_ptr, uint32_t buffer_len) {
     if (cursor < end) {
         *cursor = '\0';
     }
-    return (int)(cursor - (char *)(uintptr_t)buffer_ptr);
+    return (int)(cursor - (char *)buffer_ptr);
 }
 
 EMSCRIPTEN_KEEPALIVE
@@ -568,3 +906,368 @@ int lfsjs_remove(const char *path, int recursive) {
     }
     return lfsjs_remove_recursive(path);
 }
+
+/*
+ * Enabling allocates zeroed counters for the current volume; volumes created
+ * afterwards get fresh counters. Disabling frees them.
+ */
+EMSCRIPTEN_KEEPALIVE
+int lfsjs_set_io_stats(uint32_t enabled) {
+    g_io_stats_enabled = enabled != 0;
+    return lfsjs_io_stats_alloc(g_storage || g_host ? g_cfg.block_count : 0);
+}
+
+EMSCRIPTEN_KEEPALIVE
+int lfsjs_reset_io_stats(void) {
+    if (!g_io_stats) {
+        return LFS_ERR_INVAL;
+    }
+    memset(g_io_stats, 0,
+           LFSJS_IO_KINDS * ((size_t)g_io_stats_blocks + 1) * sizeof(uint64_t));
+    return 0;
+}
+
+/*
+ * Copies the counters as laid out in g_io_stats and returns the block count,
+ * which is all it returns for a NULL buffer.
+ */
+EMSCRIPTEN_KEEPALIVE
+int lfsjs_get_io_stats(uintptr_t buffer_ptr, uint32_t buffer_len) {
+    if (!g_io_stats) {
+        return LFS_ERR_INVAL;
+    }
+    size_t bytes =
+        LFSJS_IO_KINDS * ((size_t)g_io_stats_blocks + 1) * sizeof(uint64_t);
+    if (buffer_ptr == 0) {
+        return (int)g_io_stats_blocks;
+    }
+    if (buffer_len < bytes) {
+        return LFS_ERR_NOSPC;
+    }
+    memcpy((void *)buffer_ptr, g_io_stats, bytes);
+    return (int)g_io_stats_blocks;
+}
+
+/*
+ * Returns the id of a new snapshot of the current image. Every call completes
+ * its file operations before returning, so the image is always consistent.
+ */
+EMSCRIPTEN_KEEPALIVE
+int lfsjs_snapshot(void) {
+    int err = lfsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    if (!g_storage) {
+        return LFS_ERR_INVAL;
+    }
+    lfsjs_snapshot_t *snap =
+        (lfsjs_snapshot_t *)calloc(1, sizeof(lfsjs_snapshot_t));
+    if (!snap) {
+        return LFS_ERR_NOMEM;
+    }
+    snap->blocks = (uint8_t **)calloc(g_cfg.block_count, sizeof(uint8_t *));
+    if (!snap->blocks) {
+        free(snap);
+        return LFS_ERR_NOMEM;
+    }
+    snap->id = g_next_snapshot_id++;
+    snap->older = g_snapshots;
+    g_snapshots = snap;
+    return (int)snap->id;
+}
+
+/*
+ * Rolls the image back to the snapshot and remounts. Snapshots taken after it
+ * describe states that no longer lead anywhere and are released; the snapshot
+ * itself stays valid, now with nothing to undo.
+ */
+EMSCRIPTEN_KEEPALIVE
+int lfsjs_restore_snapshot(uint32_t id) {
+    lfsjs_snapshot_t **found = lfsjs_snapshot_find(id);
+    if (!found) {
+        return LFS_ERR_INVAL;
+    }
+    lfsjs_snapshot_t *target = *found;
+    if (g_is_mounted) {
+        lfs_unmount(&g_lfs);
+        g_is_mounted = false;
+    }
+    for (lfsjs_snapshot_t *snap = g_snapshots;; snap = snap->older) {
+        for (uint32_t i = 0; snap->saved && i < g_cfg.block_count; i++) {
+            if (snap->blocks[i]) {
+                memcpy(&g_storage[(size_t)i * g_cfg.block_size], snap->blocks[i],
+                       g_cfg.block_size);
+                free(snap->blocks[i]);
+                snap->blocks[i] = NULL;
+                snap->saved--;
+            }
+        }
+        if (snap == target) {
+            break;
+        }
+    }
+    while (g_snapshots != target) {
+        lfsjs_snapshot_t *older = g_snapshots->older;
+        lfsjs_snapshot_free(g_snapshots);
+        g_snapshots = older;
+    }
+    return lfsjs_mount_internal(false);
+}
+
+/*
+ * Drops a snapshot. Pre-images it holds for blocks the next older snapshot has
+ * not saved are that snapshot's view too, so they move down instead of being
+ * freed.
+ */
+EMSCRIPTEN_KEEPALIVE
+int lfsjs_release_snapshot(uint32_t id) {
+    lfsjs_snapshot_t **found = lfsjs_snapshot_find(id);
+    if (!found) {
+        return LFS_ERR_INVAL;
+    }
+    lfsjs_snapshot_t *snap = *found;
+    lfsjs_snapshot_t *older = snap->older;
+    for (uint32_t i = 0; older && snap->saved && i < g_cfg.block_count; i++) {
+        if (snap->blocks[i] && !older->blocks[i]) {
+            older->blocks[i] = snap->blocks[i];
+            older->saved++;
+            snap->blocks[i] = NULL;
+            snap->saved--;
+        }
+    }
+    *found = older;
+    lfsjs_snapshot_free(snap);
+    return 0;
+}
+
+/* Number of blocks the snapshot holds a pre-image for. */
+EMSCRIPTEN_KEEPALIVE
+int lfsjs_snapshot_blocks(uint32_t id) {
+    lfsjs_snapshot_t **found = lfsjs_snapshot_find(id);
+    if (!found) {
+        return LFS_ERR_INVAL;
+    }
+    return (int)(*found)->saved;
+}
+
+static const uint8_t *lfsjs_snapshot_view(uint32_t block, void *ctx) {
+    lfsjs_snapshot_t *target = (lfsjs_snapshot_t *)ctx;
+    const uint8_t *view = NULL;
+    for (lfsjs_snapshot_t *snap = g_snapshots;; snap = snap->older) {
+        if (snap->blocks[block]) {
+            view = snap->blocks[block];
+        }
+        if (snap == target) {
+            return view;
+        }
+    }
+}
+
+static const uint8_t *lfsjs_image_view(uint32_t block, void *ctx) {
+    return (const uint8_t *)ctx + (size_t)block * g_cfg.block_size;
+}
+
+static int lfsjs_patch_result(int err) {
+    if (err == IMGPATCH_ERR_NOMEM) {
+        return LFS_ERR_NOMEM;
+    }
+    return err ? LFS_ERR_INVAL : 0;
+}
+
+static void lfsjs_hand_over(uintptr_t result_ptr, uint8_t *data,
+                            uint32_t len) {
+    uintptr_t *dest = (uintptr_t *)result_ptr;
+    dest[0] = (uintptr_t)data;
+    dest[1] = len;
+}
+
+static int lfsjs_diff(imgpatch_view_fn view, void *ctx, uint32_t granularity,
+                      uintptr_t result_ptr) {
+    if (!g_storage || !result_ptr || lfsjs_total_bytes(&g_cfg) > UINT32_MAX) {
+        return LFS_ERR_INVAL;
+    }
+    imgpatch_source src = {g_storage, (uint32_t)lfsjs_total_bytes(&g_cfg),
+                           g_cfg.block_size, view, ctx};
+    uint8_t *patch = NULL;
+    uint32_t patch_len = 0;
+    int err = imgpatch_diff(&src, granularity, &patch, &patch_len);
+    if (err) {
+        return lfsjs_patch_result(err);
+    }
+    lfsjs_hand_over(result_ptr, patch, patch_len);
+    return 0;
+}
+
+/*
+ * Patch from the snapshot's image to the live one. Only blocks written since
+ * the snapshot are compared, so the cost follows the change, not the image.
+ * Writes {patch pointer, length} to result_ptr; the caller frees the patch.
+ */
+EMSCRIPTEN_KEEPALIVE
+int lfsjs_diff_snapshot(uint32_t id, uint32_t granularity,
+                        uintptr_t result_ptr) {
+    lfsjs_snapshot_t **found = lfsjs_snapshot_find(id);
+    if (!found) {
+        return LFS_ERR_INVAL;
+    }
+    return lfsjs_diff(lfsjs_snapshot_view, *found, granularity, result_ptr);
+}
+
+/* Patch from an image of the same geometry to the live one. */
+EMSCRIPTEN_KEEPALIVE
+int lfsjs_diff_image(const uint8_t *image, size_t image_len,
+                     uint32_t granularity, uintptr_t result_ptr) {
+    if (!image || image_len != lfsjs_current_size()) {
+        return LFS_ERR_INVAL;
+    }
+    return lfsjs_diff(lfsjs_image_view, (void *)image, granularity,
+                      result_ptr);
+}
+
+static int lfsjs_patch_write(uint32_t offset, const uint8_t *data,
+                             uint32_t len, void *ctx) {
+    (void)ctx;
+    lfs_block_t last = (offset + len - 1) / g_cfg.block_size;
+    for (lfs_block_t block = offset / g_cfg.block_size; block <= last;
+         block++) {
+        int err = lfsjs_snapshot_preserve(block);
+        if (err) {
+            return err;
+        }
+    }
+    memcpy(&g_storage[offset], data, len);
+    return 0;
+}
+
+/*
+ * Validates the whole patch, writes it straight into the image and remounts.
+ * Snapshots see the patched blocks like any other write.
+ */
+EMSCRIPTEN_KEEPALIVE
+int lfsjs_apply_patch(const uint8_t *patch, uint32_t patch_len) {
+    if (!g_storage || lfsjs_total_bytes(&g_cfg) > UINT32_MAX) {
+        return LFS_ERR_INVAL;
+    }
+    int err = imgpatch_validate(patch, patch_len,
+                                (uint32_t)lfsjs_total_bytes(&g_cfg));
+    if (err) {
+        return lfsjs_patch_result(err);
+    }
+    if (g_is_mounted) {
+        lfs_unmount(&g_lfs);
+        g_is_mounted = false;
+    }
+    err = imgpatch_apply(patch, lfsjs_patch_write, NULL);
+    int mount_err = lfsjs_mount_internal(false);
+    return err ? err : mount_err;
+}
+
+static int lfsjs_mark_used(void *ctx, lfs_block_t block) {
+    if (block < g_cfg.block_count) {
+        imgpatch_mark((uint8_t *)ctx, block);
+    }
+    return 0;
+}
+
+/*
+ * Image patch holding only the blocks lfs_fs_traverse reports in use
+ * (metadata pairs and file data). Other blocks are free; littlefs
+ * erases a block before reusing it, so a flasher may leave them untouched.
+ * Writes {patch pointer, length} to result_ptr; the caller frees the patch.
+ */
+EMSCRIPTEN_KEEPALIVE
+int lfsjs_export_sparse(uint32_t flags, uintptr_t result_ptr) {
+    int err = lfsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    if (!g_storage || !result_ptr || lfsjs_total_bytes(&g_cfg) > UINT32_MAX) {
+        return LFS_ERR_INVAL;
+    }
+    uint8_t *used = (uint8_t *)calloc((g_cfg.block_count + 7) / 8, 1);
+    if (!used) {
+        return LFS_ERR_NOMEM;
+    }
+    err = lfs_fs_traverse(&g_lfs, lfsjs_mark_used, used);
+    uint8_t *sparse = NULL;
+    uint32_t sparse_len = 0;
+    if (!err) {
+        err = lfsjs_patch_result(
+            imgpatch_sparse(g_storage, (uint32_t)lfsjs_total_bytes(&g_cfg),
+                            g_cfg.block_size, used, flags, &sparse,
+                            &sparse_len));
+    }
+    free(used);
+    if (err) {
+        return err;
+    }
+    lfsjs_hand_over(result_ptr, sparse, sparse_len);
+    return 0;
+}
+
+/*
+ * Digests over the live volume, written to out_ptr back to back (4 bytes per
+ * CRC32, 32 per SHA-256). Blocks and ranges are hashed in place in the RAM
+ * image; files stream through lfs_file_read, so they also work on a host
+ * device. Nothing is copied out to JS. hash_blocks with out_ptr 0 returns
+ * the block count.
+ */
+EMSCRIPTEN_KEEPALIVE
+int lfsjs_hash_blocks(uint32_t algorithm, uint32_t first, uint32_t count,
+                      uintptr_t out_ptr) {
+    if (!g_storage || first > g_cfg.block_count ||
+        count > g_cfg.block_count - first) {
+        return LFS_ERR_INVAL;
+    }
+    if (!out_ptr) {
+        return (int)g_cfg.block_count;
+    }
+    return blockhash_units(algorithm,
+                           g_storage + (size_t)first * g_cfg.block_size,
+                           g_cfg.block_size, count, (uint8_t *)out_ptr)
+               ? LFS_ERR_INVAL
+               : 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int lfsjs_hash_range(uint32_t algorithm, size_t offset, size_t length,
+                     uintptr_t out_ptr) {
+    size_t total = lfsjs_current_size();
+    if (!g_storage || offset > total || length > total - offset) {
+        return LFS_ERR_INVAL;
+    }
+    return blockhash_range(algorithm, g_storage + offset, length,
+                           (uint8_t *)out_ptr)
+               ? LFS_ERR_INVAL
+               : 0;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int lfsjs_hash_file(uint32_t algorithm, const char *path, uintptr_t out_ptr) {
+    int err = lfsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    blockhash_ctx ctx;
+    if (!path || !out_ptr || blockhash_init(&ctx, algorithm)) {
+        return LFS_ERR_INVAL;
+    }
+
+    lfs_file_t file;
+    err = lfs_file_open(&g_lfs, &file, path, LFS_O_RDONLY);
+    if (err < 0) {
+        return err;
+    }
+    uint8_t chunk[4096];
+    lfs_ssize_t read;
+    while ((read = lfs_file_read(&g_lfs, &file, chunk, sizeof(chunk))) > 0) {
+        blockhash_update(&ctx, chunk, (size_t)read);
+    }
+    lfs_file_close(&g_lfs, &file);
+    if (read < 0) {
+        return (int)read;
+    }
+    blockhash_final(&ctx, (uint8_t *)out_ptr);
+    return 0;
+}
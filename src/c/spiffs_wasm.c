@@ -6,15 +6,46 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "block_hash.h"
+#include "block_ops.h"
+#include "image_patch.h"
 #include "spiffs.h"
+#include "spiffs_nucleus.h"
 
 #define SPIFFSJS_PATH_MAX 512
 #define SPIFFSJS_MAX_READ_CHUNK 4096
 #define SPIFFSJS_DEFAULT_FD_COUNT 16
 #define SPIFFSJS_DEFAULT_CACHE_PAGES 64
+#define SPIFFSJS_NAME_INDEX_MIN_BUCKETS 256
+// Inline GC starts once three or fewer blocks are free, so a reservation
+// keeps this many blocks on top of the data being written.
+#define SPIFFSJS_GC_HEADROOM_BLOCKS 4
+// Files kept open with an index map for ranged reads. Each holds a file
+// descriptor, so fewer are kept when fd_count is small.
+#define SPIFFSJS_RANGE_READERS 4
 
 #define SPIFFSJS_MIN(a, b) ((a) < (b) ? (a) : (b))
 
+typedef struct spiffsjs_name_entry {
+    struct spiffsjs_name_entry *name_next;
+    struct spiffsjs_name_entry *id_next;
+    uint32_t hash;
+    spiffs_obj_id obj_id;
+    spiffs_page_ix pix;
+    char name[SPIFFS_OBJ_NAME_LEN + 1];
+} spiffsjs_name_entry;
+
+typedef struct {
+    char name[SPIFFS_OBJ_NAME_LEN];
+    spiffs_file file;
+    u32_t size;
+    u32_t last_used;
+#if SPIFFS_IX_MAP
+    spiffs_ix_map map;
+    spiffs_page_ix *map_buf;
+#endif
+} spiffsjs_range_reader;
+
 static spiffs g_fs;
 static spiffs_config g_cfg;
 static bool g_is_mounted = false;
@@ -31,6 +62,33 @@ static uint8_t *g_fd_space = NULL;
 static uint32_t g_fd_space_size = 0;
 static void *g_cache = NULL;
 static uint32_t g_cache_size = 0;
+static bool g_ram_direct = true;
+static spiffsjs_name_entry **g_name_buckets = NULL;
+static spiffsjs_name_entry **g_id_buckets = NULL;
+static uint32_t g_name_bucket_count = 0;
+static uint32_t g_name_count = 0;
+static bool g_name_index_ready = false;
+static spiffsjs_name_entry **g_sorted_names = NULL;
+static uint32_t g_sorted_count = 0;
+static uint32_t g_sorted_capacity = 0;
+static uint32_t g_fd_count = 0;
+static spiffsjs_range_reader g_range_readers[SPIFFSJS_RANGE_READERS];
+static uint32_t g_range_reader_count = 0;
+static u32_t g_range_clock = 0;
+static u32_t g_check_counts[SPIFFS_CHECK_DELETE_BAD_FILE + 1];
+static bool g_io_stats_enabled = false;
+static uint64_t *g_io_stats = NULL;
+static uint32_t g_io_stats_blocks = 0;
+
+typedef struct spiffsjs_snapshot {
+    struct spiffsjs_snapshot *older;
+    uint32_t id;
+    uint32_t saved;
+    uint8_t **blocks;
+} spiffsjs_snapshot_t;
+
+static spiffsjs_snapshot_t *g_snapshots = NULL;
+static uint32_t g_next_snapshot_id = 1;
 
 static size_t spiffsjs_total_bytes(void) {
     return g_total_bytes;
@@ -40,11 +98,153 @@ static s32_t spiffsjs_result(s32_t err) {
     return err == SPIFFS_OK ? 0 : err;
 }
 
+// I/O counters per erase block. While enabled, g_io_stats holds three totals
+// (erases, programmed bytes, read bytes) followed by one array per counter.
+// Disabled, the HAL pays a single NULL check per call. With ramDirect, reads
+// are served from the volume in place and never reach spiffsjs_hal_read.
+enum { SPIFFSJS_IO_ERASES, SPIFFSJS_IO_PROG, SPIFFSJS_IO_READ, SPIFFSJS_IO_KINDS };
+
+static void spiffsjs_io_stats_free(void) {
+    free(g_io_stats);
+    g_io_stats = NULL;
+    g_io_stats_blocks = 0;
+}
+
+static int spiffsjs_io_stats_alloc(uint32_t block_count) {
+    spiffsjs_io_stats_free();
+    if (!g_io_stats_enabled || block_count == 0) {
+        return 0;
+    }
+    g_io_stats = (uint64_t *)calloc(
+        SPIFFSJS_IO_KINDS * ((size_t)block_count + 1), sizeof(uint64_t));
+    if (!g_io_stats) {
+        return SPIFFS_ERR_INTERNAL;
+    }
+    g_io_stats_blocks = block_count;
+    return 0;
+}
+
+static void spiffsjs_io_count(int kind, u32_t addr, u32_t size) {
+    uint64_t *per_block = g_io_stats + SPIFFSJS_IO_KINDS +
+                          (size_t)kind * g_io_stats_blocks;
+    g_io_stats[kind] += kind == SPIFFSJS_IO_ERASES ? 1 : size;
+    while (size > 0) {
+        u32_t block = addr / g_block_size;
+        u32_t span = g_block_size - addr % g_block_size;
+        if (span > size) {
+            span = size;
+        }
+        if (block < g_io_stats_blocks) {
+            per_block[block] += kind == SPIFFSJS_IO_ERASES ? 1 : span;
+        }
+        addr += span;
+        size -= span;
+    }
+}
+
+// Copy-on-write snapshots per erase block. The live image stays one buffer
+// (ramDirect keeps reading it in place) and a snapshot keeps the pre-image of
+// each erase block written or erased after it was taken, so memory grows only
+// with the blocks that change. Only the newest snapshot records pre-images; an
+// older snapshot's view of a block is the copy held by the oldest snapshot at
+// or after it.
+static void spiffsjs_snapshot_free(spiffsjs_snapshot_t *snap) {
+    for (uint32_t i = 0; snap->saved && i < g_block_count; i++) {
+        if (snap->blocks[i]) {
+            free(snap->blocks[i]);
+            snap->saved--;
+        }
+    }
+    free(snap->blocks);
+    free(snap);
+}
+
+static void spiffsjs_snapshots_free(void) {
+    while (g_snapshots) {
+        spiffsjs_snapshot_t *older = g_snapshots->older;
+        spiffsjs_snapshot_free(g_snapshots);
+        g_snapshots = older;
+    }
+}
+
+static s32_t spiffsjs_snapshot_preserve(u32_t addr, u32_t size) {
+    spiffsjs_snapshot_t *snap = g_snapshots;
+    if (!snap || size == 0) {
+        return SPIFFS_OK;
+    }
+    for (u32_t block = addr / g_block_size; block <= (addr + size - 1) / g_block_size;
+         block++) {
+        if (snap->blocks[block]) {
+            continue;
+        }
+        uint8_t *copy = (uint8_t *)malloc(g_block_size);
+        if (!copy) {
+            return SPIFFS_ERR_INTERNAL;
+        }
+        memcpy(copy, g_storage + (size_t)block * g_block_size, g_block_size);
+        snap->blocks[block] = copy;
+        snap->saved++;
+    }
+    return SPIFFS_OK;
+}
+
+static spiffsjs_snapshot_t *spiffsjs_snapshot_push(void) {
+    spiffsjs_snapshot_t *snap = (spiffsjs_snapshot_t *)calloc(1, sizeof(*snap));
+    if (!snap) {
+        return NULL;
+    }
+    snap->blocks = (uint8_t **)calloc(g_block_count, sizeof(uint8_t *));
+    if (!snap->blocks) {
+        free(snap);
+        return NULL;
+    }
+    snap->id = g_next_snapshot_id++;
+    snap->older = g_snapshots;
+    g_snapshots = snap;
+    return snap;
+}
+
+// Copies the pre-images back, newest first so the oldest copy of each block
+// at or after target wins, and drops the snapshots taken after target. The
+// caller unmounts before and remounts after.
+static void spiffsjs_snapshot_rollback(spiffsjs_snapshot_t *target) {
+    for (spiffsjs_snapshot_t *snap = g_snapshots;; snap = snap->older) {
+        for (uint32_t i = 0; snap->saved && i < g_block_count; i++) {
+            if (snap->blocks[i]) {
+                memcpy(g_storage + (size_t)i * g_block_size, snap->blocks[i],
+                       g_block_size);
+                free(snap->blocks[i]);
+                snap->blocks[i] = NULL;
+                snap->saved--;
+            }
+        }
+        if (snap == target) {
+            break;
+        }
+    }
+    while (g_snapshots != target) {
+        spiffsjs_snapshot_t *older = g_snapshots->older;
+        spiffsjs_snapshot_free(g_snapshots);
+        g_snapshots = older;
+    }
+}
+
+static spiffsjs_snapshot_t **spiffsjs_snapshot_find(uint32_t id) {
+    spiffsjs_snapshot_t **cursor = &g_snapshots;
+    while (*cursor && (*cursor)->id != id) {
+        cursor = &(*cursor)->older;
+    }
+    return *cursor ? cursor : NULL;
+}
+
 static s32_t spiffsjs_hal_read(u32_t addr, u32_t size, u8_t *dst) {
     if (!g_storage || addr + size > g_total_bytes) {
         return SPIFFS_ERR_INTERNAL;
     }
     memcpy(dst, g_storage + addr, size);
+    if (g_io_stats) {
+        spiffsjs_io_count(SPIFFSJS_IO_READ, addr, size);
+    }
     return SPIFFS_OK;
 }
 
@@ -52,7 +252,13 @@ static s32_t spiffsjs_hal_write(u32_t addr, u32_t size, u8_t *src) {
     if (!g_storage || addr + size > g_total_bytes) {
         return SPIFFS_ERR_INTERNAL;
     }
+    if (spiffsjs_snapshot_preserve(addr, size) != SPIFFS_OK) {
+        return SPIFFS_ERR_INTERNAL;
+    }
     memcpy(g_storage + addr, src, size);
+    if (g_io_stats) {
+        spiffsjs_io_count(SPIFFSJS_IO_PROG, addr, size);
+    }
     return SPIFFS_OK;
 }
 
@@ -60,11 +266,309 @@ static s32_t spiffsjs_hal_erase(u32_t addr, u32_t size) {
     if (!g_storage || addr + size > g_total_bytes) {
         return SPIFFS_ERR_INTERNAL;
     }
-    memset(g_storage + addr, 0xFF, size);
+    if (spiffsjs_snapshot_preserve(addr, size) != SPIFFS_OK) {
+        return SPIFFS_ERR_INTERNAL;
+    }
+    blockops_fill_erased(g_storage + addr, size);
+    if (g_io_stats) {
+        spiffsjs_io_count(SPIFFSJS_IO_ERASES, addr, size);
+    }
     return SPIFFS_OK;
 }
 
+static uint32_t spiffsjs_hash_name(const u8_t *name) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < SPIFFS_OBJ_NAME_LEN && name[i]; i++) {
+        hash = (hash ^ name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void spiffsjs_name_index_clear(void) {
+    for (uint32_t i = 0; i < g_name_bucket_count; i++) {
+        spiffsjs_name_entry *entry = g_id_buckets[i];
+        while (entry) {
+            spiffsjs_name_entry *next = entry->id_next;
+            free(entry);
+            entry = next;
+        }
+    }
+    free(g_name_buckets);
+    free(g_id_buckets);
+    free(g_sorted_names);
+    g_name_buckets = NULL;
+    g_id_buckets = NULL;
+    g_sorted_names = NULL;
+    g_name_bucket_count = 0;
+    g_name_count = 0;
+    g_sorted_count = 0;
+    g_sorted_capacity = 0;
+    g_name_index_ready = false;
+}
+
+// The index also keeps its entries sorted by name, so that listing a prefix
+// is a binary search plus a walk over the matches.
+static uint32_t spiffsjs_sorted_lower_bound(const char *name) {
+    uint32_t lo = 0;
+    uint32_t hi = g_sorted_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (strcmp(g_sorted_names[mid]->name, name) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void spiffsjs_sorted_remove(const spiffsjs_name_entry *entry) {
+    for (uint32_t i = spiffsjs_sorted_lower_bound(entry->name);
+         i < g_sorted_count; i++) {
+        if (g_sorted_names[i] == entry) {
+            memmove(&g_sorted_names[i], &g_sorted_names[i + 1],
+                    (g_sorted_count - i - 1) * sizeof(*g_sorted_names));
+            g_sorted_count--;
+            return;
+        }
+        if (strcmp(g_sorted_names[i]->name, entry->name) != 0) {
+            return;
+        }
+    }
+}
+
+// While the index is being built entries are only appended; the build sorts
+// them once at the end.
+static bool spiffsjs_sorted_insert(spiffsjs_name_entry *entry) {
+    if (g_sorted_count == g_sorted_capacity) {
+        uint32_t capacity = g_sorted_capacity ? g_sorted_capacity * 2
+                                              : SPIFFSJS_NAME_INDEX_MIN_BUCKETS;
+        spiffsjs_name_entry **grown = (spiffsjs_name_entry **)realloc(
+            g_sorted_names, capacity * sizeof(*grown));
+        if (!grown) {
+            return false;
+        }
+        g_sorted_names = grown;
+        g_sorted_capacity = capacity;
+    }
+    uint32_t at = g_name_index_ready ? spiffsjs_sorted_lower_bound(entry->name)
+                                     : g_sorted_count;
+    memmove(&g_sorted_names[at + 1], &g_sorted_names[at],
+            (g_sorted_count - at) * sizeof(*g_sorted_names));
+    g_sorted_names[at] = entry;
+    g_sorted_count++;
+    return true;
+}
+
+static int spiffsjs_compare_entries(const void *a, const void *b) {
+    const spiffsjs_name_entry *left = *(const spiffsjs_name_entry *const *)a;
+    const spiffsjs_name_entry *right = *(const spiffsjs_name_entry *const *)b;
+    return strcmp(left->name, right->name);
+}
+
+static void spiffsjs_name_entry_link(spiffsjs_name_entry *entry) {
+    uint32_t mask = g_name_bucket_count - 1;
+    entry->name_next = g_name_buckets[entry->hash & mask];
+    g_name_buckets[entry->hash & mask] = entry;
+    entry->id_next = g_id_buckets[entry->obj_id & mask];
+    g_id_buckets[entry->obj_id & mask] = entry;
+}
+
+static void spiffsjs_name_entry_unlink_name(spiffsjs_name_entry *entry) {
+    spiffsjs_name_entry **cursor =
+        &g_name_buckets[entry->hash & (g_name_bucket_count - 1)];
+    while (*cursor && *cursor != entry) {
+        cursor = &(*cursor)->name_next;
+    }
+    if (*cursor) {
+        *cursor = entry->name_next;
+    }
+}
+
+static void spiffsjs_name_entry_free(spiffsjs_name_entry *entry) {
+    spiffsjs_sorted_remove(entry);
+    spiffsjs_name_entry_unlink_name(entry);
+    spiffsjs_name_entry **cursor =
+        &g_id_buckets[entry->obj_id & (g_name_bucket_count - 1)];
+    while (*cursor && *cursor != entry) {
+        cursor = &(*cursor)->id_next;
+    }
+    if (*cursor) {
+        *cursor = entry->id_next;
+    }
+    g_name_count--;
+    free(entry);
+}
+
+static bool spiffsjs_name_index_grow(void) {
+    uint32_t buckets = g_name_bucket_count ? g_name_bucket_count * 2
+                                           : SPIFFSJS_NAME_INDEX_MIN_BUCKETS;
+    spiffsjs_name_entry **names =
+        (spiffsjs_name_entry **)calloc(buckets, sizeof(*names));
+    spiffsjs_name_entry **ids =
+        (spiffsjs_name_entry **)calloc(buckets, sizeof(*ids));
+    if (!names || !ids) {
+        free(names);
+        free(ids);
+        return false;
+    }
+
+    spiffsjs_name_entry **old_ids = g_id_buckets;
+    uint32_t old_buckets = g_name_bucket_count;
+    free(g_name_buckets);
+    g_name_buckets = names;
+    g_id_buckets = ids;
+    g_name_bucket_count = buckets;
+
+    for (uint32_t i = 0; i < old_buckets; i++) {
+        spiffsjs_name_entry *entry = old_ids[i];
+        while (entry) {
+            spiffsjs_name_entry *next = entry->id_next;
+            spiffsjs_name_entry_link(entry);
+            entry = next;
+        }
+    }
+    free(old_ids);
+    return true;
+}
+
+static spiffsjs_name_entry *spiffsjs_name_entry_by_id(spiffs_obj_id obj_id) {
+    if (!g_name_bucket_count) {
+        return NULL;
+    }
+    for (spiffsjs_name_entry *entry =
+             g_id_buckets[obj_id & (g_name_bucket_count - 1)];
+         entry; entry = entry->id_next) {
+        if (entry->obj_id == obj_id) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static bool spiffsjs_name_index_set(spiffs_obj_id obj_id, spiffs_page_ix pix,
+                                    const u8_t *name) {
+    spiffsjs_name_entry *entry = spiffsjs_name_entry_by_id(obj_id);
+    if (entry) {
+        entry->pix = pix;
+        if (strncmp(entry->name, (const char *)name, SPIFFS_OBJ_NAME_LEN) == 0) {
+            return true;
+        }
+        spiffsjs_name_entry_unlink_name(entry);
+        spiffsjs_sorted_remove(entry);
+    } else {
+        if (g_name_count >= g_name_bucket_count && !spiffsjs_name_index_grow()) {
+            return false;
+        }
+        entry = (spiffsjs_name_entry *)malloc(sizeof(*entry));
+        if (!entry) {
+            return false;
+        }
+        entry->obj_id = obj_id;
+        entry->pix = pix;
+        entry->id_next = g_id_buckets[obj_id & (g_name_bucket_count - 1)];
+        g_id_buckets[obj_id & (g_name_bucket_count - 1)] = entry;
+        g_name_count++;
+    }
+    memcpy(entry->name, name, SPIFFS_OBJ_NAME_LEN);
+    entry->name[SPIFFS_OBJ_NAME_LEN] = '\0';
+    entry->hash = spiffsjs_hash_name(name);
+    uint32_t slot = entry->hash & (g_name_bucket_count - 1);
+    entry->name_next = g_name_buckets[slot];
+    g_name_buckets[slot] = entry;
+    return spiffsjs_sorted_insert(entry);
+}
+
+static void spiffsjs_name_index_build(void) {
+    spiffsjs_name_index_clear();
+    spiffs_DIR dir;
+    if (!SPIFFS_opendir(&g_fs, "/", &dir)) {
+        return;
+    }
+    struct spiffs_dirent entry;
+    bool ok = true;
+    while (ok && SPIFFS_readdir(&dir, &entry)) {
+        ok = spiffsjs_name_index_set(entry.obj_id, entry.pix, entry.name);
+    }
+    SPIFFS_closedir(&dir);
+    if (ok) {
+        if (g_sorted_count > 1) {
+            qsort(g_sorted_names, g_sorted_count, sizeof(*g_sorted_names),
+                  spiffsjs_compare_entries);
+        }
+        g_name_index_ready = true;
+    } else {
+        spiffsjs_name_index_clear();
+    }
+}
+
+s32_t spiffs_name_index_find(spiffs *fs, const u8_t *name, spiffs_page_ix *pix) {
+    (void)fs;
+    if (!g_name_index_ready) {
+        return SPIFFS_NAME_INDEX_UNKNOWN;
+    }
+    if (!g_name_bucket_count) {
+        return SPIFFS_ERR_NOT_FOUND;
+    }
+    uint32_t hash = spiffsjs_hash_name(name);
+    for (const spiffsjs_name_entry *entry =
+             g_name_buckets[hash & (g_name_bucket_count - 1)];
+         entry; entry = entry->name_next) {
+        if (entry->hash == hash &&
+            strncmp(entry->name, (const char *)name, SPIFFS_OBJ_NAME_LEN) == 0) {
+            *pix = entry->pix;
+            return SPIFFS_OK;
+        }
+    }
+    return SPIFFS_ERR_NOT_FOUND;
+}
+
+void spiffs_name_index_update(spiffs *fs, spiffs_obj_id obj_id,
+                              spiffs_page_ix pix, const u8_t *name) {
+    (void)fs;
+    if (!g_name_index_ready) {
+        return;
+    }
+    if (!name) {
+        // only forget the object if this was its live header and not a stale
+        // copy being scrapped by the garbage collector
+        spiffsjs_name_entry *entry = spiffsjs_name_entry_by_id(obj_id);
+        if (entry && entry->pix == pix) {
+            spiffsjs_name_entry_free(entry);
+        }
+        return;
+    }
+    if (!spiffsjs_name_index_set(obj_id, pix, name)) {
+        spiffsjs_name_index_clear();
+    }
+}
+
+static void spiffsjs_range_reader_close(spiffsjs_range_reader *reader) {
+    if (g_is_mounted) {
+        SPIFFS_close(&g_fs, reader->file);
+    }
+#if SPIFFS_IX_MAP
+    free(reader->map_buf);
+#endif
+    memset(reader, 0, sizeof(*reader));
+}
+
+// Closes cached range readers for path, or all of them when path is NULL.
+// Called before anything that rewrites, removes or remounts files. Readers
+// stay in their slot while open: SPIFFS holds a pointer to their map.
+static void spiffsjs_range_readers_drop(const char *path) {
+    for (uint32_t i = 0; i < SPIFFSJS_RANGE_READERS; i++) {
+        spiffsjs_range_reader *reader = &g_range_readers[i];
+        if (reader->name[0] && (!path || strcmp(reader->name, path) == 0)) {
+            spiffsjs_range_reader_close(reader);
+            g_range_reader_count--;
+        }
+    }
+}
+
 static void spiffsjs_release(void) {
+    spiffsjs_range_readers_drop(NULL);
+    spiffsjs_snapshots_free();
     if (g_is_mounted) {
         SPIFFS_unmount(&g_fs);
         g_is_mounted = false;
@@ -77,6 +581,7 @@ static void spiffsjs_release(void) {
     g_cache = NULL;
     free(g_storage);
     g_storage = NULL;
+    spiffsjs_name_index_clear();
     g_total_bytes = 0;
     g_total_bytes32 = 0;
     g_page_size = 0;
@@ -85,6 +590,7 @@ static void spiffsjs_release(void) {
     g_disk_ready = false;
     g_work_size = 0;
     g_fd_space_size = 0;
+    g_fd_count = 0;
     g_cache_size = 0;
     memset(&g_fs, 0, sizeof(g_fs));
     memset(&g_cfg, 0, sizeof(g_cfg));
@@ -113,7 +619,7 @@ static int spiffsjs_configure(uint32_t page_size, uint32_t block_size,
     if (!g_storage) {
         return SPIFFS_ERR_INTERNAL;
     }
-    memset(g_storage, 0xFF, (size_t)total);
+    blockops_fill_erased(g_storage, (size_t)total);
 
     g_total_bytes = (size_t)total;
     g_total_bytes32 = (uint32_t)total;
@@ -134,6 +640,9 @@ static int spiffsjs_configure(uint32_t page_size, uint32_t block_size,
 #if SPIFFS_FILEHDL_OFFSET
     g_cfg.fh_ix_offset = 0;
 #endif
+#if SPIFFS_RAM_DIRECT
+    g_cfg.phys_mem = g_ram_direct ? g_storage : NULL;
+#endif
 
     memset(&g_fs, 0, sizeof(g_fs));
     memcpy(&g_fs.cfg, &g_cfg, sizeof(g_cfg));
@@ -145,6 +654,7 @@ static int spiffsjs_configure(uint32_t page_size, uint32_t block_size,
         return SPIFFS_ERR_INTERNAL;
     }
 
+    g_fd_count = fd_count;
     g_fd_space_size = SPIFFS_buffer_bytes_for_filedescs(&g_fs, fd_count);
     if (g_fd_space_size == 0) {
         spiffsjs_release();
@@ -173,24 +683,39 @@ static int spiffsjs_configure(uint32_t page_size, uint32_t block_size,
 #endif
 
     g_disk_ready = true;
-    return 0;
+    return spiffsjs_io_stats_alloc(block_count);
+}
+
+// Counts what SPIFFS_check reports, indexed by spiffs_check_report.
+static void spiffsjs_check_cb(spiffs_check_type type, spiffs_check_report report,
+                              u32_t arg1, u32_t arg2) {
+    (void)type;
+    (void)arg1;
+    (void)arg2;
+    if (report != SPIFFS_CHECK_PROGRESS && report <= SPIFFS_CHECK_DELETE_BAD_FILE) {
+        g_check_counts[report]++;
+    }
 }
 
 static int spiffsjs_mount(bool allow_format) {
     if (!g_disk_ready) {
         return SPIFFS_ERR_NOT_CONFIGURED;
     }
+    spiffsjs_name_index_clear();
     s32_t res = SPIFFS_mount(&g_fs, &g_cfg, g_work, g_fd_space, g_fd_space_size,
-                             g_cache, g_cache_size, NULL);
+                             g_cache, g_cache_size, spiffsjs_check_cb);
     if (res != SPIFFS_OK && allow_format) {
         SPIFFS_unmount(&g_fs);
         res = SPIFFS_format(&g_fs);
         if (res == SPIFFS_OK) {
             res = SPIFFS_mount(&g_fs, &g_cfg, g_work, g_fd_space, g_fd_space_size,
-                               g_cache, g_cache_size, NULL);
+                               g_cache, g_cache_size, spiffsjs_check_cb);
         }
     }
     g_is_mounted = (res == SPIFFS_OK);
+    if (g_is_mounted) {
+        spiffsjs_name_index_build();
+    }
     return spiffsjs_result(res);
 }
 
@@ -201,21 +726,18 @@ static int spiffsjs_ensure_mounted(void) {
     return 0;
 }
 
-static int spiffsjs_emit_entry(const struct spiffs_dirent *entry, char **cursor,
-                              const char *end) {
-    const char *type = entry->type == SPIFFS_TYPE_DIR ? "dir" : "file";
-    int needed =
-        snprintf(NULL, 0, "%s\t%s\t%lu\n", entry->name, type,
-                 (unsigned long)entry->size);
+static int spiffsjs_emit(const char *name, const char *type, uint32_t size,
+                         char **cursor, const char *end) {
+    int needed = snprintf(NULL, 0, "%s\t%s\t%lu\n", name, type,
+                          (unsigned long)size);
     if (needed < 0) {
         return SPIFFS_ERR_INTERNAL;
     }
     if (*cursor + needed + 1 > end) {
-        return SPIFFS_ERR_INTERNAL;
+        return SPIFFS_ERR_FULL;
     }
-    int written =
-        snprintf(*cursor, (size_t)(end - *cursor), "%s\t%s\t%lu\n", entry->name,
-                 type, (unsigned long)entry->size);
+    int written = snprintf(*cursor, (size_t)(end - *cursor), "%s\t%s\t%lu\n",
+                           name, type, (unsigned long)size);
     if (written != needed) {
         return SPIFFS_ERR_INTERNAL;
     }
@@ -223,6 +745,13 @@ static int spiffsjs_emit_entry(const struct spiffs_dirent *entry, char **cursor,
     return 0;
 }
 
+static int spiffsjs_emit_entry(const struct spiffs_dirent *entry, char **cursor,
+                              const char *end) {
+    const char *type = entry->type == SPIFFS_TYPE_DIR ? "dir" : "file";
+    return spiffsjs_emit((const char *)entry->name, type, entry->size, cursor,
+                         end);
+}
+
 static int spiffsjs_list_inner(uint32_t buffer_ptr, uint32_t buffer_len) {
     if (!g_is_mounted) {
         return SPIFFS_ERR_NOT_MOUNTED;
@@ -260,6 +789,127 @@ static int spiffsjs_list_inner(uint32_t buffer_ptr, uint32_t buffer_len) {
     return (int)(cursor - (char *)(uintptr_t)buffer_ptr);
 }
 
+// Prefix listing; SPIFFS_ERR_FULL means the buffer was too small. SPIFFS has
+// no directories, so with SPIFFSJS_LIST_DIRS every "/"-separated segment below
+// the prefix is reported once as a "dir" entry, just before the first file
+// inside it. That relies on the names arriving in sorted order, where
+// everything under a directory is contiguous.
+#define SPIFFSJS_LIST_DIRS 1u
+
+typedef struct {
+    const char *prefix;
+    size_t prefix_len;
+    bool dirs;
+    char prev[SPIFFS_OBJ_NAME_LEN + 1];
+    char *cursor;
+    const char *end;
+} spiffsjs_prefix_list;
+
+static int spiffsjs_prefix_list_emit(spiffsjs_prefix_list *list,
+                                     const char *name, const char *type,
+                                     uint32_t size) {
+    if (list->dirs) {
+        char dir[SPIFFS_OBJ_NAME_LEN + 1];
+        for (size_t i = list->prefix_len; name[i]; i++) {
+            if (name[i] != '/' || i == 0 ||
+                strncmp(list->prev, name, i + 1) == 0) {
+                continue;
+            }
+            memcpy(dir, name, i);
+            dir[i] = '\0';
+            int err = spiffsjs_emit(dir, "dir", 0, &list->cursor, list->end);
+            if (err) {
+                return err;
+            }
+        }
+        strncpy(list->prev, name, SPIFFS_OBJ_NAME_LEN);
+        list->prev[SPIFFS_OBJ_NAME_LEN] = '\0';
+    }
+    return spiffsjs_emit(name, type, size, &list->cursor, list->end);
+}
+
+static int spiffsjs_prefix_list_indexed(spiffsjs_prefix_list *list) {
+    for (uint32_t i = spiffsjs_sorted_lower_bound(list->prefix);
+         i < g_sorted_count; i++) {
+        const spiffsjs_name_entry *entry = g_sorted_names[i];
+        if (strncmp(entry->name, list->prefix, list->prefix_len) != 0) {
+            break;
+        }
+        spiffs_page_object_ix_header header;
+        s32_t res = _spiffs_rd(&g_fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ, 0,
+                               SPIFFS_PAGE_TO_PADDR(&g_fs, entry->pix),
+                               sizeof(header), (u8_t *)&header);
+        if (res != SPIFFS_OK) {
+            return res;
+        }
+        uint32_t size = header.size == SPIFFS_UNDEFINED_LEN ? 0 : header.size;
+        int err = spiffsjs_prefix_list_emit(
+            list, entry->name, header.type == SPIFFS_TYPE_DIR ? "dir" : "file",
+            size);
+        if (err) {
+            return err;
+        }
+    }
+    return 0;
+}
+
+static int spiffsjs_compare_dirents(const void *a, const void *b) {
+    return strcmp((const char *)((const struct spiffs_dirent *)a)->name,
+                  (const char *)((const struct spiffs_dirent *)b)->name);
+}
+
+// Used only when the name index could not be allocated: scan, filter, sort.
+static int spiffsjs_prefix_list_scan(spiffsjs_prefix_list *list) {
+    spiffs_DIR dir;
+    if (!SPIFFS_opendir(&g_fs, "/", &dir)) {
+        return SPIFFS_ERR_NOT_MOUNTED;
+    }
+    struct spiffs_dirent *matches = NULL;
+    uint32_t count = 0;
+    uint32_t capacity = 0;
+    int err = 0;
+    struct spiffs_dirent entry;
+    while (SPIFFS_readdir(&dir, &entry)) {
+        if (strncmp((const char *)entry.name, list->prefix, list->prefix_len) !=
+            0) {
+            continue;
+        }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            struct spiffs_dirent *grown = (struct spiffs_dirent *)realloc(
+                matches, capacity * sizeof(*grown));
+            if (!grown) {
+                err = SPIFFS_ERR_INTERNAL;
+                break;
+            }
+            matches = grown;
+        }
+        matches[count++] = entry;
+    }
+    SPIFFS_closedir(&dir);
+    if (!err) {
+        qsort(matches, count, sizeof(*matches), spiffsjs_compare_dirents);
+        for (uint32_t i = 0; i < count && !err; i++) {
+            err = spiffsjs_prefix_list_emit(
+                list, (const char *)matches[i].name,
+                matches[i].type == SPIFFS_TYPE_DIR ? "dir" : "file",
+                matches[i].size);
+        }
+    }
+    free(matches);
+    return err;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_set_ram_direct(uint32_t enabled) {
+#if SPIFFS_RAM_DIRECT
+    g_ram_direct = enabled != 0;
+    return 0;
+#else
+    return enabled ? SPIFFS_ERR_NOT_CONFIGURED : 0;
+#endif
+}
+
 EMSCRIPTEN_KEEPALIVE
 int spiffsjs_init(uint32_t page_size, uint32_t block_size, uint32_t block_count,
                   uint32_t fd_count, uint32_t cache_pages) {
@@ -275,13 +925,33 @@ int spiffsjs_init(uint32_t page_size, uint32_t block_size, uint32_t block_count,
     return err;
 }
 
+// Allocates storage for an image the host writes in place through
+// spiffsjs_storage_ptr; spiffsjs_import_end then mounts it. Streaming imports
+// use this so the raw image never exists twice.
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_import_begin(uint32_t page_size, uint32_t block_size,
+                          uint32_t block_count, uint32_t fd_count,
+                          uint32_t cache_pages) {
+    return spiffsjs_configure(page_size, block_size, block_count, fd_count,
+                              cache_pages);
+}
+
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_import_end(void) {
+    int err = spiffsjs_mount(false);
+    if (err) {
+        spiffsjs_release();
+    }
+    return err;
+}
+
 EMSCRIPTEN_KEEPALIVE
 int spiffsjs_init_from_image(uint32_t page_size, uint32_t block_size,
                              uint32_t block_count, uint32_t fd_count,
                              uint32_t cache_pages, const uint8_t *image,
                              uint32_t image_len) {
-    int err = spiffsjs_configure(page_size, block_size, block_count, fd_count,
-                                cache_pages);
+    int err = spiffsjs_import_begin(page_size, block_size, block_count,
+                                    fd_count, cache_pages);
     if (err) {
         return err;
     }
@@ -290,12 +960,7 @@ int spiffsjs_init_from_image(uint32_t page_size, uint32_t block_size,
         return SPIFFS_ERR_NOT_CONFIGURED;
     }
     memcpy(g_storage, image, g_total_bytes);
-
-    err = spiffsjs_mount(false);
-    if (err) {
-        spiffsjs_release();
-    }
-    return err;
+    return spiffsjs_import_end();
 }
 
 EMSCRIPTEN_KEEPALIVE
@@ -304,6 +969,7 @@ int spiffsjs_format(void) {
     if (err) {
         return err;
     }
+    spiffsjs_range_readers_drop(NULL);
     SPIFFS_unmount(&g_fs);
     err = SPIFFS_format(&g_fs);
     if (err != SPIFFS_OK) {
@@ -336,36 +1002,26 @@ int spiffsjs_file_size(const char *path) {
     return (int)info.size;
 }
 
-EMSCRIPTEN_KEEPALIVE
-int spiffsjs_read_file(const char *path, uint32_t buffer_ptr,
-                       uint32_t buffer_len) {
-    int err = spiffsjs_ensure_mounted();
-    if (err) {
-        return err;
-    }
-    if (!path || buffer_ptr == 0 || buffer_len == 0) {
-        return SPIFFS_ERR_NOT_CONFIGURED;
+static int spiffsjs_open_for_read(const char *path, spiffs_file *file,
+                                  u32_t *size) {
+    *file = SPIFFS_open(&g_fs, path, SPIFFS_RDONLY, 0);
+    if (*file < 0) {
+        return *file;
     }
-
     spiffs_stat info;
-    s32_t res = SPIFFS_stat(&g_fs, path, &info);
+    s32_t res = SPIFFS_fstat(&g_fs, *file, &info);
+    if (res == SPIFFS_OK && info.type == SPIFFS_TYPE_DIR) {
+        res = SPIFFS_ERR_NOT_A_FILE;
+    }
     if (res != SPIFFS_OK) {
+        SPIFFS_close(&g_fs, *file);
         return res;
     }
-    if (info.type == SPIFFS_TYPE_DIR) {
-        return SPIFFS_ERR_NOT_A_FILE;
-    }
-    u32_t size = info.size;
-    if (size > buffer_len) {
-        return SPIFFS_ERR_INTERNAL;
-    }
-
-    spiffs_file file = SPIFFS_open(&g_fs, path, SPIFFS_RDONLY, 0);
-    if (file < 0) {
-        return file;
-    }
+    *size = info.size;
+    return 0;
+}
 
-    uint8_t *dest = (uint8_t *)(uintptr_t)buffer_ptr;
+static int spiffsjs_read_and_close(spiffs_file file, uint8_t *dest, u32_t size) {
     u32_t remaining = size;
     while (remaining > 0) {
         s32_t chunk =
@@ -386,37 +1042,299 @@ int spiffsjs_read_file(const char *path, uint32_t buffer_ptr,
 }
 
 EMSCRIPTEN_KEEPALIVE
-int spiffsjs_write_file(const char *path, const uint8_t *data,
-                        uint32_t length) {
+int spiffsjs_read_file(const char *path, uint32_t buffer_ptr,
+                       uint32_t buffer_len) {
     int err = spiffsjs_ensure_mounted();
     if (err) {
         return err;
     }
-    if (!path || (length > 0 && !data)) {
+    if (!path || buffer_ptr == 0 || buffer_len == 0) {
         return SPIFFS_ERR_NOT_CONFIGURED;
     }
 
-    spiffs_file file =
-        SPIFFS_open(&g_fs, path, SPIFFS_CREAT | SPIFFS_TRUNC | SPIFFS_RDWR, 0);
-    if (file < 0) {
-        return file;
+    spiffs_file file;
+    u32_t size = 0;
+    err = spiffsjs_open_for_read(path, &file, &size);
+    if (err) {
+        return err;
+    }
+    if (size > buffer_len) {
+        SPIFFS_close(&g_fs, file);
+        return SPIFFS_ERR_INTERNAL;
     }
+    return spiffsjs_read_and_close(file, (uint8_t *)(uintptr_t)buffer_ptr, size);
+}
 
-    uint32_t written = 0;
-    while (written < length) {
-        uint32_t chunk =
-            SPIFFSJS_MIN((uint32_t)SPIFFSJS_MAX_READ_CHUNK, length - written);
-        s32_t res = SPIFFS_write(&g_fs, file, (void *)(uintptr_t)(data + written),
-                                 (s32_t)chunk);
-        if (res < 0) {
-            SPIFFS_close(&g_fs, file);
-            return res;
+// Reads a whole file with a single name lookup. On success result_ptr holds
+// {data pointer, size}; the caller frees the data pointer.
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_read_file_alloc(const char *path, uint32_t result_ptr) {
+    int err = spiffsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    if (!path || !result_ptr) {
+        return SPIFFS_ERR_NOT_CONFIGURED;
+    }
+
+    spiffs_file file;
+    u32_t size = 0;
+    err = spiffsjs_open_for_read(path, &file, &size);
+    if (err) {
+        return err;
+    }
+    uint8_t *data = (uint8_t *)malloc(size ? size : 1);
+    if (!data) {
+        SPIFFS_close(&g_fs, file);
+        return SPIFFS_ERR_INTERNAL;
+    }
+    int read = spiffsjs_read_and_close(file, data, size);
+    if (read < 0) {
+        free(data);
+        return read;
+    }
+    uint32_t *dest = (uint32_t *)(uintptr_t)result_ptr;
+    dest[0] = (uint32_t)(uintptr_t)data;
+    dest[1] = (uint32_t)read;
+    return 0;
+}
+
+static uint32_t spiffsjs_range_reader_limit(void) {
+    // leave descriptors for the reads and writes that open files themselves
+    if (g_fd_count <= 2) {
+        return 0;
+    }
+    return SPIFFSJS_MIN(g_fd_count - 2, (uint32_t)SPIFFSJS_RANGE_READERS);
+}
+
+// Opens path and maps its whole object index, so that seeks look data pages
+// up in RAM instead of reading index pages. SPIFFS keeps the map current
+// when GC moves pages of the open file.
+static int spiffsjs_range_reader_open(const char *path,
+                                      spiffsjs_range_reader *reader) {
+    memset(reader, 0, sizeof(*reader));
+    if (strlen(path) >= sizeof(reader->name)) {
+        return SPIFFS_ERR_NAME_TOO_LONG;
+    }
+    int err = spiffsjs_open_for_read(path, &reader->file, &reader->size);
+    if (err) {
+        return err;
+    }
+    strcpy(reader->name, path);
+#if SPIFFS_IX_MAP
+    s32_t entries = SPIFFS_bytes_to_ix_map_entries(&g_fs, reader->size);
+    reader->map_buf =
+        (spiffs_page_ix *)malloc((size_t)(entries > 0 ? entries : 1) * sizeof(spiffs_page_ix));
+    if (!reader->map_buf) {
+        SPIFFS_close(&g_fs, reader->file);
+        memset(reader, 0, sizeof(*reader));
+        return SPIFFS_ERR_INTERNAL;
+    }
+    s32_t res = SPIFFS_ix_map(&g_fs, reader->file, &reader->map, 0,
+                              reader->size, reader->map_buf);
+    if (res != SPIFFS_OK) {
+        SPIFFS_close(&g_fs, reader->file);
+        free(reader->map_buf);
+        memset(reader, 0, sizeof(*reader));
+        return res;
+    }
+#endif
+    return 0;
+}
+
+static int spiffsjs_range_reader_read(spiffsjs_range_reader *reader,
+                                      u32_t offset, uint8_t *dest, u32_t length) {
+    if (offset >= reader->size) {
+        return 0;
+    }
+    length = SPIFFSJS_MIN(length, reader->size - offset);
+    s32_t res = SPIFFS_lseek(&g_fs, reader->file, (s32_t)offset, SPIFFS_SEEK_SET);
+    if (res < 0) {
+        return res;
+    }
+    u32_t done = 0;
+    while (done < length) {
+        s32_t chunk =
+            (s32_t)SPIFFSJS_MIN((u32_t)SPIFFSJS_MAX_READ_CHUNK, length - done);
+        s32_t read = SPIFFS_read(&g_fs, reader->file, dest + done, chunk);
+        if (read < 0) {
+            return read;
+        }
+        if (read == 0) {
+            break;
+        }
+        done += (u32_t)read;
+    }
+    return (int)done;
+}
+
+// Reads up to length bytes from offset into buffer_ptr and returns the count,
+// which is short at the end of the file. The files read last stay open with
+// their index mapped, so paging through a large file never rewalks it.
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_read_range(const char *path, uint32_t offset, uint32_t length,
+                        uint32_t buffer_ptr) {
+    int err = spiffsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    if (!path || (length > 0 && !buffer_ptr) || length > INT32_MAX ||
+        offset > INT32_MAX) {
+        return SPIFFS_ERR_NOT_CONFIGURED;
+    }
+    uint8_t *dest = (uint8_t *)(uintptr_t)buffer_ptr;
+
+    spiffsjs_range_reader *slot = NULL;
+    for (uint32_t i = 0; i < SPIFFSJS_RANGE_READERS; i++) {
+        spiffsjs_range_reader *reader = &g_range_readers[i];
+        if (!reader->name[0]) {
+            slot = slot ? slot : reader;
+        } else if (strcmp(reader->name, path) == 0) {
+            reader->last_used = ++g_range_clock;
+            return spiffsjs_range_reader_read(reader, offset, dest, length);
+        }
+    }
+
+    uint32_t limit = spiffsjs_range_reader_limit();
+    if (limit == 0) {
+        spiffsjs_range_reader reader;
+        err = spiffsjs_range_reader_open(path, &reader);
+        if (err) {
+            return err;
+        }
+        int read = spiffsjs_range_reader_read(&reader, offset, dest, length);
+        spiffsjs_range_reader_close(&reader);
+        return read;
+    }
+    if (g_range_reader_count >= limit) {
+        spiffsjs_range_reader *oldest = NULL;
+        for (uint32_t i = 0; i < SPIFFSJS_RANGE_READERS; i++) {
+            spiffsjs_range_reader *reader = &g_range_readers[i];
+            if (reader->name[0] &&
+                (!oldest || reader->last_used < oldest->last_used)) {
+                oldest = reader;
+            }
+        }
+        spiffsjs_range_reader_close(oldest);
+        g_range_reader_count--;
+        slot = oldest;
+    }
+    err = spiffsjs_range_reader_open(path, slot);
+    if (err) {
+        return err;
+    }
+    g_range_reader_count++;
+    slot->last_used = ++g_range_clock;
+    return spiffsjs_range_reader_read(slot, offset, dest, length);
+}
+
+// Closes a file that was written to. SPIFFS_close bails out before returning
+// the descriptor when its cache flush fails, so flush first: the cache page is
+// released either way, and the close that follows always frees the descriptor.
+static int spiffsjs_close_written(spiffs_file file) {
+    s32_t res = SPIFFS_fflush(&g_fs, file);
+    s32_t close_res = SPIFFS_close(&g_fs, file);
+    return res < 0 ? res : close_res;
+}
+
+// Writes length bytes of data to path, or zeros when data is NULL. flags
+// picks SPIFFS_TRUNC or SPIFFS_APPEND.
+static int spiffsjs_write_contents(const char *path, const uint8_t *data,
+                                   uint32_t length, spiffs_flags flags) {
+    static const uint8_t zeros[SPIFFSJS_MAX_READ_CHUNK];
+    spiffs_file file =
+        SPIFFS_open(&g_fs, path, SPIFFS_CREAT | SPIFFS_RDWR | flags, 0);
+    if (file < 0) {
+        return file;
+    }
+
+    uint32_t written = 0;
+    while (written < length) {
+        uint32_t chunk =
+            SPIFFSJS_MIN((uint32_t)SPIFFSJS_MAX_READ_CHUNK, length - written);
+        const uint8_t *src = data ? data + written : zeros;
+        s32_t res = SPIFFS_write(&g_fs, file, (void *)(uintptr_t)src, (s32_t)chunk);
+        if (res < 0) {
+            spiffsjs_close_written(file);
+            return res;
         }
         written += (uint32_t)res;
     }
 
-    SPIFFS_close(&g_fs, file);
-    return 0;
+    return spiffsjs_close_written(file);
+}
+
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_write_file(const char *path, const uint8_t *data,
+                        uint32_t length) {
+    int err = spiffsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    if (!path || (length > 0 && !data)) {
+        return SPIFFS_ERR_NOT_CONFIGURED;
+    }
+    spiffsjs_range_readers_drop(path);
+    return spiffsjs_write_contents(path, data, length, SPIFFS_TRUNC);
+}
+
+// Appends to the end of path, creating it if needed. Only the new data pages
+// and the index pages that point at them are written.
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_append_file(const char *path, const uint8_t *data,
+                         uint32_t length) {
+    int err = spiffsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    if (!path || (length > 0 && !data)) {
+        return SPIFFS_ERR_NOT_CONFIGURED;
+    }
+    spiffsjs_range_readers_drop(path);
+    return spiffsjs_write_contents(path, data, length, SPIFFS_APPEND);
+}
+
+// Appends to several files in one call. manifest holds "name\tlength\n"
+// lines and data the payloads back to back in the same order. Returns the
+// number of files appended to.
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_append_batch(const char *manifest, const uint8_t *data,
+                          uint32_t data_len) {
+    int err = spiffsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    if (!manifest || (data_len > 0 && !data)) {
+        return SPIFFS_ERR_NOT_CONFIGURED;
+    }
+    char name[SPIFFSJS_PATH_MAX];
+    const char *line = manifest;
+    uint32_t offset = 0;
+    int count = 0;
+    while (*line) {
+        const char *tab = strchr(line, '\t');
+        if (!tab || (size_t)(tab - line) >= sizeof(name)) {
+            return SPIFFS_ERR_NOT_CONFIGURED;
+        }
+        memcpy(name, line, (size_t)(tab - line));
+        name[tab - line] = '\0';
+        char *end = NULL;
+        unsigned long length = strtoul(tab + 1, &end, 10);
+        if (end == tab + 1 || (*end != '\n' && *end != '\0') ||
+            length > data_len - offset) {
+            return SPIFFS_ERR_NOT_CONFIGURED;
+        }
+        spiffsjs_range_readers_drop(name);
+        err = spiffsjs_write_contents(name, data ? data + offset : NULL,
+                                      (uint32_t)length, SPIFFS_APPEND);
+        if (err) {
+            return err;
+        }
+        offset += (uint32_t)length;
+        count++;
+        line = *end ? end + 1 : end;
+    }
+    return count;
 }
 
 EMSCRIPTEN_KEEPALIVE
@@ -428,19 +1346,97 @@ int spiffsjs_remove_file(const char *path) {
     if (!path) {
         return SPIFFS_ERR_NOT_CONFIGURED;
     }
+    spiffsjs_range_readers_drop(path);
     return SPIFFS_remove(&g_fs, path);
 }
 
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_remove_prefix(const char *prefix) {
+    int err = spiffsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    if (!prefix) {
+        return SPIFFS_ERR_NOT_CONFIGURED;
+    }
+    size_t prefix_len = strlen(prefix);
+
+    spiffs_DIR dir;
+    if (!SPIFFS_opendir(&g_fs, "/", &dir)) {
+        return SPIFFS_errno(&g_fs);
+    }
+    /* Removing only marks the current lookup entries deleted, so the scan
+     * can keep going from where it is. */
+    int removed = 0;
+    struct spiffs_dirent entry;
+    struct spiffs_dirent *result;
+    while ((result = SPIFFS_readdir(&dir, &entry)) != NULL) {
+        if (strncmp((const char *)result->name, prefix, prefix_len) != 0) {
+            continue;
+        }
+        spiffsjs_range_readers_drop((const char *)result->name);
+        spiffs_file file = SPIFFS_open_by_dirent(&g_fs, result, SPIFFS_RDWR, 0);
+        if (file < 0) {
+            SPIFFS_closedir(&dir);
+            return file;
+        }
+        s32_t res = SPIFFS_fremove(&g_fs, file);
+        if (res != SPIFFS_OK) {
+            SPIFFS_close(&g_fs, file);
+            SPIFFS_closedir(&dir);
+            return res;
+        }
+        removed++;
+    }
+    SPIFFS_closedir(&dir);
+    return removed;
+}
+
 EMSCRIPTEN_KEEPALIVE
 int spiffsjs_list(uint32_t buffer_ptr, uint32_t buffer_len) {
     return spiffsjs_list_inner(buffer_ptr, buffer_len);
 }
 
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_list_prefix(const char *prefix, uint32_t flags, uint32_t buffer_ptr,
+                         uint32_t buffer_len) {
+    if (!g_is_mounted) {
+        return SPIFFS_ERR_NOT_MOUNTED;
+    }
+    if (buffer_ptr == 0 || buffer_len == 0) {
+        return SPIFFS_ERR_INTERNAL;
+    }
+    spiffsjs_prefix_list list;
+    memset(&list, 0, sizeof(list));
+    list.prefix = prefix ? prefix : "";
+    list.prefix_len = strlen(list.prefix);
+    list.dirs = (flags & SPIFFSJS_LIST_DIRS) != 0;
+    list.cursor = (char *)(uintptr_t)buffer_ptr;
+    list.end = list.cursor + buffer_len;
+    *list.cursor = '\0';
+
+    int err = g_name_index_ready ? spiffsjs_prefix_list_indexed(&list)
+                                 : spiffsjs_prefix_list_scan(&list);
+    if (err) {
+        return spiffsjs_result(err);
+    }
+    if (list.cursor < list.end) {
+        *list.cursor = '\0';
+    }
+    return (int)(list.cursor - (char *)(uintptr_t)buffer_ptr);
+}
+
 EMSCRIPTEN_KEEPALIVE
 uint32_t spiffsjs_storage_size(void) {
     return g_total_bytes32;
 }
 
+// The live image, for hosts that stream it in or out without a copy.
+EMSCRIPTEN_KEEPALIVE
+uint32_t spiffsjs_storage_ptr(void) {
+    return (uint32_t)(uintptr_t)g_storage;
+}
+
 EMSCRIPTEN_KEEPALIVE
 int spiffsjs_export_image(uint32_t buffer_ptr, uint32_t buffer_len) {
     size_t total = spiffsjs_total_bytes();
@@ -477,6 +1473,155 @@ int spiffsjs_get_usage(uint32_t usage_ptr) {
     return 0;
 }
 
+// Pages a file of size bytes occupies: data pages plus the object index
+// header and as many further index pages as its data spans need.
+static u32_t spiffsjs_pages_for_size(u32_t size) {
+    u32_t data_pages =
+        (size + SPIFFS_DATA_PAGE_SIZE(&g_fs) - 1) / SPIFFS_DATA_PAGE_SIZE(&g_fs);
+    u32_t index_pages = 1;
+    if (data_pages > SPIFFS_OBJ_HDR_IX_LEN(&g_fs)) {
+        u32_t rest = data_pages - SPIFFS_OBJ_HDR_IX_LEN(&g_fs);
+        index_pages += (rest + SPIFFS_OBJ_IX_LEN(&g_fs) - 1) / SPIFFS_OBJ_IX_LEN(&g_fs);
+    }
+    return data_pages + index_pages;
+}
+
+// Page accounting for a planned series of writes.
+typedef struct {
+    u32_t needed;    // pages the written files occupy
+    u32_t rewrites;  // index pages the appends leave deleted behind them
+    u32_t released;  // pages truncating replaced files deletes
+} spiffsjs_fit;
+
+typedef int (*spiffsjs_fit_visitor)(void *ctx, const char *path, u32_t size);
+
+// Calls visit for each "name\tlength\n" line of manifest, or once for
+// path/length when manifest is NULL.
+static int spiffsjs_fit_each(const char *manifest, const char *path,
+                             u32_t length, spiffsjs_fit_visitor visit,
+                             void *ctx) {
+    if (!manifest) {
+        return visit(ctx, path, length);
+    }
+    char name[SPIFFSJS_PATH_MAX];
+    const char *line = manifest;
+    while (*line) {
+        const char *tab = strchr(line, '\t');
+        if (!tab || (size_t)(tab - line) >= sizeof(name)) {
+            return SPIFFS_ERR_NOT_CONFIGURED;
+        }
+        memcpy(name, line, (size_t)(tab - line));
+        name[tab - line] = '\0';
+        char *end = NULL;
+        unsigned long size = strtoul(tab + 1, &end, 10);
+        if (end == tab + 1 || (*end != '\n' && *end != '\0') ||
+            size > UINT32_MAX) {
+            return SPIFFS_ERR_NOT_CONFIGURED;
+        }
+        int err = visit(ctx, name, (u32_t)size);
+        if (err) {
+            return err;
+        }
+        line = *end ? end + 1 : end;
+    }
+    return 0;
+}
+
+static int spiffsjs_fit_account(void *ctx, const char *path, u32_t size) {
+    spiffsjs_fit *fit = (spiffsjs_fit *)ctx;
+    if (strlen(path) >= SPIFFS_OBJ_NAME_LEN) {
+        return SPIFFS_ERR_NAME_TOO_LONG;
+    }
+    u32_t pages = spiffsjs_pages_for_size(size);
+    u32_t data_pages =
+        (size + SPIFFS_DATA_PAGE_SIZE(&g_fs) - 1) / SPIFFS_DATA_PAGE_SIZE(&g_fs);
+    u32_t chunks = (size + SPIFFSJS_MAX_READ_CHUNK - 1) / SPIFFSJS_MAX_READ_CHUNK;
+    fit->rewrites += chunks + (pages - data_pages);
+    spiffs_stat info;
+    s32_t res = SPIFFS_stat(&g_fs, path, &info);
+    if (res == SPIFFS_OK) {
+        // truncation keeps the object index header but moves it to a new page
+        u32_t old_size = info.size == SPIFFS_UNDEFINED_LEN ? 0 : info.size;
+        fit->released += spiffsjs_pages_for_size(old_size) - 1;
+        fit->rewrites += 1;
+        pages -= 1;
+    } else if (res != SPIFFS_ERR_NOT_FOUND) {
+        return res;
+    }
+    fit->needed += pages;
+    return 0;
+}
+
+static int spiffsjs_fit_write(void *ctx, const char *path, u32_t size) {
+    (void)ctx;
+    return spiffsjs_write_contents(path, NULL, size, SPIFFS_TRUNC);
+}
+
+// Returns 1 if writing the planned files would succeed, 0 if SPIFFS would
+// run out of space. Pages that are free outside the two blocks GC keeps in
+// reserve settle it without GC; deleted pages only come back a block at a
+// time under GC's own candidate heuristics, so when the answer depends on
+// them the writes are tried for real and the image is restored afterwards.
+static int spiffsjs_fit_check(const char *manifest, const char *path,
+                              u32_t length, u32_t *needed, u32_t *available) {
+    spiffsjs_fit fit = {0};
+    int err = spiffsjs_fit_each(manifest, path, length, spiffsjs_fit_account, &fit);
+    if (err) {
+        return err;
+    }
+    s32_t free_pages =
+        (s32_t)((SPIFFS_PAGES_PER_BLOCK(&g_fs) - SPIFFS_OBJ_LOOKUP_PAGES(&g_fs)) *
+                (g_fs.block_count - 2)) -
+        (s32_t)g_fs.stats_p_allocated - (s32_t)g_fs.stats_p_deleted;
+    s32_t reclaimable = free_pages + (s32_t)g_fs.stats_p_deleted + (s32_t)fit.released;
+    *needed = fit.needed;
+    *available = reclaimable > 0 ? (u32_t)reclaimable : 0;
+    if (fit.needed > *available) {
+        return 0;
+    }
+    // spiffs_gc_check wants the chunk being appended plus a page spare
+    u32_t spare = (SPIFFSJS_MAX_READ_CHUNK + 2 * SPIFFS_DATA_PAGE_SIZE(&g_fs) - 1) /
+                  SPIFFS_DATA_PAGE_SIZE(&g_fs);
+    if (free_pages > 0 && (uint64_t)fit.needed + fit.rewrites + spare <= (u32_t)free_pages) {
+        return 1;
+    }
+
+    // The dry run is not device I/O, so keep it out of the counters.
+    uint64_t *io_stats = g_io_stats;
+    g_io_stats = NULL;
+    spiffsjs_range_readers_drop(NULL);
+    // GC picks blocks from the cursors and caches the mount leaves behind, and
+    // the real write runs on the fresh mount that follows the rollback. Start
+    // the dry run from a fresh mount too so both make the same choices.
+    SPIFFS_unmount(&g_fs);
+    err = spiffsjs_mount(false);
+    if (err) {
+        g_io_stats = io_stats;
+        return err;
+    }
+    // The dry run writes under a private snapshot and rolls back to it, so it
+    // costs the blocks it touches rather than a copy of the whole image.
+    spiffsjs_snapshot_t *dry_run = spiffsjs_snapshot_push();
+    if (!dry_run) {
+        g_io_stats = io_stats;
+        return SPIFFS_ERR_INTERNAL;
+    }
+    err = spiffsjs_fit_each(manifest, path, length, spiffsjs_fit_write, NULL);
+    SPIFFS_unmount(&g_fs);
+    spiffsjs_snapshot_rollback(dry_run);
+    g_snapshots = dry_run->older;
+    spiffsjs_snapshot_free(dry_run);
+    int mount_err = spiffsjs_mount(false);
+    g_io_stats = io_stats;
+    if (mount_err) {
+        return mount_err;
+    }
+    if (err == SPIFFS_ERR_FULL) {
+        return 0;
+    }
+    return err ? err : 1;
+}
+
 EMSCRIPTEN_KEEPALIVE
 int spiffsjs_can_fit(const char *path, uint32_t length) {
     int err = spiffsjs_ensure_mounted();
@@ -486,12 +1631,449 @@ int spiffsjs_can_fit(const char *path, uint32_t length) {
     if (!path) {
         return SPIFFS_ERR_NOT_CONFIGURED;
     }
-    u32_t total = 0;
-    u32_t used = 0;
-    s32_t res = SPIFFS_info(&g_fs, &total, &used);
-    if (res != SPIFFS_OK) {
+    u32_t needed = 0;
+    u32_t available = 0;
+    return spiffsjs_fit_check(NULL, path, length, &needed, &available);
+}
+
+// Checks a manifest of "name\tlength\n" lines, written in order, as a whole.
+// result_ptr receives {pages the files occupy, pages free or reclaimable}.
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_can_fit_batch(const char *manifest, uint32_t result_ptr) {
+    int err = spiffsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    if (!manifest || !result_ptr) {
+        return SPIFFS_ERR_NOT_CONFIGURED;
+    }
+    u32_t needed = 0;
+    u32_t available = 0;
+    int fits = spiffsjs_fit_check(manifest, NULL, 0, &needed, &available);
+    if (fits < 0) {
+        return fits;
+    }
+    uint32_t *dest = (uint32_t *)(uintptr_t)result_ptr;
+    dest[0] = needed;
+    dest[1] = available;
+    return fits;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_gc(uint32_t size) {
+    int err = spiffsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    return SPIFFS_gc(&g_fs, size);
+}
+
+// Returns 1 if a block was erased, 0 if no block qualified.
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_gc_quick(uint32_t max_free_pages) {
+    int err = spiffsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    if (max_free_pages > 0xFFFF) {
+        return SPIFFS_ERR_NOT_CONFIGURED;
+    }
+    s32_t res = SPIFFS_gc_quick(&g_fs, (u16_t)max_free_pages);
+    if (res == SPIFFS_ERR_NO_DELETED_BLOCKS) {
+        return 0;
+    }
+    return res == SPIFFS_OK ? 1 : res;
+}
+
+// Runs GC ahead of a write of length bytes so that the write itself does not
+// have to. SPIFFS_ERR_FULL only means the reservation could not be made in
+// full; the write may still succeed, e.g. when it replaces a large file.
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_reserve(uint32_t length) {
+    int err = spiffsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    uint64_t block_bytes =
+        (uint64_t)(SPIFFS_PAGES_PER_BLOCK(&g_fs) - SPIFFS_OBJ_LOOKUP_PAGES(&g_fs)) *
+        SPIFFS_DATA_PAGE_SIZE(&g_fs);
+    uint64_t target = (uint64_t)length + block_bytes * SPIFFSJS_GC_HEADROOM_BLOCKS;
+    if (target > INT32_MAX) {
+        target = INT32_MAX;
+    }
+    s32_t res = SPIFFS_gc(&g_fs, (u32_t)target);
+    if (res == SPIFFS_ERR_FULL) {
+        res = SPIFFS_gc(&g_fs, length);
+    }
+    return res;
+}
+
+// SPIFFS_check split into its passes so that the caller can report progress
+// between them: 0 = lookup pages, 1 = object indices, 2 = all pages. Each pass
+// repairs what it can and reports through spiffsjs_check_cb; like
+// SPIFFS_check, a failing pass does not stop the next one. Calling it with
+// SPIFFSJS_CHECK_FINISH rescans the lookup pages and rebuilds the name index,
+// and must follow the last pass that was run.
+#define SPIFFSJS_CHECK_FINISH 3u
+
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_check_pass(uint32_t pass) {
+    int err = spiffsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    switch (pass) {
+    case 0:
+        memset(g_check_counts, 0, sizeof(g_check_counts));
+        spiffsjs_range_readers_drop(NULL);
+        return spiffs_lookup_consistency_check(&g_fs, 0);
+    case 1:
+        return spiffs_object_index_consistency_check(&g_fs);
+    case 2:
+        return spiffs_page_consistency_check(&g_fs);
+    case SPIFFSJS_CHECK_FINISH: {
+        s32_t res = spiffs_obj_lu_scan(&g_fs);
+        spiffsjs_name_index_clear();
+        spiffsjs_name_index_build();
         return res;
     }
-    u32_t free_bytes = (total > used) ? (total - used) : 0;
-    return length <= free_bytes ? 1 : 0;
+    default:
+        return SPIFFS_ERR_INTERNAL;
+    }
+}
+
+// Writes the repair counts of the last check: errors, fixed index entries,
+// fixed lookup entries, deleted orphaned indices, deleted pages, deleted files.
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_check_report(uint32_t report_ptr) {
+    if (!report_ptr) {
+        return SPIFFS_ERR_NOT_CONFIGURED;
+    }
+    u32_t *dest = (u32_t *)(uintptr_t)report_ptr;
+    for (int i = SPIFFS_CHECK_ERROR; i <= SPIFFS_CHECK_DELETE_BAD_FILE; i++) {
+        dest[i - SPIFFS_CHECK_ERROR] = g_check_counts[i];
+    }
+    return 0;
+}
+
+// Enabling allocates zeroed counters for the current volume; volumes created
+// afterwards get fresh counters. Disabling frees them.
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_set_io_stats(uint32_t enabled) {
+    g_io_stats_enabled = enabled != 0;
+    return spiffsjs_io_stats_alloc(g_storage ? g_block_count : 0);
+}
+
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_reset_io_stats(void) {
+    if (!g_io_stats) {
+        return SPIFFS_ERR_NOT_CONFIGURED;
+    }
+    memset(g_io_stats, 0,
+           SPIFFSJS_IO_KINDS * ((size_t)g_io_stats_blocks + 1) * sizeof(uint64_t));
+    return 0;
+}
+
+// Copies the counters as laid out in g_io_stats and returns the block count,
+// which is all it returns for a NULL buffer.
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_get_io_stats(uint32_t buffer_ptr, uint32_t buffer_len) {
+    if (!g_io_stats) {
+        return SPIFFS_ERR_NOT_CONFIGURED;
+    }
+    size_t bytes =
+        SPIFFSJS_IO_KINDS * ((size_t)g_io_stats_blocks + 1) * sizeof(uint64_t);
+    if (buffer_ptr == 0) {
+        return (int)g_io_stats_blocks;
+    }
+    if (buffer_len < bytes) {
+        return SPIFFS_ERR_INTERNAL;
+    }
+    memcpy((void *)(uintptr_t)buffer_ptr, g_io_stats, bytes);
+    return (int)g_io_stats_blocks;
+}
+
+// Returns the id of a new snapshot of the current image. Files are closed at
+// the end of every call, so the image is consistent.
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_snapshot(void) {
+    int err = spiffsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    spiffsjs_snapshot_t *snap = spiffsjs_snapshot_push();
+    if (!snap) {
+        return SPIFFS_ERR_INTERNAL;
+    }
+    return (int)snap->id;
+}
+
+// Rolls the image back to the snapshot and remounts. Snapshots taken after it
+// are released; the snapshot itself stays valid with nothing to undo.
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_restore_snapshot(uint32_t id) {
+    spiffsjs_snapshot_t **found = spiffsjs_snapshot_find(id);
+    if (!found) {
+        return SPIFFS_ERR_NOT_FOUND;
+    }
+    spiffsjs_range_readers_drop(NULL);
+    if (g_is_mounted) {
+        SPIFFS_unmount(&g_fs);
+        g_is_mounted = false;
+    }
+    spiffsjs_snapshot_rollback(*found);
+    return spiffsjs_mount(false);
+}
+
+// Drops a snapshot, handing pre-images the next older snapshot lacks down to
+// it, since they are that snapshot's view as well.
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_release_snapshot(uint32_t id) {
+    spiffsjs_snapshot_t **found = spiffsjs_snapshot_find(id);
+    if (!found) {
+        return SPIFFS_ERR_NOT_FOUND;
+    }
+    spiffsjs_snapshot_t *snap = *found;
+    spiffsjs_snapshot_t *older = snap->older;
+    for (uint32_t i = 0; older && snap->saved && i < g_block_count; i++) {
+        if (snap->blocks[i] && !older->blocks[i]) {
+            older->blocks[i] = snap->blocks[i];
+            older->saved++;
+            snap->blocks[i] = NULL;
+            snap->saved--;
+        }
+    }
+    *found = older;
+    spiffsjs_snapshot_free(snap);
+    return 0;
+}
+
+// Number of erase blocks the snapshot holds a pre-image for.
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_snapshot_blocks(uint32_t id) {
+    spiffsjs_snapshot_t **found = spiffsjs_snapshot_find(id);
+    if (!found) {
+        return SPIFFS_ERR_NOT_FOUND;
+    }
+    return (int)(*found)->saved;
+}
+
+static const uint8_t *spiffsjs_snapshot_view(uint32_t block, void *ctx) {
+    spiffsjs_snapshot_t *target = (spiffsjs_snapshot_t *)ctx;
+    const uint8_t *view = NULL;
+    for (spiffsjs_snapshot_t *snap = g_snapshots;; snap = snap->older) {
+        if (snap->blocks[block]) {
+            view = snap->blocks[block];
+        }
+        if (snap == target) {
+            return view;
+        }
+    }
+}
+
+static const uint8_t *spiffsjs_image_view(uint32_t block, void *ctx) {
+    return (const uint8_t *)ctx + (size_t)block * g_block_size;
+}
+
+static int spiffsjs_patch_result(int err) {
+    if (err == IMGPATCH_ERR_NOMEM) {
+        return SPIFFS_ERR_INTERNAL;
+    }
+    return err ? SPIFFS_ERR_NOT_CONFIGURED : 0;
+}
+
+static void spiffsjs_hand_over(uint32_t result_ptr, uint8_t *data,
+                               uint32_t len) {
+    uint32_t *dest = (uint32_t *)(uintptr_t)result_ptr;
+    dest[0] = (uint32_t)(uintptr_t)data;
+    dest[1] = len;
+}
+
+static int spiffsjs_diff(imgpatch_view_fn view, void *ctx, uint32_t granularity,
+                         uint32_t result_ptr) {
+    if (!g_storage || !result_ptr) {
+        return SPIFFS_ERR_NOT_CONFIGURED;
+    }
+    imgpatch_source src = {g_storage, g_total_bytes32, g_block_size, view, ctx};
+    uint8_t *patch = NULL;
+    uint32_t patch_len = 0;
+    int err = imgpatch_diff(&src, granularity, &patch, &patch_len);
+    if (err) {
+        return spiffsjs_patch_result(err);
+    }
+    spiffsjs_hand_over(result_ptr, patch, patch_len);
+    return 0;
+}
+
+// Patch from the snapshot's image to the live one, comparing only erase blocks
+// written since the snapshot. Writes {patch pointer, length} to result_ptr;
+// the caller frees the patch.
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_diff_snapshot(uint32_t id, uint32_t granularity,
+                           uint32_t result_ptr) {
+    spiffsjs_snapshot_t **found = spiffsjs_snapshot_find(id);
+    if (!found) {
+        return SPIFFS_ERR_NOT_FOUND;
+    }
+    return spiffsjs_diff(spiffsjs_snapshot_view, *found, granularity,
+                         result_ptr);
+}
+
+// Patch from an image of the same size to the live one.
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_diff_image(const uint8_t *image, uint32_t image_len,
+                        uint32_t granularity, uint32_t result_ptr) {
+    if (!image || !g_storage || image_len != g_total_bytes) {
+        return SPIFFS_ERR_NOT_CONFIGURED;
+    }
+    return spiffsjs_diff(spiffsjs_image_view, (void *)image, granularity,
+                         result_ptr);
+}
+
+static int spiffsjs_patch_write(uint32_t offset, const uint8_t *data,
+                                uint32_t len, void *ctx) {
+    (void)ctx;
+    if (spiffsjs_snapshot_preserve(offset, len) != SPIFFS_OK) {
+        return SPIFFS_ERR_INTERNAL;
+    }
+    memcpy(g_storage + offset, data, len);
+    return 0;
+}
+
+// Validates the whole patch, writes it straight into the image and remounts,
+// which rebuilds the name index.
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_apply_patch(const uint8_t *patch, uint32_t patch_len) {
+    if (!g_storage) {
+        return SPIFFS_ERR_NOT_CONFIGURED;
+    }
+    int err = imgpatch_validate(patch, patch_len, g_total_bytes32);
+    if (err) {
+        return spiffsjs_patch_result(err);
+    }
+    spiffsjs_range_readers_drop(NULL);
+    if (g_is_mounted) {
+        SPIFFS_unmount(&g_fs);
+        g_is_mounted = false;
+    }
+    err = imgpatch_apply(patch, spiffsjs_patch_write, NULL);
+    int mount_err = spiffsjs_mount(false);
+    return err ? err : mount_err;
+}
+
+// Image patch at page granularity holding the lookup pages of every block
+// (they carry the magic and erase count mount looks for) and each data page
+// whose lookup entry is not free. Deleted pages stay in, since GC and the
+// consistency check still read their headers. Free pages must read as erased,
+// so a flasher erases the touched blocks and programs only these ranges.
+// Writes {patch pointer, length} to result_ptr; the caller frees the patch.
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_export_sparse(uint32_t flags, uint32_t result_ptr) {
+    int err = spiffsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    if (!result_ptr) {
+        return SPIFFS_ERR_NOT_CONFIGURED;
+    }
+    uint32_t pages_per_block = g_block_size / g_page_size;
+    uint32_t lookup_pages = SPIFFS_OBJ_LOOKUP_PAGES(&g_fs);
+    uint32_t entries = SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(&g_fs);
+    uint8_t *used = (uint8_t *)calloc(
+        ((size_t)g_block_count * pages_per_block + 7) / 8, 1);
+    if (!used) {
+        return SPIFFS_ERR_INTERNAL;
+    }
+    for (uint32_t block = 0; block < g_block_count; block++) {
+        uint32_t first = block * pages_per_block;
+        const uint8_t *lookup = g_storage + (size_t)block * g_block_size;
+        imgpatch_mark_range(used, first, lookup_pages);
+        for (uint32_t entry = 0; entry < entries; entry++) {
+            spiffs_obj_id id;
+            memcpy(&id, lookup + entry * sizeof(spiffs_obj_id), sizeof(id));
+            if (id != SPIFFS_OBJ_ID_FREE) {
+                imgpatch_mark(used, first + lookup_pages + entry);
+            }
+        }
+    }
+    uint8_t *sparse = NULL;
+    uint32_t sparse_len = 0;
+    err = spiffsjs_patch_result(imgpatch_sparse(g_storage, g_total_bytes32,
+                                                g_page_size, used, flags,
+                                                &sparse, &sparse_len));
+    free(used);
+    if (err) {
+        return err;
+    }
+    spiffsjs_hand_over(result_ptr, sparse, sparse_len);
+    return 0;
+}
+
+// Digests over the live volume, written to out_ptr back to back (4 bytes per
+// CRC32, 32 per SHA-256). Erase blocks and ranges are hashed in place in the
+// RAM image; files stream through SPIFFS_read into a stack buffer, so neither
+// path copies the data out to JS. hash_blocks with out_ptr 0 returns the
+// erase block count.
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_hash_blocks(uint32_t algorithm, uint32_t first, uint32_t count,
+                         uint32_t out_ptr) {
+    if (!g_storage || first > g_block_count || count > g_block_count - first) {
+        return SPIFFS_ERR_NOT_CONFIGURED;
+    }
+    if (!out_ptr) {
+        return (int)g_block_count;
+    }
+    return blockhash_units(algorithm,
+                           g_storage + (size_t)first * g_block_size,
+                           g_block_size, count, (uint8_t *)(uintptr_t)out_ptr)
+               ? SPIFFS_ERR_NOT_CONFIGURED
+               : SPIFFS_OK;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_hash_range(uint32_t algorithm, uint32_t offset, uint32_t length,
+                        uint32_t out_ptr) {
+    if (!g_storage || offset > g_total_bytes32 ||
+        length > g_total_bytes32 - offset) {
+        return SPIFFS_ERR_NOT_CONFIGURED;
+    }
+    return blockhash_range(algorithm, g_storage + offset, length,
+                           (uint8_t *)(uintptr_t)out_ptr)
+               ? SPIFFS_ERR_NOT_CONFIGURED
+               : SPIFFS_OK;
+}
+
+EMSCRIPTEN_KEEPALIVE
+int spiffsjs_hash_file(uint32_t algorithm, const char *path,
+                       uint32_t out_ptr) {
+    int err = spiffsjs_ensure_mounted();
+    if (err) {
+        return err;
+    }
+    blockhash_ctx ctx;
+    if (!path || !out_ptr || blockhash_init(&ctx, algorithm)) {
+        return SPIFFS_ERR_NOT_CONFIGURED;
+    }
+
+    spiffs_file file;
+    u32_t remaining = 0;
+    err = spiffsjs_open_for_read(path, &file, &remaining);
+    if (err) {
+        return err;
+    }
+    uint8_t chunk[4096];
+    while (remaining > 0) {
+        s32_t read = SPIFFS_read(&g_fs, file, chunk,
+                                 (s32_t)SPIFFSJS_MIN((u32_t)sizeof(chunk),
+                                                     remaining));
+        if (read <= 0) {
+            SPIFFS_close(&g_fs, file);
+            return read < 0 ? read : SPIFFS_ERR_END_OF_OBJECT;
+        }
+        blockhash_update(&ctx, chunk, (size_t)read);
+        remaining -= (u32_t)read;
+    }
+    SPIFFS_close(&g_fs, file);
+    blockhash_final(&ctx, (uint8_t *)(uintptr_t)out_ptr);
+    return SPIFFS_OK;
 }
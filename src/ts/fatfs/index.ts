@@ -1,4 +1,27 @@
-import type { BinarySource, FileSource, FileSystemUsage } from "../shared/types";
+import type {
+  BinarySource,
+  BlockHashOptions,
+  CompressedImageSource,
+  FileSource,
+  FileSystemUsage,
+  HashAlgorithm,
+  HashDigest,
+  HostBlockDevice,
+  HostDeviceOptions,
+  ImagePatchOptions,
+  ImageStreamOptions,
+  IoStats,
+  SparseImage,
+  SparseImageOptions,
+  VolumeSnapshot,
+} from "../shared/types";
+import { decodeDigests, digestByteLength, hashAlgorithmId } from "../shared/hash";
+import { hostCacheGeometry, hostDeviceImports } from "../shared/host-device";
+import { compressImage, decompressImage } from "../shared/image-stream";
+import { decodeIoStats, ioStatsByteLength } from "../shared/io-stats";
+import { adaptExports, readPointerPair, sumIovecs, writeSize, type PointerArgs } from "../shared/memory64";
+import { useSimd } from "../shared/simd";
+import { decodeSparseImage, sparseImageFlags } from "../shared/sparse-image";
 
 export const FAT_MOUNT = "/fatfs";
 
@@ -7,30 +30,100 @@ const DEFAULT_BLOCK_SIZE = 4096;
 const DEFAULT_BLOCK_COUNT = 128;
 const FATFS_ERR_INVAL = -1;
 const FATFS_ERR_NOSPC = -3;
+const FATFS_FEATURE_EXFAT = 0x01;
+const FORMAT_TYPE_FLAGS: Record<FatFSFormatType, number> = {
+  fat: 0x01,
+  fat32: 0x02,
+  exfat: 0x04,
+  auto: 0x07,
+};
+const FATFS_POINTER_ARGS: PointerArgs = {
+  fatfsjs_init_from_image: [0, 1],
+  fatfsjs_write_file: [0, 1, 2],
+  fatfsjs_delete_file: [0],
+  fatfsjs_remove: [0],
+  fatfsjs_list: [0, 1],
+  fatfsjs_mkdir: [0],
+  fatfsjs_rename: [0, 1],
+  fatfsjs_file_size: [0],
+  fatfsjs_read_file: [0, 1, 2],
+  fatfsjs_export_image: [0, 1],
+  fatfsjs_get_usage: [0],
+  fatfsjs_get_io_stats: [0],
+  fatfsjs_diff_snapshot: [2],
+  fatfsjs_diff_image: [0, 1, 3],
+  fatfsjs_apply_patch: [0],
+  fatfsjs_export_sparse: [1],
+  fatfsjs_hash_blocks: [3],
+  fatfsjs_hash_range: [1, 2, 3],
+  fatfsjs_hash_file: [1, 2],
+  malloc: [0],
+  free: [0],
+};
 
 export interface FatFSEntry {
   path: string;
   size: number;
   type: "file" | "dir";
+  mtime: number;
+}
+
+export interface FatFSUsageOptions {
+  forceScan?: boolean;
+}
+
+export interface FatFSWriteOptions {
+  mtime?: Date | number;
+}
+
+export type FatFSVariant = "fat" | "exfat";
+
+export type FatFSFormatType = "fat" | "fat32" | "exfat" | "auto";
+
+export interface FatFSFormatOptions {
+  type?: FatFSFormatType;
+  clusterSize?: number;
+  fatCopies?: number;
+  rootEntries?: number;
 }
 
 export interface FatFSOptions {
   blockSize?: number;
   blockCount?: number;
   formatOnInit?: boolean;
+  variant?: FatFSVariant;
+  format?: FatFSFormatOptions;
   wasmURL?: string | URL;
+  ioStats?: boolean;
+  memory64?: boolean;
+  simd?: boolean;
 }
 
 export interface FatFS {
   list(path?: string): FatFSEntry[];
   readFile(path: string): Uint8Array;
   toImage(): Uint8Array;
-  getUsage(): FileSystemUsage;
-  format(): void;
-  writeFile(path: string, data: FileSource): void;
+  toCompressedStream(options?: ImageStreamOptions): ReadableStream<Uint8Array>;
+  getUsage(options?: FatFSUsageOptions): FileSystemUsage;
+  format(options?: FatFSFormatOptions): void;
+  writeFile(path: string, data: FileSource, options?: FatFSWriteOptions): void;
+  delete(path: string, options?: { recursive?: boolean }): void;
   deleteFile(path: string): void;
   mkdir(path: string): void;
   rename(oldPath: string, newPath: string): void;
+  getIoStats(): IoStats | null;
+  resetIoStats(): void;
+  snapshot(): VolumeSnapshot;
+  restore(snapshot: VolumeSnapshot): void;
+  releaseSnapshot(snapshot: VolumeSnapshot): void;
+  snapshotBlocks(snapshot: VolumeSnapshot): number;
+  diff(base: VolumeSnapshot | BinarySource, options?: ImagePatchOptions): Uint8Array;
+  applyPatch(patch: BinarySource): void;
+  toSparseImage(options?: SparseImageOptions): SparseImage;
+  hashBlocks<A extends HashAlgorithm>(algorithm: A, options?: BlockHashOptions): HashDigest<A>;
+  hashRange<A extends HashAlgorithm>(algorithm: A, offset: number, length: number): HashDigest<A>;
+  hashFile<A extends HashAlgorithm>(path: string, algorithm: A): HashDigest<A>;
+  flush(): void;
 }
 
 interface FatFSExports {
@@ -38,8 +131,17 @@ interface FatFSExports {
   fatfsjs_init(blockSize: number, blockCount: number): number;
   fatfsjs_init_from_image(imagePtr: number, imageLen: number): number;
   fatfsjs_format(): number;
+  fatfsjs_set_format_options(
+    fmt: number,
+    clusterSize: number,
+    fatCopies: number,
+    rootEntries: number
+  ): number;
+  fatfsjs_features(): number;
+  fatfsjs_set_time(fattime: number): number;
   fatfsjs_write_file(pathPtr: number, dataPtr: number, dataLen: number): number;
   fatfsjs_delete_file(pathPtr: number): number;
+  fatfsjs_remove(pathPtr: number, recursive: number): number;
   fatfsjs_list(pathPtr: number, bufferPtr: number, bufferLen: number): number;
   fatfsjs_mkdir(pathPtr: number): number;
   fatfsjs_rename(oldPathPtr: number, newPathPtr: number): number;
@@ -51,6 +153,26 @@ interface FatFSExports {
   ): number;
   fatfsjs_export_image(bufferPtr: number, bufferLen: number): number;
   fatfsjs_storage_size(): number;
+  fatfsjs_storage_ptr(): number;
+  fatfsjs_import_begin(blockCount: number): number;
+  fatfsjs_import_end(): number;
+  fatfsjs_init_host(blockCount: number, cacheBlocks: number, readAheadBlocks: number, format: number): number;
+  fatfsjs_flush(): number;
+  fatfsjs_get_usage(usagePtr: number, forceScan: number): number;
+  fatfsjs_set_io_stats(enabled: number): number;
+  fatfsjs_reset_io_stats(): number;
+  fatfsjs_get_io_stats(bufferPtr: number, bufferLen: number): number;
+  fatfsjs_snapshot(): number;
+  fatfsjs_restore_snapshot(id: number): number;
+  fatfsjs_release_snapshot(id: number): number;
+  fatfsjs_snapshot_blocks(id: number): number;
+  fatfsjs_diff_snapshot(id: number, granularity: number, resultPtr: number): number;
+  fatfsjs_diff_image(imagePtr: number, imageLen: number, granularity: number, resultPtr: number): number;
+  fatfsjs_apply_patch(patchPtr: number, patchLen: number): number;
+  fatfsjs_export_sparse(flags: number, resultPtr: number): number;
+  fatfsjs_hash_blocks(algorithm: number, first: number, count: number, outPtr: number): number;
+  fatfsjs_hash_range(algorithm: number, offset: number, length: number, outPtr: number): number;
+  fatfsjs_hash_file(algorithm: number, pathPtr: number, outPtr: number): number;
   malloc(size: number): number;
   free(ptr: number): void;
 }
@@ -70,8 +192,9 @@ export async function createFatFSFromImage(
   options: FatFSOptions = {}
 ): Promise<FatFS> {
   console.info("[fatfs-wasm] createFatFSFromImage() starting");
-  const wasmURL = options.wasmURL ?? new URL("./fatfs.wasm", import.meta.url);
-  const exports = await instantiateFatFSModule(wasmURL);
+  const wasmURL = options.wasmURL ?? defaultWasmURL(options);
+  const exports = await instantiateFatFSModule(wasmURL, options.memory64 === true);
+  const formatOptions = resolveFormatOptions(options);
   const bytes = asBinaryUint8Array(image);
 
   const blockSize = options.blockSize ?? DEFAULT_BLOCK_SIZE;
@@ -82,30 +205,68 @@ export async function createFatFSFromImage(
     throw new Error("Image size must equal blockSize * blockCount");
   }
 
-  const heap = new Uint8Array(exports.memory.buffer);
-  const imagePtr = exports.malloc(bytes.length || 1);
-  if (!imagePtr) {
-    throw new FatFSError("Failed to allocate WebAssembly memory", FATFS_ERR_NOSPC);
+  if (bytes.length === 0 || bytes.length % blockSize !== 0) {
+    throw new FatFSError("Failed to initialize FAT16 image", FATFS_ERR_INVAL);
   }
 
-  try {
-    heap.set(bytes, imagePtr);
-    const initResult = exports.fatfsjs_init_from_image(imagePtr, bytes.length);
-    if (initResult < 0) {
-      throw new FatFSError("Failed to initialize FAT16 image", initResult);
-    }
-  } finally {
-    exports.free(imagePtr);
+  enableIoStats(exports, options);
+  const beginResult = exports.fatfsjs_import_begin(bytes.length / blockSize);
+  if (beginResult < 0) {
+    throw new FatFSError("Failed to initialize FAT16 image", beginResult);
+  }
+  new Uint8Array(exports.memory.buffer).set(bytes, exports.fatfsjs_storage_ptr());
+  const initResult = exports.fatfsjs_import_end();
+  if (initResult < 0) {
+    throw new FatFSError("Failed to initialize FAT16 image", initResult);
   }
 
   console.info("[fatfs-wasm] Filesystem initialized from image");
-  return new FatFSClient(exports);
+  return new FatFSClient(exports, formatOptions, options.memory64 === true);
+}
+
+export async function createFatFSFromCompressedImage(
+  source: CompressedImageSource,
+  options: FatFSOptions & ImageStreamOptions = {}
+): Promise<FatFS> {
+  console.info("[fatfs-wasm] createFatFSFromCompressedImage() starting");
+  const wasmURL = options.wasmURL ?? defaultWasmURL(options);
+  const exports = await instantiateFatFSModule(wasmURL, options.memory64 === true);
+  const formatOptions = resolveFormatOptions(options);
+
+  const blockSize = options.blockSize ?? DEFAULT_BLOCK_SIZE;
+  const blockCount = options.blockCount ?? DEFAULT_BLOCK_COUNT;
+  if (blockSize !== DEFAULT_BLOCK_SIZE) {
+    throw new Error(`blockSize must be ${DEFAULT_BLOCK_SIZE}`);
+  }
+  if (!Number.isInteger(blockCount) || blockCount <= 0) {
+    throw new Error("blockCount must be a positive integer");
+  }
+
+  enableIoStats(exports, options);
+  const beginResult = exports.fatfsjs_import_begin(blockCount);
+  if (beginResult < 0) {
+    throw new FatFSError("Failed to initialize FAT16 image", beginResult);
+  }
+  await decompressImage(
+    source,
+    blockSize * blockCount,
+    (offset, chunk) => new Uint8Array(exports.memory.buffer).set(chunk, exports.fatfsjs_storage_ptr() + offset),
+    options
+  );
+  const initResult = exports.fatfsjs_import_end();
+  if (initResult < 0) {
+    throw new FatFSError("Failed to initialize FAT16 image", initResult);
+  }
+
+  console.info("[fatfs-wasm] Filesystem initialized from compressed image");
+  return new FatFSClient(exports, formatOptions, options.memory64 === true);
 }
 
 export async function createFatFS(options: FatFSOptions = {}): Promise<FatFS> {
   console.info("[fatfs-wasm] createFatFS() starting", options);
-  const wasmURL = options.wasmURL ?? new URL("./fatfs.wasm", import.meta.url);
-  const exports = await instantiateFatFSModule(wasmURL);
+  const wasmURL = options.wasmURL ?? defaultWasmURL(options);
+  const exports = await instantiateFatFSModule(wasmURL, options.memory64 === true);
+  const formatOptions = resolveFormatOptions(options);
 
   const blockSize = options.blockSize ?? DEFAULT_BLOCK_SIZE;
   const blockCount = options.blockCount ?? DEFAULT_BLOCK_COUNT;
@@ -116,6 +277,8 @@ export async function createFatFS(options: FatFSOptions = {}): Promise<FatFS> {
     throw new Error("blockCount must be a positive integer");
   }
 
+  applyFormatOptions(exports, formatOptions);
+  enableIoStats(exports, options);
   const initResult = exports.fatfsjs_init(blockSize, blockCount);
   if (initResult < 0) {
     throw new FatFSError("Failed to initialize FatFS", initResult);
@@ -129,18 +292,59 @@ export async function createFatFS(options: FatFSOptions = {}): Promise<FatFS> {
   }
 
   console.info("[fatfs-wasm] Filesystem initialized");
-  return new FatFSClient(exports);
+  return new FatFSClient(exports, formatOptions, options.memory64 === true);
+}
+
+export async function createFatFSOnDevice(
+  device: HostBlockDevice,
+  options: FatFSOptions & HostDeviceOptions = {}
+): Promise<FatFS> {
+  console.info("[fatfs-wasm] createFatFSOnDevice() starting");
+  const wasmURL = options.wasmURL ?? defaultWasmURL(options);
+  const formatOptions = resolveFormatOptions(options);
+
+  const blockSize = options.blockSize ?? DEFAULT_BLOCK_SIZE;
+  const blockCount = options.blockCount ?? DEFAULT_BLOCK_COUNT;
+  if (blockSize !== DEFAULT_BLOCK_SIZE) {
+    throw new Error(`blockSize must be ${DEFAULT_BLOCK_SIZE}`);
+  }
+  if (!Number.isInteger(blockCount) || blockCount <= 0) {
+    throw new Error("blockCount must be a positive integer");
+  }
+  const [cacheBlocks, readAheadBlocks] = hostCacheGeometry(options);
+  const exports = await instantiateFatFSModule(wasmURL, options.memory64 === true, device);
+
+  applyFormatOptions(exports, formatOptions);
+  enableIoStats(exports, options);
+  const initResult = exports.fatfsjs_init_host(blockCount, cacheBlocks, readAheadBlocks, options.formatOnInit ? 1 : 0);
+  if (initResult < 0) {
+    throw new FatFSError("Failed to mount FatFS on the host device", initResult);
+  }
+
+  console.info("[fatfs-wasm] Filesystem mounted on host device");
+  return new FatFSClient(exports, formatOptions, options.memory64 === true, device);
 }
 
 class FatFSClient implements FatFS {
   private readonly exports: FatFSExports;
+  private readonly formatOptions: FatFSFormatOptions;
   private heapU8: Uint8Array;
   private readonly encoder = new TextEncoder();
   private readonly decoder = new TextDecoder();
   private listBufferSize = INITIAL_LIST_BUFFER;
+  private readonly memory64: boolean;
+  private readonly device: HostBlockDevice | null;
 
-  constructor(exports: FatFSExports) {
+  constructor(
+    exports: FatFSExports,
+    formatOptions: FatFSFormatOptions,
+    memory64: boolean,
+    device: HostBlockDevice | null = null
+  ) {
     this.exports = exports;
+    this.formatOptions = formatOptions;
+    this.memory64 = memory64;
+    this.device = device;
     this.heapU8 = new Uint8Array(this.exports.memory.buffer);
   }
 
@@ -165,6 +369,7 @@ class FatFSClient implements FatFS {
           if (used === 0) {
             return [];
           }
+          this.refreshHeap();
           const payload = this.decoder.decode(this.heapU8.subarray(ptr, ptr + used));
           return parseListPayload(payload).map((entry) => ({
             ...entry,
@@ -197,6 +402,7 @@ class FatFSClient implements FatFS {
       try {
         const read = this.exports.fatfsjs_read_file(pathPtr, dataPtr, size);
         this.assertOk(read, `read file "${normalized}"`);
+        this.refreshHeap();
         return this.heapU8.slice(dataPtr, dataPtr + size);
       } finally {
         this.exports.free(dataPtr);
@@ -207,6 +413,7 @@ class FatFSClient implements FatFS {
   }
 
   toImage(): Uint8Array {
+    this.assertInMemory("export filesystem image");
     const size = this.exports.fatfsjs_storage_size();
     if (size === 0) {
       return new Uint8Array();
@@ -221,31 +428,147 @@ class FatFSClient implements FatFS {
     }
   }
 
-  getUsage(): FileSystemUsage {
-    const capacityBytes = this.exports.fatfsjs_storage_size();
-    const entries = this.list(FAT_MOUNT);
-    const usedBytes = entries.reduce(
-      (acc, entry) => (entry.type === "file" ? acc + entry.size : acc),
-      0
+  toCompressedStream(options: ImageStreamOptions = {}): ReadableStream<Uint8Array> {
+    this.assertInMemory("stream filesystem image");
+    return compressImage(
+      (offset, length) => {
+        this.refreshHeap();
+        const ptr = this.exports.fatfsjs_storage_ptr() + offset;
+        return this.heapU8.slice(ptr, ptr + length);
+      },
+      this.exports.fatfsjs_storage_size(),
+      options
     );
-    const freeBytes = capacityBytes > usedBytes ? capacityBytes - usedBytes : 0;
-    return {
-      capacityBytes,
-      usedBytes,
-      freeBytes,
-    };
   }
 
-  format(): void {
+  getUsage(options: FatFSUsageOptions = {}): FileSystemUsage {
+    const ptr = this.alloc(24);
+    try {
+      const result = this.exports.fatfsjs_get_usage(ptr, options.forceScan ? 1 : 0);
+      this.assertOk(result, "get usage");
+      this.refreshHeap();
+      const view = new DataView(this.heapU8.buffer, ptr, 24);
+      return {
+        capacityBytes: Number(view.getBigUint64(0, true)),
+        usedBytes: Number(view.getBigUint64(8, true)),
+        freeBytes: Number(view.getBigUint64(16, true)),
+      };
+    } finally {
+      this.exports.free(ptr);
+    }
+  }
+
+  getIoStats(): IoStats | null {
+    const sectorCount = this.exports.fatfsjs_get_io_stats(0, 0);
+    if (sectorCount < 0) {
+      return null;
+    }
+    const byteLength = ioStatsByteLength(sectorCount);
+    const ptr = this.alloc(byteLength);
+    try {
+      this.assertOk(this.exports.fatfsjs_get_io_stats(ptr, byteLength), "read I/O statistics");
+      return decodeIoStats(this.heapU8.buffer, ptr, sectorCount);
+    } finally {
+      this.exports.free(ptr);
+    }
+  }
+
+  resetIoStats(): void {
+    this.assertOk(this.exports.fatfsjs_reset_io_stats(), "reset I/O statistics");
+  }
+
+  snapshot(): VolumeSnapshot {
+    const id = this.exports.fatfsjs_snapshot();
+    this.assertOk(id, "take snapshot");
+    return { id };
+  }
+
+  restore(snapshot: VolumeSnapshot): void {
+    this.assertOk(this.exports.fatfsjs_restore_snapshot(snapshot.id), `restore snapshot ${snapshot.id}`);
+  }
+
+  releaseSnapshot(snapshot: VolumeSnapshot): void {
+    this.assertOk(this.exports.fatfsjs_release_snapshot(snapshot.id), `release snapshot ${snapshot.id}`);
+  }
+
+  snapshotBlocks(snapshot: VolumeSnapshot): number {
+    const sectors = this.exports.fatfsjs_snapshot_blocks(snapshot.id);
+    this.assertOk(sectors, `inspect snapshot ${snapshot.id}`);
+    return sectors;
+  }
+  diff(base: VolumeSnapshot | BinarySource, options: ImagePatchOptions = {}): Uint8Array {
+    const granularity = options.granularity ?? 0;
+    if (!Number.isInteger(granularity) || granularity < 0) {
+      throw new Error("granularity must be a non-negative integer");
+    }
+    const resultPtr = this.alloc(16);
+    try {
+      if (base instanceof Uint8Array || base instanceof ArrayBuffer) {
+        const image = asBinaryUint8Array(base);
+        const imagePtr = this.alloc(image.length);
+        try {
+          this.heapU8.set(image, imagePtr);
+          const result = this.exports.fatfsjs_diff_image(imagePtr, image.length, granularity, resultPtr);
+          this.assertOk(result, "diff against image");
+        } finally {
+          this.exports.free(imagePtr);
+        }
+      } else {
+        const result = this.exports.fatfsjs_diff_snapshot(base.id, granularity, resultPtr);
+        this.assertOk(result, `diff against snapshot ${base.id}`);
+      }
+      this.refreshHeap();
+      const [patchPtr, patchLen] = readPointerPair(this.heapU8.buffer, resultPtr, this.memory64);
+      try {
+        return this.heapU8.slice(patchPtr, patchPtr + patchLen);
+      } finally {
+        this.exports.free(patchPtr);
+      }
+    } finally {
+      this.exports.free(resultPtr);
+    }
+  }
+
+  applyPatch(patch: BinarySource): void {
+    const bytes = asBinaryUint8Array(patch);
+    const patchPtr = this.alloc(bytes.length);
+    try {
+      this.heapU8.set(bytes, patchPtr);
+      this.assertOk(this.exports.fatfsjs_apply_patch(patchPtr, bytes.length), "apply patch");
+    } finally {
+      this.exports.free(patchPtr);
+    }
+  }
+
+  toSparseImage(options: SparseImageOptions = {}): SparseImage {
+    const resultPtr = this.alloc(16);
+    try {
+      this.assertOk(this.exports.fatfsjs_export_sparse(sparseImageFlags(options), resultPtr), "export sparse image");
+      this.refreshHeap();
+      const [sparsePtr, sparseLen] = readPointerPair(this.heapU8.buffer, resultPtr, this.memory64);
+      try {
+        return decodeSparseImage(this.heapU8.slice(sparsePtr, sparsePtr + sparseLen));
+      } finally {
+        this.exports.free(sparsePtr);
+      }
+    } finally {
+      this.exports.free(resultPtr);
+    }
+  }
+
+
+  format(options?: FatFSFormatOptions): void {
+    applyFormatOptions(this.exports, options ? { ...this.formatOptions, ...options } : this.formatOptions);
     const result = this.exports.fatfsjs_format();
     this.assertOk(result, "format filesystem");
   }
 
-  writeFile(path: string, data: FileSource): void {
+  writeFile(path: string, data: FileSource, options: FatFSWriteOptions = {}): void {
     const normalized = normalizeMountPath(path);
     if (normalized === FAT_MOUNT) {
       throw new FatFSError("Path must point to a file", FATFS_ERR_INVAL);
     }
+    this.setClock(options.mtime ?? Date.now());
     const payload = asUint8Array(data, this.encoder);
     const pathPtr = this.allocString(normalized);
     const dataPtr = payload.length ? this.alloc(payload.length) : 0;
@@ -263,6 +586,21 @@ class FatFSClient implements FatFS {
     }
   }
 
+  delete(path: string, options?: { recursive?: boolean }): void {
+    const recursive = options?.recursive === true;
+    const normalized = normalizeMountPath(path);
+    if (normalized === FAT_MOUNT && !recursive) {
+      throw new FatFSError("Path must point to a file or directory", FATFS_ERR_INVAL);
+    }
+    const pathPtr = this.allocString(normalized);
+    try {
+      const result = this.exports.fatfsjs_remove(pathPtr, recursive ? 1 : 0);
+      this.assertOk(result, `delete "${normalized}"${recursive ? " (recursive)" : ""}`);
+    } finally {
+      this.exports.free(pathPtr);
+    }
+  }
+
   deleteFile(path: string): void {
     const normalized = normalizeMountPath(path);
     if (normalized === FAT_MOUNT) {
@@ -282,6 +620,7 @@ class FatFSClient implements FatFS {
     if (normalized === FAT_MOUNT) {
       return;
     }
+    this.setClock(Date.now());
     const pathPtr = this.allocString(normalized);
     try {
       const result = this.exports.fatfsjs_mkdir(pathPtr);
@@ -305,6 +644,86 @@ class FatFSClient implements FatFS {
     }
   }
 
+  private setClock(time: Date | number): void {
+    const result = this.exports.fatfsjs_set_time(encodeFatTime(time));
+    this.assertOk(result, "set filesystem clock");
+  }
+
+  hashBlocks<A extends HashAlgorithm>(algorithm: A, options: BlockHashOptions = {}): HashDigest<A> {
+    this.assertInMemory("hash sectors");
+    const id = hashAlgorithmId(algorithm);
+    const sectorCount = this.exports.fatfsjs_hash_blocks(id, 0, 0, 0);
+    this.assertOk(sectorCount, "hash sectors");
+    const first = options.first ?? 0;
+    const count = options.count ?? sectorCount - first;
+    return this.collectDigests(
+      algorithm,
+      count,
+      (ptr) => this.exports.fatfsjs_hash_blocks(id, first, count, ptr),
+      `hash sectors ${first}..${first + count}`
+    );
+  }
+
+  hashRange<A extends HashAlgorithm>(algorithm: A, offset: number, length: number): HashDigest<A> {
+    this.assertInMemory("hash range");
+    const id = hashAlgorithmId(algorithm);
+    return this.collectDigests(
+      algorithm,
+      1,
+      (ptr) => this.exports.fatfsjs_hash_range(id, offset, length, ptr),
+      `hash ${length} bytes at ${offset}`
+    );
+  }
+
+  hashFile<A extends HashAlgorithm>(path: string, algorithm: A): HashDigest<A> {
+    const normalized = normalizeMountPath(path);
+    if (normalized === FAT_MOUNT) {
+      throw new FatFSError("Path must point to a file", FATFS_ERR_INVAL);
+    }
+    const id = hashAlgorithmId(algorithm);
+    const pathPtr = this.allocString(normalized);
+    try {
+      return this.collectDigests(
+        algorithm,
+        1,
+        (ptr) => this.exports.fatfsjs_hash_file(id, pathPtr, ptr),
+        `hash file "${normalized}"`
+      );
+    } finally {
+      this.exports.free(pathPtr);
+    }
+  }
+
+  flush(): void {
+    this.assertOk(this.exports.fatfsjs_flush(), "flush host device");
+    this.device?.flush?.();
+  }
+
+  private collectDigests<A extends HashAlgorithm>(
+    algorithm: A,
+    count: number,
+    run: (outPtr: number) => number,
+    action: string
+  ): HashDigest<A> {
+    if (!Number.isInteger(count) || count < 0) {
+      throw new Error("count must be a non-negative integer");
+    }
+    const ptr = this.alloc(Math.max(count, 1) * digestByteLength(algorithm));
+    try {
+      this.assertOk(run(ptr), action);
+      this.refreshHeap();
+      return decodeDigests(this.heapU8.buffer, ptr, count, algorithm);
+    } finally {
+      this.exports.free(ptr);
+    }
+  }
+
+  private assertInMemory(action: string): void {
+    if (this.device) {
+      throw new FatFSError(`Unable to ${action}: the volume lives on a host device`, FATFS_ERR_INVAL);
+    }
+  }
+
   private refreshHeap(): void {
     if (this.heapU8.buffer !== this.exports.memory.buffer) {
       this.heapU8 = new Uint8Array(this.exports.memory.buffer);
@@ -338,10 +757,14 @@ class FatFSClient implements FatFS {
   }
 }
 
-async function instantiateFatFSModule(input: string | URL): Promise<FatFSExports> {
+async function instantiateFatFSModule(
+  input: string | URL,
+  memory64: boolean,
+  device: HostBlockDevice | null = null
+): Promise<FatFSExports> {
   const source = resolveWasmURL(input);
   console.info("[fatfs-wasm] Fetching wasm from", source.href);
-  const wasmContext: WasmContext = { memory: null };
+  const wasmContext: WasmContext = { memory: null, memory64, device, blockSize: DEFAULT_BLOCK_SIZE };
   const imports: WebAssembly.Imports = createDefaultImports(wasmContext);
 
   let response = await fetch(source);
@@ -356,7 +779,7 @@ async function instantiateFatFSModule(input: string | URL): Promise<FatFSExports
       const streaming = await WebAssembly.instantiateStreaming(response, imports);
       wasmContext.memory = getExportedMemory(streaming.instance.exports);
       console.info("[fatfs-wasm] instantiateStreaming succeeded");
-      return streaming.instance.exports as unknown as FatFSExports;
+      return adaptExports<FatFSExports>(streaming.instance.exports, memory64, FATFS_POINTER_ARGS);
     } catch (error) {
       console.warn(
         "Unable to instantiate FATFS wasm via streaming, retrying with arrayBuffer()",
@@ -375,7 +798,56 @@ async function instantiateFatFSModule(input: string | URL): Promise<FatFSExports
   const instance = await WebAssembly.instantiate(bytes, imports);
   wasmContext.memory = getExportedMemory(instance.instance.exports);
   console.info("[fatfs-wasm] instantiate(bytes) succeeded");
-  return instance.instance.exports as unknown as FatFSExports;
+  return adaptExports<FatFSExports>(instance.instance.exports, memory64, FATFS_POINTER_ARGS);
+}
+
+function defaultWasmURL(options: FatFSOptions): URL {
+  const simd = useSimd(options);
+  if (options.memory64) {
+    return simd ? new URL("./fatfs64-simd.wasm", import.meta.url) : new URL("./fatfs64.wasm", import.meta.url);
+  }
+  if (options.variant === "exfat") {
+    return simd
+      ? new URL("./fatfs-exfat-simd.wasm", import.meta.url)
+      : new URL("./fatfs-exfat.wasm", import.meta.url);
+  }
+  return simd ? new URL("./fatfs-simd.wasm", import.meta.url) : new URL("./fatfs.wasm", import.meta.url);
+}
+
+function resolveFormatOptions(options: FatFSOptions): FatFSFormatOptions {
+  return {
+    type: options.variant === "exfat" ? "exfat" : "fat",
+    ...options.format,
+  };
+}
+
+function enableIoStats(exports: FatFSExports, options: FatFSOptions): void {
+  if (options.ioStats) {
+    const result = exports.fatfsjs_set_io_stats(1);
+    if (result < 0) {
+      throw new FatFSError("Failed to enable I/O statistics", result);
+    }
+  }
+}
+
+function applyFormatOptions(exports: FatFSExports, options: FatFSFormatOptions): void {
+  const type = options.type ?? "fat";
+  const fmt = FORMAT_TYPE_FLAGS[type];
+  if (fmt === undefined) {
+    throw new FatFSError(`Unknown format type "${type}"`, FATFS_ERR_INVAL);
+  }
+  if (type === "exfat" && !(exports.fatfsjs_features() & FATFS_FEATURE_EXFAT)) {
+    throw new FatFSError('exFAT needs the "exfat" variant (fatfs-exfat.wasm)', FATFS_ERR_INVAL);
+  }
+  const result = exports.fatfsjs_set_format_options(
+    fmt,
+    options.clusterSize ?? 0,
+    options.fatCopies ?? 0,
+    options.rootEntries ?? 0
+  );
+  if (result < 0) {
+    throw new FatFSError("Invalid format options", result);
+  }
 }
 
 function parseListPayload(payload: string): FatFSEntry[] {
@@ -386,15 +858,44 @@ function parseListPayload(payload: string): FatFSEntry[] {
     .split("\n")
     .filter((line) => line.length > 0)
     .map((line) => {
-      const [rawPath, rawSize, rawType] = line.split("\t");
+      const [rawPath, rawSize, rawType, rawMtime] = line.split("\t");
       return {
         path: rawPath ?? "",
         size: Number(rawSize ?? "0") || 0,
         type: rawType === "d" ? "dir" : "file",
+        mtime: decodeFatTime(Number(rawMtime ?? "0") || 0),
       };
     });
 }
 
+// FAT stores local time in 2-second steps between 1980 and 2107.
+function encodeFatTime(time: Date | number): number {
+  const date = time instanceof Date ? time : new Date(time);
+  if (Number.isNaN(date.getTime())) {
+    throw new FatFSError("Invalid timestamp", FATFS_ERR_INVAL);
+  }
+  const year = Math.min(Math.max(date.getFullYear(), 1980), 2107);
+  const fdate = ((year - 1980) << 9) | ((date.getMonth() + 1) << 5) | date.getDate();
+  const ftime = (date.getHours() << 11) | (date.getMinutes() << 5) | (date.getSeconds() >> 1);
+  return ((fdate << 16) | ftime) >>> 0;
+}
+
+function decodeFatTime(packed: number): number {
+  const fdate = (packed >>> 16) & 0xffff;
+  const ftime = packed & 0xffff;
+  if (fdate === 0) {
+    return 0;
+  }
+  return new Date(
+    (fdate >>> 9) + 1980,
+    ((fdate >>> 5) & 0x0f) - 1,
+    fdate & 0x1f,
+    ftime >>> 11,
+    (ftime >>> 5) & 0x3f,
+    (ftime & 0x1f) * 2
+  ).getTime();
+}
+
 function normalizeMountPath(input?: string): string {
   const raw = (input ?? "").trim();
   if (!raw || raw === "/") {
@@ -466,6 +967,9 @@ function resolveWasmURL(input: string | URL): URL {
 
 interface WasmContext {
   memory: WebAssembly.Memory | null;
+  memory64: boolean;
+  device: HostBlockDevice | null;
+  blockSize: number;
 }
 
 function createDefaultImports(context: WasmContext): WebAssembly.Imports {
@@ -475,11 +979,12 @@ function createDefaultImports(context: WasmContext): WebAssembly.Imports {
   return {
     env: {
       emscripten_notify_memory_growth: noop,
+      ...hostDeviceImports(context, "fatfsjs"),
     },
     wasi_snapshot_preview1: {
       fd_close: ok,
       fd_seek: ok,
-      fd_write: (fd: number, iov: number, iovcnt: number, pnum: number) =>
+      fd_write: (fd: number, iov: number | bigint, iovcnt: number | bigint, pnum: number | bigint) =>
         handleFdWrite(context, fd, iov, iovcnt, pnum),
     },
   };
@@ -488,31 +993,24 @@ function createDefaultImports(context: WasmContext): WebAssembly.Imports {
 function handleFdWrite(
   context: WasmContext,
   fd: number,
-  iov: number,
-  iovcnt: number,
-  pnum: number
+  iov: number | bigint,
+  iovcnt: number | bigint,
+  pnum: number | bigint
 ): number {
   const memory = context.memory;
   if (!memory) {
     return 0;
   }
 
-  const view = new DataView(memory.buffer);
-  let total = 0;
-  for (let i = 0; i < iovcnt; i++) {
-    const base = iov + i * 8;
-    const ptr = view.getUint32(base, true);
-    const len = view.getUint32(base + 4, true);
-    total += len;
-
+  const total = sumIovecs(memory.buffer, iov, iovcnt, context.memory64, (ptr, len) => {
     if (fd === 1 || fd === 2) {
       const bytes = new Uint8Array(memory.buffer, ptr, len);
       const text = new TextDecoder().decode(bytes);
       console.info(`[fatfs-wasm::fd_write fd=${fd}] ${text}`);
     }
-  }
+  });
 
-  view.setUint32(pnum, total, true);
+  writeSize(memory.buffer, pnum, total, context.memory64);
   return 0;
 }
 
@@ -4,4 +4,20 @@ export * from "./fatfs/index";
 export * as fatfs from "./fatfs/index";
 export * from "./spiffs/index";
 export * as spiffs from "./spiffs/index";
-export type { FileSource } from "./shared/types";
+export type {
+  BlockHashOptions,
+  CompressedImageSource,
+  FileSource,
+  HashAlgorithm,
+  HashDigest,
+  HostBlockDevice,
+  HostDeviceOptions,
+  ImageCompression,
+  ImagePatchOptions,
+  ImageStreamOptions,
+  IoStats,
+  SparseExtent,
+  SparseImage,
+  SparseImageOptions,
+  VolumeSnapshot,
+} from "./shared/types";
@@ -1,10 +1,58 @@
-import type { FileSource, BinarySource, FileSystemUsage } from "../shared/types";
+import type {
+  FileSource,
+  BinarySource,
+  BlockHashOptions,
+  CompressedImageSource,
+  FileSystemUsage,
+  HashAlgorithm,
+  HashDigest,
+  HostBlockDevice,
+  HostDeviceOptions,
+  ImagePatchOptions,
+  ImageStreamOptions,
+  IoStats,
+  SparseImage,
+  SparseImageOptions,
+  VolumeSnapshot,
+} from "../shared/types";
+import { decodeDigests, digestByteLength, hashAlgorithmId } from "../shared/hash";
+import { hostCacheGeometry, hostDeviceImports } from "../shared/host-device";
+import { compressImage, decompressImage } from "../shared/image-stream";
+import { decodeIoStats, ioStatsByteLength } from "../shared/io-stats";
+import { adaptExports, readPointerPair, sumIovecs, writeSize, type PointerArgs } from "../shared/memory64";
+import { useSimd } from "../shared/simd";
+import { decodeSparseImage, sparseImageFlags } from "../shared/sparse-image";
 
 const DEFAULT_BLOCK_SIZE = 512;
 const DEFAULT_BLOCK_COUNT = 512;
-const DEFAULT_LOOKAHEAD_SIZE = 32;
+const AUTO_LOOKAHEAD_SIZE = 0;
 const INITIAL_LIST_BUFFER = 4096;
 const LFS_ERR_NOSPC = -28;
+const LFS_ERR_INVAL = -22;
+const LFS_POINTER_ARGS: PointerArgs = {
+  lfsjs_init_from_image: [3, 4],
+  lfsjs_list: [0, 1],
+  lfsjs_add_file: [0, 1],
+  lfsjs_append_file: [0, 1],
+  lfsjs_append_batch: [0, 1],
+  lfsjs_delete_file: [0],
+  lfsjs_remove: [0],
+  lfsjs_mkdir: [0],
+  lfsjs_rename: [0, 1],
+  lfsjs_file_size: [0],
+  lfsjs_read_file: [0, 1],
+  lfsjs_export_image: [0, 1],
+  lfsjs_get_io_stats: [0],
+  lfsjs_diff_snapshot: [2],
+  lfsjs_diff_image: [0, 1, 3],
+  lfsjs_apply_patch: [0],
+  lfsjs_export_sparse: [1],
+  lfsjs_hash_blocks: [3],
+  lfsjs_hash_range: [1, 2, 3],
+  lfsjs_hash_file: [1, 2],
+  malloc: [0],
+  free: [0],
+};
 
 export interface LittleFSEntry {
   path: string;
@@ -12,9 +60,17 @@ export interface LittleFSEntry {
   type: "file" | "dir";
 }
 
+export interface LittleFSAppendEntry {
+  path: string;
+  data: FileSource;
+}
+
 export interface LittleFSOptions {
   blockSize?: number;
   blockCount?: number;
+  /**
+   * Lookahead bitmap size in bytes. Defaults to covering the whole device (blockCount / 8).
+   */
   lookaheadSize?: number;
   /**
    * Optional override for the wasm asset location. Useful when bundlers move files.
@@ -24,6 +80,18 @@ export interface LittleFSOptions {
    * Formats the filesystem immediately after initialization.
    */
   formatOnInit?: boolean;
+  /**
+   * Counts erases, programmed bytes and read bytes per block (see getIoStats).
+   */
+  ioStats?: boolean;
+  /**
+   * Loads the memory64 build (littlefs64.wasm) so RAM-backed volumes can grow past 4 GB.
+   */
+  memory64?: boolean;
+  /**
+   * Set to false to load the scalar module even where the runtime supports SIMD128.
+   */
+  simd?: boolean;
 }
 
 export interface LittleFS {
@@ -31,13 +99,29 @@ export interface LittleFS {
   list(path?: string): LittleFSEntry[];
   addFile(path: string, data: FileSource): void;
   writeFile(path: string, data: FileSource): void;
+  appendFile(path: string, data: FileSource): void;
+  appendFiles(entries: LittleFSAppendEntry[]): void;
   deleteFile(path: string): void; // backward-compat alias
   delete(path: string, options?: { recursive?: boolean }): void;
   mkdir(path: string): void;
   rename(oldPath: string, newPath: string): void;
   toImage(): Uint8Array;
+  toCompressedStream(options?: ImageStreamOptions): ReadableStream<Uint8Array>;
   readFile(path: string): Uint8Array;
   getUsage(): FileSystemUsage;
+  getIoStats(): IoStats | null;
+  resetIoStats(): void;
+  snapshot(): VolumeSnapshot;
+  restore(snapshot: VolumeSnapshot): void;
+  releaseSnapshot(snapshot: VolumeSnapshot): void;
+  snapshotBlocks(snapshot: VolumeSnapshot): number;
+  diff(base: VolumeSnapshot | BinarySource, options?: ImagePatchOptions): Uint8Array;
+  applyPatch(patch: BinarySource): void;
+  toSparseImage(options?: SparseImageOptions): SparseImage;
+  hashBlocks<A extends HashAlgorithm>(algorithm: A, options?: BlockHashOptions): HashDigest<A>;
+  hashRange<A extends HashAlgorithm>(algorithm: A, offset: number, length: number): HashDigest<A>;
+  hashFile<A extends HashAlgorithm>(path: string, algorithm: A): HashDigest<A>;
+  flush(): void;
 }
 
 interface LittleFSExports {
@@ -53,6 +137,8 @@ interface LittleFSExports {
   lfsjs_format(): number;
   lfsjs_list(pathPtr: number, bufferPtr: number, bufferLen: number): number;
   lfsjs_add_file(pathPtr: number, dataPtr: number, dataLen: number): number;
+  lfsjs_append_file(pathPtr: number, dataPtr: number, dataLen: number): number;
+  lfsjs_append_batch(manifestPtr: number, dataPtr: number, dataLen: number): number;
   lfsjs_delete_file(pathPtr: number): number;
   lfsjs_remove(pathPtr: number, recursive: number): number;
   lfsjs_mkdir(pathPtr: number): number;
@@ -61,6 +147,32 @@ interface LittleFSExports {
   lfsjs_read_file(pathPtr: number, bufferPtr: number, bufferLen: number): number;
   lfsjs_export_image(bufferPtr: number, bufferLen: number): number;
   lfsjs_storage_size(): number;
+  lfsjs_storage_ptr(): number;
+  lfsjs_import_begin(blockSize: number, blockCount: number, lookaheadSize: number): number;
+  lfsjs_import_end(): number;
+  lfsjs_init_host(
+    blockSize: number,
+    blockCount: number,
+    lookaheadSize: number,
+    cacheBlocks: number,
+    readAheadBlocks: number,
+    format: number
+  ): number;
+  lfsjs_flush(): number;
+  lfsjs_set_io_stats(enabled: number): number;
+  lfsjs_reset_io_stats(): number;
+  lfsjs_get_io_stats(bufferPtr: number, bufferLen: number): number;
+  lfsjs_snapshot(): number;
+  lfsjs_restore_snapshot(id: number): number;
+  lfsjs_release_snapshot(id: number): number;
+  lfsjs_snapshot_blocks(id: number): number;
+  lfsjs_diff_snapshot(id: number, granularity: number, resultPtr: number): number;
+  lfsjs_diff_image(imagePtr: number, imageLen: number, granularity: number, resultPtr: number): number;
+  lfsjs_apply_patch(patchPtr: number, patchLen: number): number;
+  lfsjs_export_sparse(flags: number, resultPtr: number): number;
+  lfsjs_hash_blocks(algorithm: number, first: number, count: number, outPtr: number): number;
+  lfsjs_hash_range(algorithm: number, offset: number, length: number, outPtr: number): number;
+  lfsjs_hash_file(algorithm: number, pathPtr: number, outPtr: number): number;
   malloc(size: number): number;
   free(ptr: number): void;
 }
@@ -77,13 +189,14 @@ export class LittleFSError extends Error {
 
 export async function createLittleFS(options: LittleFSOptions = {}): Promise<LittleFS> {
   console.info("[littlefs-wasm] createLittleFS() starting", options);
-  const wasmURL = options.wasmURL ?? new URL("./littlefs.wasm", import.meta.url);
-  const exports = await instantiateLittleFSModule(wasmURL);
+  const wasmURL = options.wasmURL ?? defaultWasmURL(options);
+  const exports = await instantiateLittleFSModule(wasmURL, options.memory64 === true);
 
   const blockSize = options.blockSize ?? DEFAULT_BLOCK_SIZE;
   const blockCount = options.blockCount ?? DEFAULT_BLOCK_COUNT;
-  const lookaheadSize = options.lookaheadSize ?? DEFAULT_LOOKAHEAD_SIZE;
+  const lookaheadSize = options.lookaheadSize ?? AUTO_LOOKAHEAD_SIZE;
 
+  enableIoStats(exports, options);
   console.info("[littlefs-wasm] Calling lfsjs_init with", {
     blockSize,
     blockCount,
@@ -105,15 +218,15 @@ export async function createLittleFS(options: LittleFSOptions = {}): Promise<Lit
   }
 
   console.info("[littlefs-wasm] Filesystem initialized");
-  const client = new LittleFSClient(exports);
+  const client = new LittleFSClient(exports, options.memory64 === true);
   client.refreshStorageSize();
   return client;
 }
 
 export async function createLittleFSFromImage(image: BinarySource, options: LittleFSOptions = {}): Promise<LittleFS> {
   console.info("[littlefs-wasm] createLittleFSFromImage() starting");
-  const wasmURL = options.wasmURL ?? new URL("./littlefs.wasm", import.meta.url);
-  const exports = await instantiateLittleFSModule(wasmURL);
+  const wasmURL = options.wasmURL ?? defaultWasmURL(options);
+  const exports = await instantiateLittleFSModule(wasmURL, options.memory64 === true);
   const bytes = asBinaryUint8Array(image);
 
   const blockSize = options.blockSize ?? DEFAULT_BLOCK_SIZE;
@@ -125,30 +238,88 @@ export async function createLittleFSFromImage(image: BinarySource, options: Litt
   if (blockCount * blockSize !== bytes.length) {
     throw new Error("Image size must equal blockSize * blockCount");
   }
-  const lookaheadSize = options.lookaheadSize ?? DEFAULT_LOOKAHEAD_SIZE;
+  const lookaheadSize = options.lookaheadSize ?? AUTO_LOOKAHEAD_SIZE;
+  enableIoStats(exports, options);
 
-  const heap = new Uint8Array(exports.memory.buffer);
-  const imagePtr = exports.malloc(bytes.length || 1);
-  if (!imagePtr) {
-    throw new LittleFSError("Failed to allocate WebAssembly memory", LFS_ERR_NOSPC);
+  const beginResult = exports.lfsjs_import_begin(blockSize, blockCount, lookaheadSize);
+  if (beginResult < 0) {
+    throw new LittleFSError("Failed to initialize LittleFS from image", beginResult);
   }
-
-  try {
-    heap.set(bytes, imagePtr);
-    const initResult = exports.lfsjs_init_from_image(blockSize, blockCount, lookaheadSize, imagePtr, bytes.length);
-    if (initResult < 0) {
-      throw new LittleFSError("Failed to initialize LittleFS from image", initResult);
-    }
-  } finally {
-    exports.free(imagePtr);
+  new Uint8Array(exports.memory.buffer).set(bytes, exports.lfsjs_storage_ptr());
+  const initResult = exports.lfsjs_import_end();
+  if (initResult < 0) {
+    throw new LittleFSError("Failed to initialize LittleFS from image", initResult);
   }
 
-  const client = new LittleFSClient(exports);
+  const client = new LittleFSClient(exports, options.memory64 === true);
   client.refreshStorageSize();
   console.info("[littlefs-wasm] Filesystem initialized from image");
   return client;
 }
 
+export async function createLittleFSFromCompressedImage(
+  source: CompressedImageSource,
+  options: LittleFSOptions & ImageStreamOptions = {}
+): Promise<LittleFS> {
+  console.info("[littlefs-wasm] createLittleFSFromCompressedImage() starting");
+  const wasmURL = options.wasmURL ?? defaultWasmURL(options);
+  const exports = await instantiateLittleFSModule(wasmURL, options.memory64 === true);
+
+  const blockSize = options.blockSize ?? DEFAULT_BLOCK_SIZE;
+  const blockCount = options.blockCount ?? DEFAULT_BLOCK_COUNT;
+  const lookaheadSize = options.lookaheadSize ?? AUTO_LOOKAHEAD_SIZE;
+  enableIoStats(exports, options);
+
+  const beginResult = exports.lfsjs_import_begin(blockSize, blockCount, lookaheadSize);
+  if (beginResult < 0) {
+    throw new LittleFSError("Failed to initialize LittleFS from image", beginResult);
+  }
+  await decompressImage(
+    source,
+    blockSize * blockCount,
+    (offset, chunk) => new Uint8Array(exports.memory.buffer).set(chunk, exports.lfsjs_storage_ptr() + offset),
+    options
+  );
+  const initResult = exports.lfsjs_import_end();
+  if (initResult < 0) {
+    throw new LittleFSError("Failed to initialize LittleFS from image", initResult);
+  }
+
+  const client = new LittleFSClient(exports, options.memory64 === true);
+  client.refreshStorageSize();
+  console.info("[littlefs-wasm] Filesystem initialized from compressed image");
+  return client;
+}
+
+export async function createLittleFSOnDevice(
+  device: HostBlockDevice,
+  options: LittleFSOptions & HostDeviceOptions = {}
+): Promise<LittleFS> {
+  console.info("[littlefs-wasm] createLittleFSOnDevice() starting");
+  const wasmURL = options.wasmURL ?? defaultWasmURL(options);
+  const blockSize = options.blockSize ?? DEFAULT_BLOCK_SIZE;
+  const blockCount = options.blockCount ?? DEFAULT_BLOCK_COUNT;
+  const lookaheadSize = options.lookaheadSize ?? AUTO_LOOKAHEAD_SIZE;
+  const [cacheBlocks, readAheadBlocks] = hostCacheGeometry(options);
+  const exports = await instantiateLittleFSModule(wasmURL, options.memory64 === true, device, blockSize);
+  enableIoStats(exports, options);
+
+  const initResult = exports.lfsjs_init_host(
+    blockSize,
+    blockCount,
+    lookaheadSize,
+    cacheBlocks,
+    readAheadBlocks,
+    options.formatOnInit ? 1 : 0
+  );
+  if (initResult < 0) {
+    throw new LittleFSError("Failed to mount LittleFS on the host device", initResult);
+  }
+
+  console.info("[littlefs-wasm] Filesystem mounted on host device");
+  return new LittleFSClient(exports, options.memory64 === true, device, blockSize * blockCount);
+}
+
 class LittleFSClient implements LittleFS {
   private readonly exports: LittleFSExports;
   private heapU8: Uint8Array;
@@ -156,9 +327,15 @@ class LittleFSClient implements LittleFS {
   private readonly decoder = new TextDecoder();
   private listBufferSize = INITIAL_LIST_BUFFER;
   private storageSize = 0;
+  private readonly memory64: boolean;
+  private readonly device: HostBlockDevice | null;
+  private readonly deviceBytes: number;
 
-  constructor(exports: LittleFSExports) {
+  constructor(exports: LittleFSExports, memory64: boolean, device: HostBlockDevice | null = null, deviceBytes = 0) {
     this.exports = exports;
+    this.memory64 = memory64;
+    this.device = device;
+    this.deviceBytes = deviceBytes;
     this.heapU8 = new Uint8Array(this.exports.memory.buffer);
     this.refreshStorageSize();
   }
@@ -215,6 +392,69 @@ class LittleFSClient implements LittleFS {
     }
   }
 
+  appendFile(path: string, data: FileSource): void {
+    const normalizedPath = normalizePath(path);
+    const payload = asUint8Array(data, this.encoder);
+
+    const pathPtr = this.allocString(normalizedPath);
+    const dataPtr = this.alloc(payload.length);
+
+    try {
+      this.heapU8.set(payload, dataPtr);
+      const result = this.exports.lfsjs_append_file(pathPtr, dataPtr, payload.length);
+      this.assertOk(result, `append to file at "${normalizedPath}"`);
+    } finally {
+      this.exports.free(dataPtr);
+      this.exports.free(pathPtr);
+    }
+  }
+
+  appendFiles(entries: LittleFSAppendEntry[]): void {
+    const grouped = new Map<string, Uint8Array[]>();
+    let total = 0;
+    for (const entry of entries) {
+      const normalizedPath = normalizePath(entry.path);
+      if (/[\t\n]/.test(normalizedPath)) {
+        throw new Error(`Invalid path "${entry.path}"`);
+      }
+      const payload = asUint8Array(entry.data, this.encoder);
+      const parts = grouped.get(normalizedPath);
+      if (parts) {
+        parts.push(payload);
+      } else {
+        grouped.set(normalizedPath, [payload]);
+      }
+      total += payload.length;
+    }
+    if (grouped.size === 0) {
+      return;
+    }
+
+    const dataPtr = this.alloc(total);
+    let manifest = "";
+    try {
+      let offset = dataPtr;
+      for (const [normalizedPath, parts] of grouped) {
+        let length = 0;
+        for (const part of parts) {
+          this.heapU8.set(part, offset);
+          offset += part.length;
+          length += part.length;
+        }
+        manifest += `${normalizedPath}\t${length}\n`;
+      }
+      const manifestPtr = this.allocString(manifest);
+      try {
+        const result = this.exports.lfsjs_append_batch(manifestPtr, dataPtr, total);
+        this.assertOk(result, "append to files");
+      } finally {
+        this.exports.free(manifestPtr);
+      }
+    } finally {
+      this.exports.free(dataPtr);
+    }
+  }
+
   delete(path: string, options?: { recursive?: boolean }): void {
     const recursive = options?.recursive === true;
     const normalizedPath = normalizePath(path);
@@ -257,6 +497,7 @@ class LittleFSClient implements LittleFS {
   }
 
   toImage(): Uint8Array {
+    this.assertInMemory("export filesystem image");
     const size = this.ensureStorageSize();
     if (size === 0) {
       return new Uint8Array();
@@ -271,8 +512,22 @@ class LittleFSClient implements LittleFS {
     }
   }
 
+  toCompressedStream(options: ImageStreamOptions = {}): ReadableStream<Uint8Array> {
+    this.assertInMemory("stream filesystem image");
+    const size = this.ensureStorageSize();
+    return compressImage(
+      (offset, length) => {
+        this.refreshHeap();
+        const ptr = this.exports.lfsjs_storage_ptr() + offset;
+        return this.heapU8.slice(ptr, ptr + length);
+      },
+      size,
+      options
+    );
+  }
+
   getUsage(): FileSystemUsage {
-    const capacityBytes = this.ensureStorageSize();
+    const capacityBytes = this.device ? this.deviceBytes : this.ensureStorageSize();
     const entries = this.list("/");
     const usedBytes = entries.reduce((acc, entry) => (entry.type === "file" ? acc + entry.size : acc), 0);
     const freeBytes = capacityBytes > usedBytes ? capacityBytes - usedBytes : 0;
@@ -283,6 +538,105 @@ class LittleFSClient implements LittleFS {
     };
   }
 
+  getIoStats(): IoStats | null {
+    const blockCount = this.exports.lfsjs_get_io_stats(0, 0);
+    if (blockCount < 0) {
+      return null;
+    }
+    const byteLength = ioStatsByteLength(blockCount);
+    const ptr = this.alloc(byteLength);
+    try {
+      this.assertOk(this.exports.lfsjs_get_io_stats(ptr, byteLength), "read I/O statistics");
+      return decodeIoStats(this.heapU8.buffer, ptr, blockCount);
+    } finally {
+      this.exports.free(ptr);
+    }
+  }
+
+  resetIoStats(): void {
+    this.assertOk(this.exports.lfsjs_reset_io_stats(), "reset I/O statistics");
+  }
+
+  snapshot(): VolumeSnapshot {
+    const id = this.exports.lfsjs_snapshot();
+    this.assertOk(id, "take snapshot");
+    return { id };
+  }
+
+  restore(snapshot: VolumeSnapshot): void {
+    this.assertOk(this.exports.lfsjs_restore_snapshot(snapshot.id), `restore snapshot ${snapshot.id}`);
+  }
+
+  releaseSnapshot(snapshot: VolumeSnapshot): void {
+    this.assertOk(this.exports.lfsjs_release_snapshot(snapshot.id), `release snapshot ${snapshot.id}`);
+  }
+
+  snapshotBlocks(snapshot: VolumeSnapshot): number {
+    const blocks = this.exports.lfsjs_snapshot_blocks(snapshot.id);
+    this.assertOk(blocks, `inspect snapshot ${snapshot.id}`);
+    return blocks;
+  }
+  diff(base: VolumeSnapshot | BinarySource, options: ImagePatchOptions = {}): Uint8Array {
+    const granularity = options.granularity ?? 0;
+    if (!Number.isInteger(granularity) || granularity < 0) {
+      throw new Error("granularity must be a non-negative integer");
+    }
+    const resultPtr = this.alloc(16);
+    try {
+      if (base instanceof Uint8Array || base instanceof ArrayBuffer) {
+        const image = asBinaryUint8Array(base);
+        const imagePtr = this.alloc(image.length);
+        try {
+          this.heapU8.set(image, imagePtr);
+          const result = this.exports.lfsjs_diff_image(imagePtr, image.length, granularity, resultPtr);
+          this.assertOk(result, "diff against image");
+        } finally {
+          this.exports.free(imagePtr);
+        }
+      } else {
+        const result = this.exports.lfsjs_diff_snapshot(base.id, granularity, resultPtr);
+        this.assertOk(result, `diff against snapshot ${base.id}`);
+      }
+      this.refreshHeap();
+      const [patchPtr, patchLen] = readPointerPair(this.heapU8.buffer, resultPtr, this.memory64);
+      try {
+        return this.heapU8.slice(patchPtr, patchPtr + patchLen);
+      } finally {
+        this.exports.free(patchPtr);
+      }
+    } finally {
+      this.exports.free(resultPtr);
+    }
+  }
+
+  applyPatch(patch: BinarySource): void {
+    const bytes = asBinaryUint8Array(patch);
+    const patchPtr = this.alloc(bytes.length);
+    try {
+      this.heapU8.set(bytes, patchPtr);
+      this.assertOk(this.exports.lfsjs_apply_patch(patchPtr, bytes.length), "apply patch");
+    } finally {
+      this.exports.free(patchPtr);
+    }
+  }
+
+  toSparseImage(options: SparseImageOptions = {}): SparseImage {
+    const resultPtr = this.alloc(16);
+    try {
+      this.assertOk(this.exports.lfsjs_export_sparse(sparseImageFlags(options), resultPtr), "export sparse image");
+      this.refreshHeap();
+      const [sparsePtr, sparseLen] = readPointerPair(this.heapU8.buffer, resultPtr, this.memory64);
+      try {
+        return decodeSparseImage(this.heapU8.slice(sparsePtr, sparsePtr + sparseLen));
+      } finally {
+        this.exports.free(sparsePtr);
+      }
+    } finally {
+      this.exports.free(resultPtr);
+    }
+  }
+
+
   readFile(path: string): Uint8Array {
     const normalizedPath = normalizePath(path);
     const pathPtr = this.allocString(normalizedPath);
@@ -306,6 +660,78 @@ class LittleFSClient implements LittleFS {
     }
   }
 
+  hashBlocks<A extends HashAlgorithm>(algorithm: A, options: BlockHashOptions = {}): HashDigest<A> {
+    this.assertInMemory("hash blocks");
+    const id = hashAlgorithmId(algorithm);
+    const blockCount = this.exports.lfsjs_hash_blocks(id, 0, 0, 0);
+    this.assertOk(blockCount, "hash blocks");
+    const first = options.first ?? 0;
+    const count = options.count ?? blockCount - first;
+    return this.collectDigests(
+      algorithm,
+      count,
+      (ptr) => this.exports.lfsjs_hash_blocks(id, first, count, ptr),
+      `hash blocks ${first}..${first + count}`
+    );
+  }
+
+  hashRange<A extends HashAlgorithm>(algorithm: A, offset: number, length: number): HashDigest<A> {
+    this.assertInMemory("hash range");
+    const id = hashAlgorithmId(algorithm);
+    return this.collectDigests(
+      algorithm,
+      1,
+      (ptr) => this.exports.lfsjs_hash_range(id, offset, length, ptr),
+      `hash ${length} bytes at ${offset}`
+    );
+  }
+
+  hashFile<A extends HashAlgorithm>(path: string, algorithm: A): HashDigest<A> {
+    const normalizedPath = normalizePath(path);
+    const id = hashAlgorithmId(algorithm);
+    const pathPtr = this.allocString(normalizedPath);
+    try {
+      return this.collectDigests(
+        algorithm,
+        1,
+        (ptr) => this.exports.lfsjs_hash_file(id, pathPtr, ptr),
+        `hash file "${normalizedPath}"`
+      );
+    } finally {
+      this.exports.free(pathPtr);
+    }
+  }
+
+  flush(): void {
+    this.assertOk(this.exports.lfsjs_flush(), "flush host device");
+    this.device?.flush?.();
+  }
+
+  private collectDigests<A extends HashAlgorithm>(
+    algorithm: A,
+    count: number,
+    run: (outPtr: number) => number,
+    action: string
+  ): HashDigest<A> {
+    if (!Number.isInteger(count) || count < 0) {
+      throw new Error("count must be a non-negative integer");
+    }
+    const ptr = this.alloc(Math.max(count, 1) * digestByteLength(algorithm));
+    try {
+      this.assertOk(run(ptr), action);
+      this.refreshHeap();
+      return decodeDigests(this.heapU8.buffer, ptr, count, algorithm);
+    } finally {
+      this.exports.free(ptr);
+    }
+  }
+
+  private assertInMemory(action: string): void {
+    if (this.device) {
+      throw new LittleFSError(`Unable to ${action}: the volume lives on a host device`, LFS_ERR_INVAL);
+    }
+  }
+
   private refreshHeap(): void {
     if (this.heapU8.buffer !== this.exports.memory.buffer) {
       this.heapU8 = new Uint8Array(this.exports.memory.buffer);
@@ -353,10 +779,36 @@ class LittleFSClient implements LittleFS {
   }
 }
 
-async function instantiateLittleFSModule(input: string | URL): Promise<LittleFSExports> {
+function enableIoStats(exports: LittleFSExports, options: LittleFSOptions): void {
+  if (options.ioStats) {
+    const result = exports.lfsjs_set_io_stats(1);
+    if (result < 0) {
+      throw new LittleFSError("Failed to enable I/O statistics", result);
+    }
+  }
+}
+
+function defaultWasmURL(options: LittleFSOptions): URL {
+  const simd = useSimd(options);
+  if (options.memory64) {
+    return simd
+      ? new URL("./littlefs64-simd.wasm", import.meta.url)
+      : new URL("./littlefs64.wasm", import.meta.url);
+  }
+  return simd
+    ? new URL("./littlefs-simd.wasm", import.meta.url)
+    : new URL("./littlefs.wasm", import.meta.url);
+}
+
+async function instantiateLittleFSModule(
+  input: string | URL,
+  memory64: boolean,
+  device: HostBlockDevice | null = null,
+  blockSize = 0
+): Promise<LittleFSExports> {
   const source = resolveWasmURL(input);
   console.info("[littlefs-wasm] Fetching wasm from", source.href);
-  const wasmContext: WasmContext = { memory: null };
+  const wasmContext: WasmContext = { memory: null, memory64, device, blockSize };
   const imports: WebAssembly.Imports = createDefaultImports(wasmContext);
   let response = await fetch(source);
   if (!response.ok) {
@@ -370,7 +822,7 @@ async function instantiateLittleFSModule(input: string | URL): Promise<LittleFSE
       const streaming = await WebAssembly.instantiateStreaming(response, imports);
       wasmContext.memory = getExportedMemory(streaming.instance.exports);
       console.info("[littlefs-wasm] instantiateStreaming succeeded");
-      return streaming.instance.exports as unknown as LittleFSExports;
+      return adaptExports<LittleFSExports>(streaming.instance.exports, memory64, LFS_POINTER_ARGS);
     } catch (error) {
       console.warn("Unable to instantiate LittleFS wasm via streaming, retrying with arrayBuffer()", error);
       response = await fetch(source);
@@ -386,7 +838,7 @@ async function instantiateLittleFSModule(input: string | URL): Promise<LittleFSE
   const instance = await WebAssembly.instantiate(bytes, imports);
   wasmContext.memory = getExportedMemory(instance.instance.exports);
   console.info("[littlefs-wasm] instantiate(bytes) succeeded");
-  return instance.instance.exports as unknown as LittleFSExports;
+  return adaptExports<LittleFSExports>(instance.instance.exports, memory64, LFS_POINTER_ARGS);
 }
 
 function parseListPayload(payload: string): LittleFSEntry[] {
@@ -472,6 +924,9 @@ function resolveWasmURL(input: string | URL): URL {
 
 interface WasmContext {
   memory: WebAssembly.Memory | null;
+  memory64: boolean;
+  device: HostBlockDevice | null;
+  blockSize: number;
 }
 
 function createDefaultImports(context: WasmContext): WebAssembly.Imports {
@@ -480,12 +935,13 @@ function createDefaultImports(context: WasmContext): WebAssembly.Imports {
 
   return {
     env: {
-      emscripten_notify_memory_growth: noop
+      emscripten_notify_memory_growth: noop,
+      ...hostDeviceImports(context, "lfsjs")
     },
     wasi_snapshot_preview1: {
       fd_close: ok,
       fd_seek: ok,
-      fd_write: (fd: number, iov: number, iovcnt: number, pnum: number) =>
+      fd_write: (fd: number, iov: number | bigint, iovcnt: number | bigint, pnum: number | bigint) =>
         handleFdWrite(context, fd, iov, iovcnt, pnum)
     }
   };
@@ -494,31 +950,24 @@ function createDefaultImports(context: WasmContext): WebAssembly.Imports {
 function handleFdWrite(
   context: WasmContext,
   fd: number,
-  iov: number,
-  iovcnt: number,
-  pnum: number
+  iov: number | bigint,
+  iovcnt: number | bigint,
+  pnum: number | bigint
 ): number {
   const memory = context.memory;
   if (!memory) {
     return 0;
   }
 
-  const view = new DataView(memory.buffer);
-  let total = 0;
-  for (let i = 0; i < iovcnt; i++) {
-    const base = iov + i * 8;
-    const ptr = view.getUint32(base, true);
-    const len = view.getUint32(base + 4, true);
-    total += len;
-
+  const total = sumIovecs(memory.buffer, iov, iovcnt, context.memory64, (ptr, len) => {
     if (fd === 1 || fd === 2) {
       const bytes = new Uint8Array(memory.buffer, ptr, len);
       const text = new TextDecoder().decode(bytes);
       console.info(`[littlefs-wasm::fd_write fd=${fd}] ${text}`);
     }
-  }
+  });
 
-  view.setUint32(pnum, total, true);
+  writeSize(memory.buffer, pnum, total, context.memory64);
   return 0;
 }
 
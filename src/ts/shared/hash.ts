@@ -0,0 +1,36 @@
+import type { HashAlgorithm, HashDigest } from "./types";
+
+const HASH_ALGORITHM_IDS: Record<HashAlgorithm, number> = {
+  crc32: 1,
+  sha256: 2,
+};
+
+export function hashAlgorithmId(algorithm: HashAlgorithm): number {
+  const id = HASH_ALGORITHM_IDS[algorithm];
+  if (!id) {
+    throw new Error(`Unsupported hash algorithm "${String(algorithm)}"`);
+  }
+  return id;
+}
+
+export function digestByteLength(algorithm: HashAlgorithm): number {
+  return algorithm === "crc32" ? 4 : 32;
+}
+
+// CRC32 digests become one u32 each; SHA-256 digests stay 32 bytes each, back to back.
+export function decodeDigests<A extends HashAlgorithm>(
+  buffer: ArrayBufferLike,
+  ptr: number,
+  count: number,
+  algorithm: A
+): HashDigest<A> {
+  if (algorithm !== "crc32") {
+    return new Uint8Array(buffer, ptr, count * 32).slice() as HashDigest<A>;
+  }
+  const view = new DataView(buffer, ptr, count * 4);
+  const crcs = new Uint32Array(count);
+  for (let i = 0; i < count; i++) {
+    crcs[i] = view.getUint32(i * 4, true);
+  }
+  return crcs as HashDigest<A>;
+}
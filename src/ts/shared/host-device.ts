@@ -0,0 +1,55 @@
+import type { HostBlockDevice, HostDeviceOptions } from "./types";
+
+const DEFAULT_CACHE_BLOCKS = 256;
+const DEFAULT_READ_AHEAD_BLOCKS = 16;
+
+export interface HostDeviceBinding {
+  memory: WebAssembly.Memory | null;
+  device: HostBlockDevice | null;
+  blockSize: number;
+}
+
+export function hostCacheGeometry(options: HostDeviceOptions): [cacheBlocks: number, readAheadBlocks: number] {
+  const cacheBlocks = options.cacheBlocks ?? DEFAULT_CACHE_BLOCKS;
+  const readAheadBlocks = options.readAheadBlocks ?? DEFAULT_READ_AHEAD_BLOCKS;
+  if (!Number.isInteger(cacheBlocks) || cacheBlocks <= 0) {
+    throw new Error("cacheBlocks must be a positive integer");
+  }
+  if (!Number.isInteger(readAheadBlocks) || readAheadBlocks <= 0) {
+    throw new Error("readAheadBlocks must be a positive integer");
+  }
+  return [cacheBlocks, readAheadBlocks];
+}
+
+// A device that throws fails the filesystem call with an I/O error instead of unwinding through wasm.
+export function hostDeviceImports(binding: HostDeviceBinding, prefix: string): WebAssembly.ModuleImports {
+  const run = (action: (device: HostBlockDevice, blockSize: number) => void): number => {
+    if (!binding.device || !binding.memory) {
+      return -1;
+    }
+    try {
+      action(binding.device, binding.blockSize);
+      return 0;
+    } catch (error) {
+      console.warn(`[${prefix}] host block device failed`, error);
+      return -1;
+    }
+  };
+  const blocks = (ptr: number | bigint, count: number) =>
+    new Uint8Array(binding.memory!.buffer, Number(ptr), count * binding.blockSize);
+
+  return {
+    [`${prefix}_host_read`]: (block: number, count: number, ptr: number | bigint) =>
+      run((device, blockSize) => device.read(block * blockSize, blocks(ptr, count))),
+    [`${prefix}_host_write`]: (block: number, count: number, ptr: number | bigint) =>
+      run((device, blockSize) => device.write(block * blockSize, blocks(ptr, count))),
+    [`${prefix}_host_erase`]: (block: number, count: number) =>
+      run((device, blockSize) => {
+        if (device.erase) {
+          device.erase(block * blockSize, count * blockSize);
+        } else {
+          device.write(block * blockSize, new Uint8Array(count * blockSize).fill(0xff));
+        }
+      }),
+  };
+}
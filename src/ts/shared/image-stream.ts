@@ -0,0 +1,61 @@
+import type { CompressedImageSource, ImageStreamOptions } from "./types";
+
+const DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+export function compressImage(
+  readChunk: (offset: number, length: number) => Uint8Array,
+  totalBytes: number,
+  options: ImageStreamOptions = {}
+): ReadableStream<Uint8Array> {
+  const chunkSize = options.chunkSize ?? DEFAULT_CHUNK_SIZE;
+  if (!Number.isInteger(chunkSize) || chunkSize <= 0) {
+    throw new Error("chunkSize must be a positive integer");
+  }
+  let offset = 0;
+  const raw = new ReadableStream<Uint8Array>({
+    pull(controller) {
+      if (offset >= totalBytes) {
+        controller.close();
+        return;
+      }
+      const length = Math.min(chunkSize, totalBytes - offset);
+      controller.enqueue(readChunk(offset, length));
+      offset += length;
+    },
+  });
+  return raw.pipeThrough(new CompressionStream(options.compression ?? "gzip"));
+}
+
+export async function decompressImage(
+  source: CompressedImageSource,
+  totalBytes: number,
+  writeChunk: (offset: number, chunk: Uint8Array) => void,
+  options: ImageStreamOptions = {}
+): Promise<void> {
+  const compressed =
+    source instanceof ReadableStream
+      ? source
+      : new ReadableStream<Uint8Array>({
+          start(controller) {
+            controller.enqueue(source instanceof Uint8Array ? source : new Uint8Array(source));
+            controller.close();
+          },
+        });
+  const reader = compressed.pipeThrough(new DecompressionStream(options.compression ?? "gzip")).getReader();
+  let offset = 0;
+  while (true) {
+    const { done, value } = await reader.read();
+    if (done) {
+      break;
+    }
+    if (offset + value.length > totalBytes) {
+      await reader.cancel();
+      throw new Error(`Decompressed image is larger than the ${totalBytes} byte volume`);
+    }
+    writeChunk(offset, value);
+    offset += value.length;
+  }
+  if (offset !== totalBytes) {
+    throw new Error(`Decompressed image is ${offset} bytes, expected ${totalBytes}`);
+  }
+}
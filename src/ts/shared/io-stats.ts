@@ -0,0 +1,20 @@
+import type { IoStats } from "./types";
+
+export function ioStatsByteLength(blockCount: number): number {
+  return 3 * (blockCount + 1) * 8;
+}
+
+export function decodeIoStats(buffer: ArrayBufferLike, ptr: number, blockCount: number): IoStats {
+  const words = new BigUint64Array(buffer, ptr, 3 * (blockCount + 1));
+  const column = (index: number) =>
+    Float64Array.from(words.subarray(3 + index * blockCount, 3 + (index + 1) * blockCount), Number);
+  return {
+    blockCount,
+    totalErases: Number(words[0]),
+    totalProgBytes: Number(words[1]),
+    totalReadBytes: Number(words[2]),
+    erases: column(0),
+    progBytes: column(1),
+    readBytes: column(2),
+  };
+}
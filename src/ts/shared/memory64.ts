@@ -0,0 +1,60 @@
+// Argument positions that are pointers or size_t in the C glue; only the memory64 build passes them as i64.
+export type PointerArgs = Record<string, readonly number[]>;
+
+// Clients keep addresses and sizes as numbers: wasm64 pointers and int64_t results come back as bigint and are
+// narrowed here, which is exact for anything below 2^53 bytes.
+export function adaptExports<T>(raw: WebAssembly.Exports, memory64: boolean, pointerArgs: PointerArgs): T {
+  const adapted: Record<string, unknown> = {};
+  for (const [name, value] of Object.entries(raw)) {
+    if (typeof value !== "function") {
+      adapted[name] = value;
+      continue;
+    }
+    const fn = value as (...args: Array<number | bigint>) => number | bigint | undefined;
+    const positions = memory64 ? pointerArgs[name] ?? [] : [];
+    adapted[name] =
+      positions.length === 0
+        ? (...args: number[]) => narrow(fn(...args))
+        : (...args: number[]) => narrow(fn(...args.map((arg, i) => (positions.includes(i) ? BigInt(arg) : arg))));
+  }
+  return adapted as T;
+}
+
+// Results handed over by the glue are a { pointer, length } pair of uintptr_t.
+export function readPointerPair(buffer: ArrayBufferLike, ptr: number, memory64: boolean): [number, number] {
+  const view = new DataView(buffer, ptr, memory64 ? 16 : 8);
+  return memory64
+    ? [Number(view.getBigUint64(0, true)), Number(view.getBigUint64(8, true))]
+    : [view.getUint32(0, true), view.getUint32(4, true)];
+}
+
+// WASI fd_write iovecs are { pointer, length } pairs at the module's pointer width.
+export function sumIovecs(
+  buffer: ArrayBufferLike,
+  iov: number | bigint,
+  iovcnt: number | bigint,
+  memory64: boolean,
+  visit: (ptr: number, len: number) => void
+): number {
+  let total = 0;
+  const count = Number(iovcnt);
+  for (let i = 0; i < count; i++) {
+    const [ptr, len] = readPointerPair(buffer, Number(iov) + i * (memory64 ? 16 : 8), memory64);
+    visit(ptr, len);
+    total += len;
+  }
+  return total;
+}
+
+export function writeSize(buffer: ArrayBufferLike, ptr: number | bigint, value: number, memory64: boolean): void {
+  const view = new DataView(buffer);
+  if (memory64) {
+    view.setBigUint64(Number(ptr), BigInt(value), true);
+  } else {
+    view.setUint32(Number(ptr), value, true);
+  }
+}
+
+function narrow(result: number | bigint | undefined): number {
+  return typeof result === "bigint" ? Number(result) : (result as number);
+}
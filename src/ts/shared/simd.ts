@@ -0,0 +1,22 @@
+// (module (func (result v128) i32.const 0 i8x16.splat i8x16.popcnt))
+const SIMD_PROBE = new Uint8Array([
+  0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10, 10, 1, 8, 0, 65, 0, 253, 15, 253, 98, 11,
+]);
+
+let simdSupported: boolean | undefined;
+
+// The -simd modules fail to compile where SIMD128 is missing, so the clients only pick them when this probe validates.
+export function supportsSimd(): boolean {
+  if (simdSupported === undefined) {
+    try {
+      simdSupported = typeof WebAssembly.validate === "function" && WebAssembly.validate(SIMD_PROBE);
+    } catch {
+      simdSupported = false;
+    }
+  }
+  return simdSupported;
+}
+
+export function useSimd(options: { simd?: boolean }): boolean {
+  return options.simd !== false && supportsSimd();
+}
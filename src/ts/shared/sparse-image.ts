@@ -0,0 +1,23 @@
+import type { SparseExtent, SparseImage, SparseImageOptions } from "./types";
+
+const SPARSE_SKIP_ERASED = 0x01;
+
+export function sparseImageFlags(options: SparseImageOptions): number {
+  return options.skipErased ? SPARSE_SKIP_ERASED : 0;
+}
+
+export function decodeSparseImage(bytes: Uint8Array): SparseImage {
+  const view = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength);
+  const granularity = view.getUint32(4, true);
+  const imageBytes = view.getUint32(8, true);
+  const ranges = view.getUint32(12, true);
+  const extents: SparseExtent[] = [];
+  let cursor = 16;
+  for (let i = 0; i < ranges; i++) {
+    const offset = view.getUint32(cursor, true) * granularity;
+    const length = view.getUint32(cursor + 4, true) * granularity;
+    extents.push({ offset, data: bytes.subarray(cursor + 8, cursor + 8 + length) });
+    cursor += 8 + length;
+  }
+  return { imageBytes, extents };
+}
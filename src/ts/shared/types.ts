@@ -6,3 +6,65 @@ export interface FileSystemUsage {
   usedBytes: number;
   freeBytes: number;
 }
+
+export interface IoStats {
+  blockCount: number;
+  totalErases: number;
+  totalProgBytes: number;
+  totalReadBytes: number;
+  erases: Float64Array;
+  progBytes: Float64Array;
+  readBytes: Float64Array;
+}
+
+export interface VolumeSnapshot {
+  readonly id: number;
+}
+
+export interface ImagePatchOptions {
+  granularity?: number;
+}
+
+export interface SparseImageOptions {
+  skipErased?: boolean;
+}
+
+export interface SparseExtent {
+  offset: number;
+  data: Uint8Array;
+}
+
+export interface SparseImage {
+  imageBytes: number;
+  extents: SparseExtent[];
+}
+
+export type ImageCompression = "gzip" | "deflate" | "deflate-raw";
+
+export interface ImageStreamOptions {
+  compression?: ImageCompression;
+  chunkSize?: number;
+}
+
+export type CompressedImageSource = ReadableStream<Uint8Array> | BinarySource;
+
+export interface HostBlockDevice {
+  read(offset: number, target: Uint8Array): void;
+  write(offset: number, data: Uint8Array): void;
+  erase?(offset: number, length: number): void;
+  flush?(): void;
+}
+
+export interface HostDeviceOptions {
+  cacheBlocks?: number;
+  readAheadBlocks?: number;
+}
+
+export type HashAlgorithm = "crc32" | "sha256";
+
+export type HashDigest<A extends HashAlgorithm> = A extends "crc32" ? Uint32Array : Uint8Array;
+
+export interface BlockHashOptions {
+  first?: number;
+  count?: number;
+}
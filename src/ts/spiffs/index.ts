@@ -1,4 +1,22 @@
-import type { FileSource, BinarySource } from "../shared/types";
+import type {
+  FileSource,
+  BinarySource,
+  BlockHashOptions,
+  CompressedImageSource,
+  HashAlgorithm,
+  HashDigest,
+  ImagePatchOptions,
+  ImageStreamOptions,
+  IoStats,
+  SparseImage,
+  SparseImageOptions,
+  VolumeSnapshot,
+} from "../shared/types";
+import { decodeDigests, digestByteLength, hashAlgorithmId } from "../shared/hash";
+import { compressImage, decompressImage } from "../shared/image-stream";
+import { decodeIoStats, ioStatsByteLength } from "../shared/io-stats";
+import { useSimd } from "../shared/simd";
+import { decodeSparseImage, sparseImageFlags } from "../shared/sparse-image";
 
 const DEFAULT_PAGE_SIZE = 256;
 const DEFAULT_BLOCK_SIZE = 4096;
@@ -7,6 +25,9 @@ const DEFAULT_FD_COUNT = 16;
 const DEFAULT_CACHE_PAGES = 64;
 const INITIAL_LIST_BUFFER = 4096;
 const SPIFFS_CAN_FIT_SUCCESS = 1;
+const LIST_DIRECTORIES = 1;
+const CHECK_FINISH = 3;
+const CHECK_PASSES = ["lookup", "index", "page"] as const;
 
 export enum SpiffsErrorCode {
   SPIFFS_OK = 0,
@@ -108,12 +129,67 @@ export interface SpiffsEntry {
   type: "file" | "dir";
 }
 
+export interface SpiffsListOptions {
+  directories?: boolean;
+}
+
 export interface SpiffsUsage {
   capacityBytes: number;
   usedBytes: number;
   freeBytes: number;
 }
 
+export interface SpiffsWriteOptions {
+  reserve?: boolean;
+}
+
+export interface SpiffsGcOptions {
+  targetFreeBytes?: number;
+}
+
+export interface SpiffsGcQuickOptions {
+  maxFreePages?: number;
+}
+
+export interface SpiffsAppendEntry {
+  name: string;
+  data: FileSource;
+}
+
+export interface SpiffsFitEntry {
+  name: string;
+  size: number;
+}
+
+export interface SpiffsFitResult {
+  fits: boolean;
+  requiredPages: number;
+  availablePages: number;
+}
+
+export type SpiffsCheckMode = "none" | "fast" | "full";
+
+export interface SpiffsCheckProgress {
+  pass: "lookup" | "index" | "page";
+  completed: number;
+  total: number;
+}
+
+export interface SpiffsCheckOptions {
+  mode?: Exclude<SpiffsCheckMode, "none">;
+  onProgress?: (progress: SpiffsCheckProgress) => void;
+}
+
+export interface SpiffsCheckReport {
+  mode: Exclude<SpiffsCheckMode, "none">;
+  errors: number;
+  fixedIndexEntries: number;
+  fixedLookupEntries: number;
+  deletedOrphanedIndices: number;
+  deletedPages: number;
+  deletedFiles: number;
+}
+
 export interface SpiffsOptions {
   wasmURL?: string | URL;
   pageSize?: number;
@@ -121,22 +197,53 @@ export interface SpiffsOptions {
   blockCount?: number;
   fdCount?: number;
   cachePages?: number;
+  ramDirect?: boolean;
   formatOnInit?: boolean;
+  ioStats?: boolean;
+  simd?: boolean;
+}
+
+export interface SpiffsImageOptions extends SpiffsOptions {
+  check?: SpiffsCheckMode;
+  onCheckProgress?: (progress: SpiffsCheckProgress) => void;
 }
 
 export interface Spiffs {
-  list(): Promise<SpiffsEntry[]>;
+  list(prefix?: string, options?: SpiffsListOptions): Promise<SpiffsEntry[]>;
   read(name: string): Promise<Uint8Array>;
-  write(name: string, data: FileSource): Promise<void>;
+  readRange(name: string, offset: number, length: number): Promise<Uint8Array>;
+  write(name: string, data: FileSource, options?: SpiffsWriteOptions): Promise<void>;
+  appendFile(name: string, data: FileSource): Promise<void>;
+  appendFiles(entries: SpiffsAppendEntry[]): Promise<void>;
   remove(name: string): Promise<void>;
+  removePrefix(prefix: string): Promise<number>;
   format(): Promise<void>;
   toImage(): Promise<Uint8Array>;
+  toCompressedStream(options?: ImageStreamOptions): ReadableStream<Uint8Array>;
   getUsage(): Promise<SpiffsUsage>;
+  gc(options?: SpiffsGcOptions): Promise<void>;
+  gcQuick(options?: SpiffsGcQuickOptions): Promise<boolean>;
+  check(options?: SpiffsCheckOptions): Promise<SpiffsCheckReport>;
+  getCheckReport(): SpiffsCheckReport | null;
+  getIoStats(): Promise<IoStats | null>;
+  resetIoStats(): Promise<void>;
+  snapshot(): Promise<VolumeSnapshot>;
+  restore(snapshot: VolumeSnapshot): Promise<void>;
+  releaseSnapshot(snapshot: VolumeSnapshot): Promise<void>;
+  snapshotBlocks(snapshot: VolumeSnapshot): Promise<number>;
+  diff(base: VolumeSnapshot | BinarySource, options?: ImagePatchOptions): Promise<Uint8Array>;
+  applyPatch(patch: BinarySource): Promise<void>;
+  toSparseImage(options?: SparseImageOptions): Promise<SparseImage>;
+  hashBlocks<A extends HashAlgorithm>(algorithm: A, options?: BlockHashOptions): Promise<HashDigest<A>>;
+  hashRange<A extends HashAlgorithm>(algorithm: A, offset: number, length: number): Promise<HashDigest<A>>;
+  hashFile<A extends HashAlgorithm>(name: string, algorithm: A): Promise<HashDigest<A>>;
   canFit?(name: string, dataLength: number): boolean;
+  canFitAll?(entries: SpiffsFitEntry[]): SpiffsFitResult;
 }
 
 interface SpiffsExports {
   memory: WebAssembly.Memory;
+  spiffsjs_set_ram_direct(enabled: number): number;
   spiffsjs_init(
     pageSize: number,
     blockSize: number,
@@ -155,22 +262,67 @@ interface SpiffsExports {
   ): number;
   spiffsjs_format(): number;
   spiffsjs_list(bufferPtr: number, bufferLen: number): number;
+  spiffsjs_list_prefix(
+    prefixPtr: number,
+    flags: number,
+    bufferPtr: number,
+    bufferLen: number
+  ): number;
   spiffsjs_file_size(pathPtr: number): number;
   spiffsjs_read_file(
     pathPtr: number,
     bufferPtr: number,
     bufferLen: number
   ): number;
+  spiffsjs_read_file_alloc(pathPtr: number, resultPtr: number): number;
+  spiffsjs_read_range(
+    pathPtr: number,
+    offset: number,
+    length: number,
+    bufferPtr: number
+  ): number;
   spiffsjs_write_file(
     pathPtr: number,
     dataPtr: number,
     dataLen: number
   ): number;
+  spiffsjs_append_file(pathPtr: number, dataPtr: number, dataLen: number): number;
+  spiffsjs_append_batch(manifestPtr: number, dataPtr: number, dataLen: number): number;
   spiffsjs_remove_file(pathPtr: number): number;
   spiffsjs_storage_size(): number;
+  spiffsjs_storage_ptr(): number;
+  spiffsjs_import_begin(
+    pageSize: number,
+    blockSize: number,
+    blockCount: number,
+    fdCount: number,
+    cachePages: number
+  ): number;
+  spiffsjs_import_end(): number;
   spiffsjs_export_image(bufferPtr: number, bufferLen: number): number;
   spiffsjs_get_usage(usagePtr: number): number;
+  spiffsjs_remove_prefix(prefixPtr: number): number;
   spiffsjs_can_fit(pathPtr: number, length: number): number;
+  spiffsjs_can_fit_batch(manifestPtr: number, resultPtr: number): number;
+  spiffsjs_gc(size: number): number;
+  spiffsjs_gc_quick(maxFreePages: number): number;
+  spiffsjs_reserve(length: number): number;
+  spiffsjs_check_pass(pass: number): number;
+  spiffsjs_check_report(reportPtr: number): number;
+  spiffsjs_set_io_stats(enabled: number): number;
+  spiffsjs_reset_io_stats(): number;
+  spiffsjs_get_io_stats(bufferPtr: number, bufferLen: number): number;
+  spiffsjs_snapshot(): number;
+  spiffsjs_restore_snapshot(id: number): number;
+  spiffsjs_release_snapshot(id: number): number;
+  spiffsjs_snapshot_blocks(id: number): number;
+  spiffsjs_diff_snapshot(id: number, granularity: number, resultPtr: number): number;
+  spiffsjs_diff_image(imagePtr: number, imageLen: number, granularity: number, resultPtr: number): number;
+  spiffsjs_apply_patch(patchPtr: number, patchLen: number): number;
+  spiffsjs_export_sparse(flags: number, resultPtr: number): number;
+  spiffsjs_hash_blocks(algorithm: number, first: number, count: number, outPtr: number): number;
+  spiffsjs_hash_range(algorithm: number, offset: number, length: number, outPtr: number): number;
+  spiffsjs_hash_file(algorithm: number, pathPtr: number, outPtr: number): number;
   malloc(size: number): number;
   free(ptr: number): void;
 }
@@ -193,7 +345,7 @@ export class SpiffsError extends Error {
 
 export async function createSpiffs(options: SpiffsOptions = {}): Promise<Spiffs> {
   console.info("[spiffs-wasm] createSpiffs() starting", options);
-  const wasmURL = options.wasmURL ?? new URL("./spiffs.wasm", import.meta.url);
+  const wasmURL = options.wasmURL ?? defaultWasmURL(options);
   const exports = await instantiateSpiffsModule(wasmURL);
 
   const pageSize = options.pageSize ?? DEFAULT_PAGE_SIZE;
@@ -203,6 +355,8 @@ export async function createSpiffs(options: SpiffsOptions = {}): Promise<Spiffs>
 
   const fdCount = options.fdCount ?? DEFAULT_FD_COUNT;
   const cachePages = options.cachePages ?? DEFAULT_CACHE_PAGES;
+  applyRamDirect(exports, options);
+  enableIoStats(exports, options);
 
   const initResult = exports.spiffsjs_init(
     pageSize,
@@ -231,10 +385,10 @@ export async function createSpiffs(options: SpiffsOptions = {}): Promise<Spiffs>
 
 export async function createSpiffsFromImage(
   image: BinarySource,
-  options: SpiffsOptions = {}
+  options: SpiffsImageOptions = {}
 ): Promise<Spiffs> {
   console.info("[spiffs-wasm] createSpiffsFromImage() starting");
-  const wasmURL = options.wasmURL ?? new URL("./spiffs.wasm", import.meta.url);
+  const wasmURL = options.wasmURL ?? defaultWasmURL(options);
   const exports = await instantiateSpiffsModule(wasmURL);
   const bytes = asBinaryUint8Array(image);
 
@@ -251,36 +405,61 @@ export async function createSpiffsFromImage(
 
   const fdCount = options.fdCount ?? DEFAULT_FD_COUNT;
   const cachePages = options.cachePages ?? DEFAULT_CACHE_PAGES;
+  applyRamDirect(exports, options);
+  enableIoStats(exports, options);
 
-  const heap = new Uint8Array(exports.memory.buffer);
-  const ptr = exports.malloc(bytes.length || 1);
-  if (!ptr) {
-    throw new SpiffsError(
-      "Failed to allocate WebAssembly memory",
-      -1 // mimic not enough core
-    );
+  const beginResult = exports.spiffsjs_import_begin(pageSize, blockSize, blockCount, fdCount, cachePages);
+  if (beginResult < 0) {
+    throw new SpiffsError("Failed to initialize SPIFFS from image", beginResult);
   }
+  new Uint8Array(exports.memory.buffer).set(bytes, exports.spiffsjs_storage_ptr());
+  return mountImportedImage(exports, options);
+}
 
-  try {
-    heap.set(bytes, ptr);
-    const initResult = exports.spiffsjs_init_from_image(
-      pageSize,
-      blockSize,
-      blockCount,
-      fdCount,
-      cachePages,
-      ptr,
-      bytes.length
-    );
-    if (initResult < 0) {
-      throw new SpiffsError("Failed to initialize SPIFFS from image", initResult);
-    }
-  } finally {
-    exports.free(ptr);
+export async function createSpiffsFromCompressedImage(
+  source: CompressedImageSource,
+  options: SpiffsImageOptions & ImageStreamOptions = {}
+): Promise<Spiffs> {
+  console.info("[spiffs-wasm] createSpiffsFromCompressedImage() starting");
+  const wasmURL = options.wasmURL ?? defaultWasmURL(options);
+  const exports = await instantiateSpiffsModule(wasmURL);
+
+  const pageSize = options.pageSize ?? DEFAULT_PAGE_SIZE;
+  const blockSize = options.blockSize ?? DEFAULT_BLOCK_SIZE;
+  const blockCount = options.blockCount ?? DEFAULT_BLOCK_COUNT;
+  validateSpiffsLayout(pageSize, blockSize, blockCount);
+
+  const fdCount = options.fdCount ?? DEFAULT_FD_COUNT;
+  const cachePages = options.cachePages ?? DEFAULT_CACHE_PAGES;
+  applyRamDirect(exports, options);
+  enableIoStats(exports, options);
+
+  const beginResult = exports.spiffsjs_import_begin(pageSize, blockSize, blockCount, fdCount, cachePages);
+  if (beginResult < 0) {
+    throw new SpiffsError("Failed to initialize SPIFFS from image", beginResult);
+  }
+  await decompressImage(
+    source,
+    blockSize * blockCount,
+    (offset, chunk) => new Uint8Array(exports.memory.buffer).set(chunk, exports.spiffsjs_storage_ptr() + offset),
+    options
+  );
+  return mountImportedImage(exports, options);
+}
+
+async function mountImportedImage(exports: SpiffsExports, options: SpiffsImageOptions): Promise<Spiffs> {
+  const initResult = exports.spiffsjs_import_end();
+  if (initResult < 0) {
+    throw new SpiffsError("Failed to initialize SPIFFS from image", initResult);
   }
 
   const client = new SpiffsClient(exports);
   console.info("[spiffs-wasm] Filesystem initialized from image");
+  const checkMode = options.check ?? "none";
+  if (checkMode !== "none") {
+    const report = await client.check({ mode: checkMode, onProgress: options.onCheckProgress });
+    console.info("[spiffs-wasm] Consistency check finished", report);
+  }
   return client;
 }
 
@@ -290,79 +469,136 @@ class SpiffsClient implements Spiffs {
   private readonly encoder = new TextEncoder();
   private readonly decoder = new TextDecoder();
   private listBufferSize = INITIAL_LIST_BUFFER;
+  private checkReport: SpiffsCheckReport | null = null;
 
   constructor(exports: SpiffsExports) {
     this.exports = exports;
     this.heapU8 = new Uint8Array(this.exports.memory.buffer);
   }
 
-  async list(): Promise<SpiffsEntry[]> {
+  async list(prefix = "", options: SpiffsListOptions = {}): Promise<SpiffsEntry[]> {
+    const flags = options.directories ? LIST_DIRECTORIES : 0;
+    const entries: SpiffsEntry[] = [];
+    for (const candidate of getPrefixCandidates(prefix)) {
+      entries.push(...this.listPrefix(candidate, flags));
+    }
+    return entries;
+  }
+
+  private listPrefix(prefix: string, flags: number): SpiffsEntry[] {
+    const prefixPtr = this.allocString(prefix);
     let capacity = this.listBufferSize;
-    while (true) {
-      const ptr = this.alloc(capacity);
-      try {
-        const used = this.exports.spiffsjs_list(ptr, capacity);
-        if (used < 0) {
-          this.assertOk(used, "list files");
-        }
-        if (used === 0) {
-          return [];
+    try {
+      while (true) {
+        const ptr = this.alloc(capacity);
+        try {
+          const used = this.exports.spiffsjs_list_prefix(prefixPtr, flags, ptr, capacity);
+          if (used === SpiffsErrorCode.SPIFFS_ERR_FULL) {
+            this.listBufferSize = capacity * 2;
+            capacity = this.listBufferSize;
+            continue;
+          }
+          if (used < 0) {
+            this.assertOk(used, "list files");
+          }
+          if (used === 0) {
+            return [];
+          }
+          const payload = this.decoder.decode(this.heapU8.subarray(ptr, ptr + used));
+          return parseListPayload(payload);
+        } finally {
+          this.exports.free(ptr);
         }
-        const payload = this.decoder.decode(this.heapU8.subarray(ptr, ptr + used));
-        return parseListPayload(payload);
-      } finally {
-        this.exports.free(ptr);
       }
+    } finally {
+      this.exports.free(prefixPtr);
     }
   }
 
   async read(name: string): Promise<Uint8Array> {
     const normalized = normalizePath(name);
     const candidates = getFsPathCandidates(normalized);
-    let chosenPath: string | null = null;
-    let fileSize: number | null = null;
-    let lastError = 0;
-
-    for (const candidate of candidates) {
-      const pathPtr = this.allocString(candidate);
-      try {
-        const size = this.exports.spiffsjs_file_size(pathPtr);
-        if (size >= 0) {
-          chosenPath = candidate;
-          fileSize = size;
+    const resultPtr = this.alloc(8);
+    try {
+      let result = 0;
+      for (const candidate of candidates) {
+        const pathPtr = this.allocString(candidate);
+        try {
+          result = this.exports.spiffsjs_read_file_alloc(pathPtr, resultPtr);
+        } finally {
+          this.exports.free(pathPtr);
+        }
+        if (result !== SpiffsErrorCode.SPIFFS_ERR_NOT_FOUND) {
           break;
         }
-        lastError = size;
+      }
+      this.assertOk(result, `read file "${normalized}"`);
+
+      this.refreshHeap();
+      const view = new DataView(this.heapU8.buffer, resultPtr, 8);
+      const dataPtr = view.getUint32(0, true);
+      const size = view.getUint32(4, true);
+      try {
+        return this.heapU8.slice(dataPtr, dataPtr + size);
       } finally {
-        this.exports.free(pathPtr);
+        this.exports.free(dataPtr);
       }
+    } finally {
+      this.exports.free(resultPtr);
     }
+  }
 
-    if (fileSize === null || chosenPath === null) {
-      this.assertOk(lastError, `stat file "${normalized}"`);
-      return new Uint8Array();
+  async readRange(name: string, offset: number, length: number): Promise<Uint8Array> {
+    if (!Number.isInteger(offset) || offset < 0 || offset > 0x7fffffff) {
+      throw new Error("offset must be a non-negative integer");
     }
-
-    if (fileSize === 0) {
-      return new Uint8Array();
+    if (!Number.isInteger(length) || length < 0 || length > 0x7fffffff) {
+      throw new Error("length must be a non-negative integer");
     }
-
-    const dataPtr = this.alloc(fileSize);
-    const pathPtr = this.allocString(chosenPath);
+    const normalized = normalizePath(name);
+    let pathPtr = 0;
+    let bufferPtr = 0;
     try {
-      const read = this.exports.spiffsjs_read_file(pathPtr, dataPtr, fileSize);
-      this.assertOk(read, `read file "${normalized}"`);
-      return this.heapU8.slice(dataPtr, dataPtr + fileSize);
+      let size = 0;
+      for (const candidate of getFsPathCandidates(normalized)) {
+        pathPtr = this.allocString(candidate);
+        size = this.exports.spiffsjs_file_size(pathPtr);
+        if (size !== SpiffsErrorCode.SPIFFS_ERR_NOT_FOUND) {
+          break;
+        }
+        this.exports.free(pathPtr);
+        pathPtr = 0;
+      }
+      this.assertOk(size, `read file "${normalized}"`);
+      length = Math.min(length, Math.max(0, size - offset));
+      if (length === 0) {
+        return new Uint8Array();
+      }
+      bufferPtr = this.alloc(length);
+      const result = this.exports.spiffsjs_read_range(pathPtr, offset, length, bufferPtr);
+      this.assertOk(result, `read file "${normalized}"`);
+      this.refreshHeap();
+      return this.heapU8.slice(bufferPtr, bufferPtr + result);
     } finally {
-      this.exports.free(dataPtr);
-      this.exports.free(pathPtr);
+      if (bufferPtr) {
+        this.exports.free(bufferPtr);
+      }
+      if (pathPtr) {
+        this.exports.free(pathPtr);
+      }
     }
   }
 
-  async write(name: string, data: FileSource): Promise<void> {
+  async write(name: string, data: FileSource, options: SpiffsWriteOptions = {}): Promise<void> {
     const normalized = normalizePath(name);
     const fsPath = normalizeForFs(normalized);
     const payload = asUint8Array(data, this.encoder);
+    if (options.reserve) {
+      const reserved = this.exports.spiffsjs_reserve(payload.length);
+      if (reserved !== SpiffsErrorCode.SPIFFS_ERR_FULL) {
+        this.assertOk(reserved, `reserve space for "${normalized}"`);
+      }
+    }
     const pathPtr = this.allocString(fsPath);
     const dataPtr = payload.length ? this.alloc(payload.length) : 0;
     try {
@@ -383,6 +619,73 @@ class SpiffsClient implements Spiffs {
     }
   }
 
+  async appendFile(name: string, data: FileSource): Promise<void> {
+    const normalized = normalizePath(name);
+    const fsPath = normalizeForFs(normalized);
+    const payload = asUint8Array(data, this.encoder);
+    const pathPtr = this.allocString(fsPath);
+    const dataPtr = payload.length ? this.alloc(payload.length) : 0;
+    try {
+      if (payload.length > 0) {
+        this.heapU8.set(payload, dataPtr);
+      }
+      const result = this.exports.spiffsjs_append_file(pathPtr, dataPtr, payload.length);
+      this.assertOk(result, `append to file "${normalized}"`);
+    } finally {
+      if (dataPtr) {
+        this.exports.free(dataPtr);
+      }
+      this.exports.free(pathPtr);
+    }
+  }
+
+  async appendFiles(entries: SpiffsAppendEntry[]): Promise<void> {
+    const grouped = new Map<string, Uint8Array[]>();
+    let total = 0;
+    for (const entry of entries) {
+      const fsPath = normalizeForFs(normalizePath(entry.name));
+      if (/[\t\n]/.test(fsPath)) {
+        throw new Error(`Invalid file name "${entry.name}"`);
+      }
+      const payload = asUint8Array(entry.data, this.encoder);
+      const parts = grouped.get(fsPath);
+      if (parts) {
+        parts.push(payload);
+      } else {
+        grouped.set(fsPath, [payload]);
+      }
+      total += payload.length;
+    }
+    if (grouped.size === 0) {
+      return;
+    }
+    let manifest = "";
+    const dataPtr = total ? this.alloc(total) : 0;
+    try {
+      let offset = dataPtr;
+      for (const [fsPath, parts] of grouped) {
+        let length = 0;
+        for (const part of parts) {
+          this.heapU8.set(part, offset);
+          offset += part.length;
+          length += part.length;
+        }
+        manifest += `${fsPath}\t${length}\n`;
+      }
+      const manifestPtr = this.allocString(manifest);
+      try {
+        const result = this.exports.spiffsjs_append_batch(manifestPtr, dataPtr, total);
+        this.assertOk(result, "append to files");
+      } finally {
+        this.exports.free(manifestPtr);
+      }
+    } finally {
+      if (dataPtr) {
+        this.exports.free(dataPtr);
+      }
+    }
+  }
+
   async remove(name: string): Promise<void> {
     const normalized = normalizePath(name);
     const fsPath = normalizeForFs(normalized);
@@ -395,6 +698,21 @@ class SpiffsClient implements Spiffs {
     }
   }
 
+  async removePrefix(prefix: string): Promise<number> {
+    let removed = 0;
+    for (const candidate of getPrefixCandidates(prefix)) {
+      const prefixPtr = this.allocString(candidate);
+      try {
+        const result = this.exports.spiffsjs_remove_prefix(prefixPtr);
+        this.assertOk(result, `delete files with prefix "${prefix}"`);
+        removed += result;
+      } finally {
+        this.exports.free(prefixPtr);
+      }
+    }
+    return removed;
+  }
+
   async format(): Promise<void> {
     const result = this.exports.spiffsjs_format();
     this.assertOk(result, "format filesystem");
@@ -415,6 +733,221 @@ class SpiffsClient implements Spiffs {
     }
   }
 
+  toCompressedStream(options: ImageStreamOptions = {}): ReadableStream<Uint8Array> {
+    return compressImage(
+      (offset, length) => {
+        this.refreshHeap();
+        const ptr = this.exports.spiffsjs_storage_ptr() + offset;
+        return this.heapU8.slice(ptr, ptr + length);
+      },
+      this.exports.spiffsjs_storage_size(),
+      options
+    );
+  }
+
+  async gc(options: SpiffsGcOptions = {}): Promise<void> {
+    const target = options.targetFreeBytes ?? 0;
+    if (!Number.isInteger(target) || target < 0) {
+      throw new Error("targetFreeBytes must be a non-negative integer");
+    }
+    const result = this.exports.spiffsjs_gc(target);
+    this.assertOk(result, "run garbage collection");
+  }
+
+  async gcQuick(options: SpiffsGcQuickOptions = {}): Promise<boolean> {
+    const result = this.exports.spiffsjs_gc_quick(options.maxFreePages ?? 0);
+    this.assertOk(result, "run quick garbage collection");
+    return result === 1;
+  }
+
+  async check(options: SpiffsCheckOptions = {}): Promise<SpiffsCheckReport> {
+    const mode = options.mode ?? "full";
+    const passes = mode === "fast" ? CHECK_PASSES.slice(0, 1) : CHECK_PASSES;
+    for (let i = 0; i < passes.length; i++) {
+      const result = this.exports.spiffsjs_check_pass(i);
+      if (result === SpiffsErrorCode.SPIFFS_ERR_NOT_MOUNTED) {
+        this.assertOk(result, `run ${passes[i]} check`);
+      }
+      options.onProgress?.({ pass: passes[i], completed: i + 1, total: passes.length });
+    }
+    this.assertOk(this.exports.spiffsjs_check_pass(CHECK_FINISH), "finish consistency check");
+
+    const ptr = this.alloc(24);
+    try {
+      this.assertOk(this.exports.spiffsjs_check_report(ptr), "read check report");
+      this.refreshHeap();
+      const view = new DataView(this.heapU8.buffer, ptr, 24);
+      this.checkReport = {
+        mode,
+        errors: view.getUint32(0, true),
+        fixedIndexEntries: view.getUint32(4, true),
+        fixedLookupEntries: view.getUint32(8, true),
+        deletedOrphanedIndices: view.getUint32(12, true),
+        deletedPages: view.getUint32(16, true),
+        deletedFiles: view.getUint32(20, true),
+      };
+      return this.checkReport;
+    } finally {
+      this.exports.free(ptr);
+    }
+  }
+
+  getCheckReport(): SpiffsCheckReport | null {
+    return this.checkReport;
+  }
+
+  async getIoStats(): Promise<IoStats | null> {
+    const blockCount = this.exports.spiffsjs_get_io_stats(0, 0);
+    if (blockCount < 0) {
+      return null;
+    }
+    const byteLength = ioStatsByteLength(blockCount);
+    const ptr = this.alloc(byteLength);
+    try {
+      this.assertOk(this.exports.spiffsjs_get_io_stats(ptr, byteLength), "read I/O statistics");
+      return decodeIoStats(this.heapU8.buffer, ptr, blockCount);
+    } finally {
+      this.exports.free(ptr);
+    }
+  }
+
+  async resetIoStats(): Promise<void> {
+    this.assertOk(this.exports.spiffsjs_reset_io_stats(), "reset I/O statistics");
+  }
+
+  async snapshot(): Promise<VolumeSnapshot> {
+    const id = this.exports.spiffsjs_snapshot();
+    this.assertOk(id, "take snapshot");
+    return { id };
+  }
+
+  async restore(snapshot: VolumeSnapshot): Promise<void> {
+    this.assertOk(this.exports.spiffsjs_restore_snapshot(snapshot.id), `restore snapshot ${snapshot.id}`);
+  }
+
+  async releaseSnapshot(snapshot: VolumeSnapshot): Promise<void> {
+    this.assertOk(this.exports.spiffsjs_release_snapshot(snapshot.id), `release snapshot ${snapshot.id}`);
+  }
+
+  async snapshotBlocks(snapshot: VolumeSnapshot): Promise<number> {
+    const blocks = this.exports.spiffsjs_snapshot_blocks(snapshot.id);
+    this.assertOk(blocks, `inspect snapshot ${snapshot.id}`);
+    return blocks;
+  }
+  async diff(base: VolumeSnapshot | BinarySource, options: ImagePatchOptions = {}): Promise<Uint8Array> {
+    const granularity = options.granularity ?? 0;
+    if (!Number.isInteger(granularity) || granularity < 0) {
+      throw new Error("granularity must be a non-negative integer");
+    }
+    const resultPtr = this.alloc(8);
+    try {
+      if (base instanceof Uint8Array || base instanceof ArrayBuffer) {
+        const image = asBinaryUint8Array(base);
+        const imagePtr = this.alloc(image.length);
+        try {
+          this.heapU8.set(image, imagePtr);
+          const result = this.exports.spiffsjs_diff_image(imagePtr, image.length, granularity, resultPtr);
+          this.assertOk(result, "diff against image");
+        } finally {
+          this.exports.free(imagePtr);
+        }
+      } else {
+        const result = this.exports.spiffsjs_diff_snapshot(base.id, granularity, resultPtr);
+        this.assertOk(result, `diff against snapshot ${base.id}`);
+      }
+      this.refreshHeap();
+      const view = new DataView(this.heapU8.buffer, resultPtr, 8);
+      const patchPtr = view.getUint32(0, true);
+      const patchLen = view.getUint32(4, true);
+      try {
+        return this.heapU8.slice(patchPtr, patchPtr + patchLen);
+      } finally {
+        this.exports.free(patchPtr);
+      }
+    } finally {
+      this.exports.free(resultPtr);
+    }
+  }
+
+  async applyPatch(patch: BinarySource): Promise<void> {
+    const bytes = asBinaryUint8Array(patch);
+    const patchPtr = this.alloc(bytes.length);
+    try {
+      this.heapU8.set(bytes, patchPtr);
+      this.assertOk(this.exports.spiffsjs_apply_patch(patchPtr, bytes.length), "apply patch");
+    } finally {
+      this.exports.free(patchPtr);
+    }
+  }
+
+  async toSparseImage(options: SparseImageOptions = {}): Promise<SparseImage> {
+    const resultPtr = this.alloc(8);
+    try {
+      this.assertOk(this.exports.spiffsjs_export_sparse(sparseImageFlags(options), resultPtr), "export sparse image");
+      this.refreshHeap();
+      const view = new DataView(this.heapU8.buffer, resultPtr, 8);
+      const sparsePtr = view.getUint32(0, true);
+      const sparseLen = view.getUint32(4, true);
+      try {
+        return decodeSparseImage(this.heapU8.slice(sparsePtr, sparsePtr + sparseLen));
+      } finally {
+        this.exports.free(sparsePtr);
+      }
+    } finally {
+      this.exports.free(resultPtr);
+    }
+  }
+
+  async hashBlocks<A extends HashAlgorithm>(algorithm: A, options: BlockHashOptions = {}): Promise<HashDigest<A>> {
+    const id = hashAlgorithmId(algorithm);
+    const blockCount = this.exports.spiffsjs_hash_blocks(id, 0, 0, 0);
+    this.assertOk(blockCount, "hash blocks");
+    const first = options.first ?? 0;
+    const count = options.count ?? blockCount - first;
+    return this.collectDigests(
+      algorithm,
+      count,
+      (ptr) => this.exports.spiffsjs_hash_blocks(id, first, count, ptr),
+      `hash blocks ${first}..${first + count}`
+    );
+  }
+
+  async hashRange<A extends HashAlgorithm>(algorithm: A, offset: number, length: number): Promise<HashDigest<A>> {
+    const id = hashAlgorithmId(algorithm);
+    return this.collectDigests(
+      algorithm,
+      1,
+      (ptr) => this.exports.spiffsjs_hash_range(id, offset, length, ptr),
+      `hash ${length} bytes at ${offset}`
+    );
+  }
+
+  async hashFile<A extends HashAlgorithm>(name: string, algorithm: A): Promise<HashDigest<A>> {
+    const normalized = normalizePath(name);
+    const id = hashAlgorithmId(algorithm);
+    return this.collectDigests(
+      algorithm,
+      1,
+      (ptr) => {
+        let result = 0;
+        for (const candidate of getFsPathCandidates(normalized)) {
+          const pathPtr = this.allocString(candidate);
+          try {
+            result = this.exports.spiffsjs_hash_file(id, pathPtr, ptr);
+          } finally {
+            this.exports.free(pathPtr);
+          }
+          if (result !== SpiffsErrorCode.SPIFFS_ERR_NOT_FOUND) {
+            break;
+          }
+        }
+        return result;
+      },
+      `hash file "${normalized}"`
+    );
+  }
+
+
   async getUsage(): Promise<SpiffsUsage> {
     const ptr = this.alloc(12);
     try {
@@ -447,6 +980,60 @@ class SpiffsClient implements Spiffs {
     }
   }
 
+  canFitAll(entries: SpiffsFitEntry[]): SpiffsFitResult {
+    const sizes = new Map<string, number>();
+    for (const entry of entries) {
+      if (!Number.isInteger(entry.size) || entry.size < 0 || entry.size > 0xffffffff) {
+        throw new Error(`Invalid size for "${entry.name}"`);
+      }
+      const fsPath = normalizeForFs(normalizePath(entry.name));
+      if (/[\t\n]/.test(fsPath)) {
+        throw new Error(`Invalid file name "${entry.name}"`);
+      }
+      sizes.delete(fsPath);
+      sizes.set(fsPath, entry.size);
+    }
+    let manifest = "";
+    for (const [fsPath, size] of sizes) {
+      manifest += `${fsPath}\t${size}\n`;
+    }
+    const manifestPtr = this.allocString(manifest);
+    const resultPtr = this.alloc(8);
+    try {
+      const result = this.exports.spiffsjs_can_fit_batch(manifestPtr, resultPtr);
+      this.assertOk(result, "check space for files");
+      this.refreshHeap();
+      const view = new DataView(this.heapU8.buffer, resultPtr, 8);
+      return {
+        fits: result === SPIFFS_CAN_FIT_SUCCESS,
+        requiredPages: view.getUint32(0, true),
+        availablePages: view.getUint32(4, true),
+      };
+    } finally {
+      this.exports.free(resultPtr);
+      this.exports.free(manifestPtr);
+    }
+  }
+
+  private collectDigests<A extends HashAlgorithm>(
+    algorithm: A,
+    count: number,
+    run: (outPtr: number) => number,
+    action: string
+  ): HashDigest<A> {
+    if (!Number.isInteger(count) || count < 0) {
+      throw new Error("count must be a non-negative integer");
+    }
+    const ptr = this.alloc(Math.max(count, 1) * digestByteLength(algorithm));
+    try {
+      this.assertOk(run(ptr), action);
+      this.refreshHeap();
+      return decodeDigests(this.heapU8.buffer, ptr, count, algorithm);
+    } finally {
+      this.exports.free(ptr);
+    }
+  }
+
   private refreshHeap(): void {
     if (this.heapU8.buffer !== this.exports.memory.buffer) {
       this.heapU8 = new Uint8Array(this.exports.memory.buffer);
@@ -480,6 +1067,10 @@ class SpiffsClient implements Spiffs {
   }
 }
 
+function defaultWasmURL(options: SpiffsOptions): URL {
+  return useSimd(options) ? new URL("./spiffs-simd.wasm", import.meta.url) : new URL("./spiffs.wasm", import.meta.url);
+}
+
 async function instantiateSpiffsModule(input: string | URL): Promise<SpiffsExports> {
   const source = resolveWasmURL(input);
   console.info("[spiffs-wasm] Fetching wasm from", source.href);
@@ -556,10 +1147,15 @@ function normalizeForFs(value: string): string {
     throw new Error('Path must point to a file (e.g. "/readme.txt")');
   }
   const segments = trimmed.split("/").filter((segment) => segment.length > 0);
-  if (segments.length !== 1) {
-    throw new Error("SPIFFS paths must refer to a single file name (no directories)");
+  if (segments.some((segment) => segment === "." || segment === "..")) {
+    throw new Error('SPIFFS paths cannot contain "." or ".." segments');
   }
-  return "/" + segments[0];
+  return "/" + segments.join("/");
+}
+
+function getPrefixCandidates(prefix: string): string[] {
+  const trimmed = prefix.trim().replace(/\\/g, "/").replace(/\/{2,}/g, "/").replace(/^\/+/, "");
+  return trimmed ? ["/" + trimmed, trimmed] : [""];
 }
 
 function getFsPathCandidates(normalized: string): string[] {
@@ -571,6 +1167,22 @@ function getFsPathCandidates(normalized: string): string[] {
   return candidates;
 }
 
+function applyRamDirect(exports: SpiffsExports, options: SpiffsOptions): void {
+  const result = exports.spiffsjs_set_ram_direct(options.ramDirect === false ? 0 : 1);
+  if (result < 0) {
+    throw new SpiffsError("Failed to configure RAM direct mode", result);
+  }
+}
+
+function enableIoStats(exports: SpiffsExports, options: SpiffsOptions): void {
+  if (options.ioStats) {
+    const result = exports.spiffsjs_set_io_stats(1);
+    if (result < 0) {
+      throw new SpiffsError("Failed to enable I/O statistics", result);
+    }
+  }
+}
+
 function validateSpiffsLayout(
   pageSize: number,
   blockSize: number,
@@ -561,6 +561,12 @@ static WCHAR LfnBuf[FF_MAX_LFN + 1];		/* LFN working buffer */
 #endif	/* FF_USE_LFN == 0 */
 
 
+/* Directory name index */
+#if FF_USE_DIR_INDEX && (FF_USE_LFN == 0 || FF_FS_READONLY || FF_FS_MINIMIZE > 1)
+#error FF_USE_DIR_INDEX requires LFN and a writable configuration
+#endif
+
+
 
 /*--------------------------------*/
 /* Code conversion tables         */
@@ -1832,7 +1838,15 @@ static FRESULT dir_alloc (	/* FR_OK(0):succeeded, !=0:error */
 	FATFS *fs = dp->obj.fs;
 
 
+#if FF_USE_DIR_INDEX
+	res = FR_INT_ERR;
+	if (fs->fs_type != FS_EXFAT && ff_dirindex_ready(fs, dp->obj.sclust)) {	/* Skip the leading part known to have no free entry */
+		res = dir_sdi(dp, ff_dirindex_free(fs, dp->obj.sclust));
+	}
+	if (res != FR_OK) res = dir_sdi(dp, 0);
+#else
 	res = dir_sdi(dp, 0);
+#endif
 	if (res == FR_OK) {
 		n = 0;
 		do {
@@ -2407,6 +2421,101 @@ static FRESULT dir_read (
 
 
 
+#if FF_USE_DIR_INDEX
+/*-----------------------------------------------------------------------*/
+/* Directory handling - Build the name index of a directory              */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT dir_index_build (	/* FR_OK(0):succeeded, !=0:error */
+	FF_DIR* dp					/* Pointer to the directory object (read pointer is destroyed) */
+)
+{
+	FRESULT res;
+	FATFS *fs = dp->obj.fs;
+	BYTE et, attr, ord = 0xFF, sum = 0xFF;
+	DWORD blk = 0xFFFFFFFF, fofs = 0xFFFFFFFF;
+	WCHAR lfn[FF_MAX_LFN + 1];
+
+
+	ff_dirindex_reset(fs, dp->obj.sclust);
+	res = dir_sdi(dp, 0);
+	while (res == FR_OK) {
+		res = move_window(fs, dp->sect);
+		if (res != FR_OK) break;
+		et = dp->dir[DIR_Name];
+		if (et == 0) break;			/* Reached end of directory table */
+		attr = dp->dir[DIR_Attr] & AM_MASK;
+		if (et == DDEM) {			/* A free entry */
+			if (fofs == 0xFFFFFFFF) fofs = dp->dptr;
+			ord = 0xFF;
+		} else if (et == '.' || ((attr & AM_VOL) && attr != AM_LFN)) {	/* Dot entry or volume label */
+			ord = 0xFF;
+		} else if (attr == AM_LFN) {	/* An LFN entry */
+			if (et & LLEF) {
+				sum = dp->dir[LDIR_Chksum];
+				et &= (BYTE)~LLEF; ord = et;
+				blk = dp->dptr;
+			}
+			ord = (et == ord && sum == dp->dir[LDIR_Chksum] && pick_lfn(lfn, dp->dir)) ? ord - 1 : 0xFF;
+		} else {					/* An SFN entry */
+			if (ord != 0 || sum != sum_sfn(dp->dir)) blk = 0xFFFFFFFF;	/* It has no valid LFN */
+			if (!ff_dirindex_add(fs, dp->obj.sclust, blk != 0xFFFFFFFF ? lfn : 0, dp->dir, dp->dptr, blk)) {
+				res = FR_NOT_ENOUGH_CORE; break;
+			}
+			ord = 0xFF; blk = 0xFFFFFFFF;
+		}
+		res = dir_next(dp, 0);
+	}
+	if (res == FR_NO_FILE) res = FR_OK;	/* The table is full up to its end */
+
+	if (res == FR_OK) {
+		ff_dirindex_commit(fs, dp->obj.sclust, fofs != 0xFFFFFFFF ? fofs : (dp->sect ? dp->dptr : dp->dptr + SZDIRE));
+	} else {
+		ff_dirindex_drop(fs, dp->obj.sclust);
+	}
+	return res;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Directory handling - Find an object with the name index               */
+/*-----------------------------------------------------------------------*/
+
+static FRESULT dir_find_indexed (	/* FR_OK(0):found, FR_NO_FILE:not found, FR_INT_ERR:index not available, others:error */
+	FF_DIR* dp						/* Pointer to the directory object with the file name */
+)
+{
+	FRESULT res;
+	FATFS *fs = dp->obj.fs;
+	DWORD ofs, blk;
+
+
+	if (!ff_dirindex_ready(fs, dp->obj.sclust)) {	/* Index the directory on first lookup */
+		res = dir_index_build(dp);
+		if (res == FR_NOT_ENOUGH_CORE) return FR_INT_ERR;	/* Fall back to the linear search */
+		if (res != FR_OK) return res;
+	}
+	if (!ff_dirindex_find(fs, dp->obj.sclust, (dp->fn[NSFLAG] & NS_NOLFN) ? 0 : fs->lfnbuf, (dp->fn[NSFLAG] & NS_LOSS) ? 0 : dp->fn, &ofs, &blk)) {
+		return FR_NO_FILE;
+	}
+	res = dir_sdi(dp, ofs);
+	if (res == FR_OK) res = move_window(fs, dp->sect);
+	if (res != FR_OK) return res;
+	if (dp->dir[DIR_Name] == DDEM || dp->dir[DIR_Name] == 0 || (dp->dir[DIR_Attr] & AM_MASK) == AM_LFN) {	/* Stale index? */
+		ff_dirindex_drop(fs, dp->obj.sclust);
+		return FR_INT_ERR;
+	}
+	dp->obj.attr = dp->dir[DIR_Attr] & AM_MASK;
+	dp->blk_ofs = blk;
+	return FR_OK;
+}
+
+#endif	/* FF_USE_DIR_INDEX */
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Directory handling - Find an object in the directory                  */
 /*-----------------------------------------------------------------------*/
@@ -2445,6 +2554,12 @@ static FRESULT dir_find (	/* FR_OK(0):succeeded, !=0:error */
 	}
 #endif
 	/* On the FAT/FAT32 volume */
+#if FF_USE_DIR_INDEX
+	res = dir_find_indexed(dp);
+	if (res != FR_INT_ERR) return res;
+	res = dir_sdi(dp, 0);			/* Index is not available, rewind for the linear search */
+	if (res != FR_OK) return res;
+#endif
 #if FF_USE_LFN
 	ord = sum = 0xFF; dp->blk_ofs = 0xFFFFFFFF;	/* Reset LFN sequence */
 #endif
@@ -2502,6 +2617,9 @@ static FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too
 #if FF_USE_LFN		/* LFN configuration */
 	UINT n, len, n_ent;
 	BYTE sn[12];
+#if FF_USE_DIR_INDEX
+	DWORD blk = 0xFFFFFFFF;
+#endif
 
 
 	if (dp->fn[NSFLAG] & (NS_DOT | NS_NONAME)) return FR_INVALID_NAME;	/* Check name validity */
@@ -2561,6 +2679,9 @@ static FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too
 	/* Create an SFN with/without LFNs. */
 	n_ent = (sn[NSFLAG] & NS_LFN) ? (len + 12) / 13 + 1 : 1;	/* Number of entries to allocate */
 	res = dir_alloc(dp, n_ent);		/* Allocate entries */
+#if FF_USE_DIR_INDEX
+	if (res == FR_OK && n_ent > 1) blk = dp->dptr - SZDIRE * (n_ent - 1);	/* Top of the entry block */
+#endif
 	if (res == FR_OK && --n_ent) {	/* Set LFN entry if needed */
 		res = dir_sdi(dp, dp->dptr - n_ent * SZDIRE);
 		if (res == FR_OK) {
@@ -2591,6 +2712,11 @@ static FRESULT dir_register (	/* FR_OK:succeeded, FR_DENIED:no free entry or too
 			dp->dir[DIR_NTres] = dp->fn[NSFLAG] & (NS_BODY | NS_EXT);	/* Put low-case flags */
 #endif
 			fs->wflag = 1;
+#if FF_USE_DIR_INDEX
+			if (ff_dirindex_ready(fs, dp->obj.sclust) && !ff_dirindex_add(fs, dp->obj.sclust, blk != 0xFFFFFFFF ? fs->lfnbuf : 0, dp->fn, dp->dptr, blk)) {
+				ff_dirindex_drop(fs, dp->obj.sclust);	/* Could not record the entry, forget the index */
+			}
+#endif
 		}
 	}
 
@@ -2615,6 +2741,9 @@ static FRESULT dir_remove (	/* FR_OK:Succeeded, FR_DISK_ERR:A disk error */
 #if FF_USE_LFN		/* LFN configuration */
 	DWORD last = dp->dptr;
 
+#if FF_USE_DIR_INDEX
+	if (fs->fs_type != FS_EXFAT) ff_dirindex_remove(fs, dp->obj.sclust, last, dp->blk_ofs);
+#endif
 	res = (dp->blk_ofs == 0xFFFFFFFF) ? FR_OK : dir_sdi(dp, dp->blk_ofs);	/* Goto top of the entry block if LFN is exist */
 	if (res == FR_OK) {
 		do {
@@ -3501,6 +3630,9 @@ static FRESULT mount_volume (	/* FR_OK(0): successful, !=0: an error occurred */
 	/* Following code attempts to mount the volume. (find an FAT volume, analyze the BPB and initialize the filesystem object) */
 
 	fs->fs_type = 0;					/* Invalidate the filesystem object */
+#if FF_USE_DIR_INDEX
+	ff_dirindex_clear(fs);				/* Forget directory indexes of the previous volume */
+#endif
 	stat = disk_initialize(fs->pdrv);	/* Initialize the volume hosting physical drive */
 	if (stat & STA_NOINIT) { 			/* Check if the initialization succeeded */
 		return FR_NOT_READY;			/* Failed to initialize due to no medium or hard error */
@@ -5189,6 +5321,9 @@ FRESULT f_unlink (
 		}
 		if (res == FR_OK) {		/* It is ready to remove the object */
 			res = dir_remove(&dj);				/* Remove the directory entry */
+#if FF_USE_DIR_INDEX
+			if (dj.obj.attr & AM_DIR) ff_dirindex_drop(fs, dclst);	/* Forget index of the removed sub-directory */
+#endif
 			if (res == FR_OK && dclst != 0) {	/* Remove the cluster chain if exist */
 #if FF_FS_EXFAT
 				res = remove_chain(&obj, dclst, 0);
@@ -5275,6 +5410,10 @@ FRESULT f_mkdir (
 					st_clust(fs, dj.dir, dcl);			/* Table start cluster */
 					dj.dir[DIR_Attr] = AM_DIR;			/* Attribute */
 					fs->wflag = 1;
+#if FF_USE_DIR_INDEX
+					ff_dirindex_reset(fs, dcl);			/* New table has only dot entries */
+					ff_dirindex_commit(fs, dcl, SZDIRE * 2);
+#endif
 				}
 				if (res == FR_OK) {
 					res = sync_fs(fs);
@@ -397,6 +397,21 @@ DWORD ff_wtoupper (DWORD uni);			/* Unicode upper-case conversion */
 #endif
 
 
+/* Directory name index functions (provided by user) */
+
+#if FF_USE_DIR_INDEX
+int ff_dirindex_ready (FATFS* fs, DWORD sclust);	/* 1:The directory is indexed */
+void ff_dirindex_reset (FATFS* fs, DWORD sclust);	/* Start (re)building the index of a directory */
+int ff_dirindex_add (FATFS* fs, DWORD sclust, const WCHAR* lfn, const BYTE* sfn, DWORD ofs, DWORD blk_ofs);	/* Record an entry (0:out of memory) */
+void ff_dirindex_commit (FATFS* fs, DWORD sclust, DWORD free_ofs);	/* Mark the directory index complete */
+int ff_dirindex_find (FATFS* fs, DWORD sclust, const WCHAR* lfn, const BYTE* sfn, DWORD* ofs, DWORD* blk_ofs);	/* 1:Found */
+void ff_dirindex_remove (FATFS* fs, DWORD sclust, DWORD ofs, DWORD blk_ofs);	/* Forget a removed entry */
+DWORD ff_dirindex_free (FATFS* fs, DWORD sclust);	/* Offset below which the table has no free entry */
+void ff_dirindex_drop (FATFS* fs, DWORD sclust);	/* Forget the index of a directory */
+void ff_dirindex_clear (FATFS* fs);					/* Forget all directory indexes */
+#endif
+
+
 /* O/S dependent functions (samples available in ffsystem.c) */
 
 #if FF_USE_LFN == 3		/* Dynamic memory allocation */
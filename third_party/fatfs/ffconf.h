@@ -16,10 +16,11 @@
 #define FF_USE_FIND     0
 #define FF_USE_MKFS     1
 #define FF_USE_FASTSEEK 0
-#define FF_USE_EXPAND   0
+#define FF_USE_EXPAND   1
 #define FF_USE_CHMOD    1
 #define FF_USE_LABEL    0
 #define FF_USE_FORWARD  0
+#define FF_USE_DIR_INDEX 1
 
 #define FF_USE_STRFUNC  0
 #define FF_PRINT_LLI    0
@@ -54,7 +55,9 @@
 #define FF_MIN_SS 4096
 #define FF_MAX_SS 4096
 
-#define FF_LBA64 0
+#ifndef FF_LBA64
+#define FF_LBA64 0   /* fatfs64.wasm is built with -DFF_LBA64=1 */
+#endif
 #define FF_MIN_GPT 0x10000000
 
 #define FF_USE_TRIM 0
@@ -64,7 +67,9 @@
 /---------------------------------------------------------------------------*/
 
 #define FF_FS_TINY     0
-#define FF_FS_EXFAT    0
+#ifndef FF_FS_EXFAT
+#define FF_FS_EXFAT    0   /* fatfs-exfat.wasm is built with -DFF_FS_EXFAT=1 */
+#endif
 #define FF_FS_NORTC    0
 #define FF_NORTC_MON   1
 #define FF_NORTC_MDAY  1
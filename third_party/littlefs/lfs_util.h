@@ -231,6 +231,8 @@ static inline uint32_t lfs_tobe32(uint32_t a) {
 
 // Calculate CRC-32 with polynomial = 0x04c11db7
 #ifdef LFS_CRC
+// LFS_CRC names a function with the same signature as lfs_crc
+uint32_t LFS_CRC(uint32_t crc, const void *buffer, size_t size);
 static inline uint32_t lfs_crc(uint32_t crc, const void *buffer, size_t size) {
     return LFS_CRC(crc, buffer, size);
 }
@@ -226,6 +226,12 @@ typedef struct {
   // an integer offset added to each file handle
   u16_t fh_ix_offset;
 #endif
+#if SPIFFS_RAM_DIRECT
+  // optional pointer to memory mirroring the flash from phys_addr on; when
+  // set, reads bypass hal_read_f and the read cache. Writes and erases still
+  // go through the hal functions, which must keep this memory up to date.
+  u8_t *phys_mem;
+#endif
 } spiffs_config;
 
 typedef struct spiffs_t {
@@ -816,6 +822,35 @@ u32_t SPIFFS_buffer_bytes_for_cache(spiffs *fs, u32_t num_pages);
 #endif
 #endif
 
+#if SPIFFS_NAME_INDEX
+// returned by spiffs_name_index_find when the index cannot answer
+#define SPIFFS_NAME_INDEX_UNKNOWN 1
+
+/**
+ * Provided by the integration. Resolves a name to the page of its object
+ * index header. Returns SPIFFS_OK and sets pix when found,
+ * SPIFFS_ERR_NOT_FOUND when the name is known not to exist, or
+ * SPIFFS_NAME_INDEX_UNKNOWN to make spiffs scan the medium. Found pages are
+ * verified by spiffs, so a stale entry only costs the scan.
+ * @param fs      the file system struct
+ * @param name    the object name
+ * @param pix     populated with the object index header page
+ */
+s32_t spiffs_name_index_find(spiffs *fs, const u8_t *name, spiffs_page_ix *pix);
+
+/**
+ * Provided by the integration. Called whenever an object index header is
+ * created, rewritten or moved, with name read from the new header, and with
+ * name 0 when the header at pix is deleted.
+ * @param fs      the file system struct
+ * @param obj_id  the object id, without the index flag
+ * @param pix     the page of the object index header
+ * @param name    the object name, or 0 if the header was deleted
+ */
+void spiffs_name_index_update(spiffs *fs, spiffs_obj_id obj_id,
+    spiffs_page_ix pix, const u8_t *name);
+#endif
+
 #if SPIFFS_CACHE
 #endif
 #if defined(__cplusplus)
@@ -10,31 +10,108 @@
 
 #if SPIFFS_CACHE
 
-// returns cached page for give page index, or null if no such cached page
-static spiffs_cache_page *spiffs_cache_page_get(spiffs *fs, spiffs_page_ix pix) {
+// Cache pages are kept in a hash table keyed by page index (read pages) or
+// object id (write pages) and on an lru list, so lookups and evictions do not
+// depend on the number of cache pages.
+
+#define SPIFFS_CACHE_KEY_WR 0x80000000u
+
+static u32_t spiffs_cache_key(spiffs_cache_page *cp) {
+#if SPIFFS_CACHE_WR
+  if (cp->flags & SPIFFS_CACHE_FLAG_TYPE_WR) {
+    return SPIFFS_CACHE_KEY_WR | cp->obj_id;
+  }
+#endif
+  return cp->pix;
+}
+
+static u32_t spiffs_cache_bucket(spiffs_cache *cache, u32_t key) {
+  key *= 0x9e3779b1u;
+  return (key ^ (key >> 15)) & cache->bucket_mask;
+}
+
+static void spiffs_cache_hash_insert(spiffs *fs, spiffs_cache_page *cp) {
   spiffs_cache *cache = spiffs_get_cache(fs);
-  if ((cache->cpage_use_map & cache->cpage_use_mask) == 0) return 0;
-  int i;
-  for (i = 0; i < cache->cpage_count; i++) {
-    spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, i);
-    if ((cache->cpage_use_map & (1<<i)) &&
-        (cp->flags & SPIFFS_CACHE_FLAG_TYPE_WR) == 0 &&
-        cp->pix == pix ) {
-      //SPIFFS_CACHE_DBG("CACHE_GET: have cache page "_SPIPRIi" for "_SPIPRIpg"\n", i, pix);
-      cp->last_access = cache->last_access;
+  u32_t b = spiffs_cache_bucket(cache, spiffs_cache_key(cp));
+  cp->hash_next = cache->buckets[b];
+  cache->buckets[b] = cp->ix;
+}
+
+static void spiffs_cache_hash_remove(spiffs *fs, spiffs_cache_page *cp) {
+  spiffs_cache *cache = spiffs_get_cache(fs);
+  u32_t *link = &cache->buckets[spiffs_cache_bucket(cache, spiffs_cache_key(cp))];
+  while (*link != SPIFFS_CACHE_NIL) {
+    if (*link == cp->ix) {
+      *link = cp->hash_next;
+      break;
+    }
+    link = &spiffs_get_cache_page_hdr(fs, cache, *link)->hash_next;
+  }
+  cp->hash_next = SPIFFS_CACHE_NIL;
+}
+
+static spiffs_cache_page *spiffs_cache_hash_find(spiffs *fs, u32_t key) {
+  spiffs_cache *cache = spiffs_get_cache(fs);
+  if (cache->cpage_count == 0) return 0;
+  u32_t ix = cache->buckets[spiffs_cache_bucket(cache, key)];
+  while (ix != SPIFFS_CACHE_NIL) {
+    spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, ix);
+    if (spiffs_cache_key(cp) == key) {
       return cp;
     }
+    ix = cp->hash_next;
   }
-  //SPIFFS_CACHE_DBG("CACHE_GET: no cache for "_SPIPRIpg"\n", pix);
   return 0;
 }
 
+static void spiffs_cache_lru_unlink(spiffs *fs, spiffs_cache_page *cp) {
+  spiffs_cache *cache = spiffs_get_cache(fs);
+  if (cp->lru_prev != SPIFFS_CACHE_NIL) {
+    spiffs_get_cache_page_hdr(fs, cache, cp->lru_prev)->lru_next = cp->lru_next;
+  } else {
+    cache->lru_head = cp->lru_next;
+  }
+  if (cp->lru_next != SPIFFS_CACHE_NIL) {
+    spiffs_get_cache_page_hdr(fs, cache, cp->lru_next)->lru_prev = cp->lru_prev;
+  } else {
+    cache->lru_tail = cp->lru_prev;
+  }
+}
+
+static void spiffs_cache_lru_push(spiffs *fs, spiffs_cache_page *cp) {
+  spiffs_cache *cache = spiffs_get_cache(fs);
+  cp->lru_prev = SPIFFS_CACHE_NIL;
+  cp->lru_next = cache->lru_head;
+  if (cache->lru_head != SPIFFS_CACHE_NIL) {
+    spiffs_get_cache_page_hdr(fs, cache, cache->lru_head)->lru_prev = cp->ix;
+  } else {
+    cache->lru_tail = cp->ix;
+  }
+  cache->lru_head = cp->ix;
+}
+
+// marks the cache page as most recently used
+static void spiffs_cache_touch(spiffs *fs, spiffs_cache_page *cp) {
+  if (spiffs_get_cache(fs)->lru_head == cp->ix) return;
+  spiffs_cache_lru_unlink(fs, cp);
+  spiffs_cache_lru_push(fs, cp);
+}
+
+// returns cached page for give page index, or null if no such cached page
+static spiffs_cache_page *spiffs_cache_page_get(spiffs *fs, spiffs_page_ix pix) {
+  spiffs_cache_page *cp = spiffs_cache_hash_find(fs, pix);
+  if (cp) {
+    spiffs_cache_touch(fs, cp);
+  }
+  return cp;
+}
+
 // frees cached page
 static s32_t spiffs_cache_page_free(spiffs *fs, int ix, u8_t write_back) {
   s32_t res = SPIFFS_OK;
   spiffs_cache *cache = spiffs_get_cache(fs);
   spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, ix);
-  if (cache->cpage_use_map & (1<<ix)) {
+  if (cp->used) {
     if (write_back &&
         (cp->flags & SPIFFS_CACHE_FLAG_TYPE_WR) == 0 &&
         (cp->flags & SPIFFS_CACHE_FLAG_DIRTY)) {
@@ -51,8 +128,12 @@ static s32_t spiffs_cache_page_free(spiffs *fs, int ix, u8_t write_back) {
     {
       SPIFFS_CACHE_DBG("CACHE_FREE: free cache page "_SPIPRIi" pix "_SPIPRIpg"\n", ix, cp->pix);
     }
-    cache->cpage_use_map &= ~(1 << ix);
+    spiffs_cache_hash_remove(fs, cp);
+    spiffs_cache_lru_unlink(fs, cp);
+    cp->used = 0;
     cp->flags = 0;
+    cp->lru_next = cache->free_head;
+    cache->free_head = cp->ix;
   }
 
   return res;
@@ -60,53 +141,40 @@ static s32_t spiffs_cache_page_free(spiffs *fs, int ix, u8_t write_back) {
 
 // removes the oldest accessed cached page
 static s32_t spiffs_cache_page_remove_oldest(spiffs *fs, u8_t flag_mask, u8_t flags) {
-  s32_t res = SPIFFS_OK;
   spiffs_cache *cache = spiffs_get_cache(fs);
 
-  if ((cache->cpage_use_map & cache->cpage_use_mask) != cache->cpage_use_mask) {
+  if (cache->free_head != SPIFFS_CACHE_NIL) {
     // at least one free cpage
     return SPIFFS_OK;
   }
 
-  // all busy, scan thru all to find the cpage which has oldest access
-  int i;
-  int cand_ix = -1;
-  u32_t oldest_val = 0;
-  for (i = 0; i < cache->cpage_count; i++) {
-    spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, i);
-    if ((cache->last_access - cp->last_access) > oldest_val &&
-        (cp->flags & flag_mask) == flags) {
-      oldest_val = cache->last_access - cp->last_access;
-      cand_ix = i;
+  // all busy, walk from the least recently used end for a matching cpage
+  u32_t ix = cache->lru_tail;
+  while (ix != SPIFFS_CACHE_NIL) {
+    spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, ix);
+    if ((cp->flags & flag_mask) == flags) {
+      return spiffs_cache_page_free(fs, ix, 1);
     }
+    ix = cp->lru_prev;
   }
 
-  if (cand_ix >= 0) {
-    res = spiffs_cache_page_free(fs, cand_ix, 1);
-  }
-
-  return res;
+  return SPIFFS_OK;
 }
 
 // allocates a new cached page and returns it, or null if all cache pages are busy
 static spiffs_cache_page *spiffs_cache_page_allocate(spiffs *fs) {
   spiffs_cache *cache = spiffs_get_cache(fs);
-  if (cache->cpage_use_map == 0xffffffff) {
+  if (cache->free_head == SPIFFS_CACHE_NIL) {
     // out of cache memory
     return 0;
   }
-  int i;
-  for (i = 0; i < cache->cpage_count; i++) {
-    if ((cache->cpage_use_map & (1<<i)) == 0) {
-      spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, i);
-      cache->cpage_use_map |= (1<<i);
-      cp->last_access = cache->last_access;
-      //SPIFFS_CACHE_DBG("CACHE_ALLO: allocated cache page "_SPIPRIi"\n", i);
-      return cp;
-    }
-  }
-  // out of cache entries
-  return 0;
+  spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, cache->free_head);
+  cache->free_head = cp->lru_next;
+  cp->used = 1;
+  cp->hash_next = SPIFFS_CACHE_NIL;
+  spiffs_cache_lru_push(fs, cp);
+  //SPIFFS_CACHE_DBG("CACHE_ALLO: allocated cache page "_SPIPRIi"\n", cp->ix);
+  return cp;
 }
 
 // drops the cache page for give page index
@@ -129,15 +197,20 @@ s32_t spiffs_phys_rd(
     u8_t *dst) {
   (void)fh;
   s32_t res = SPIFFS_OK;
+#if SPIFFS_RAM_DIRECT
+  if (fs->cfg.phys_mem) {
+    // mapped flash is as fast as any cache page, never cache reads
+    _SPIFFS_MEMCPY(dst, SPIFFS_PHYS_MEM(fs, addr), len);
+    return SPIFFS_OK;
+  }
+#endif
   spiffs_cache *cache = spiffs_get_cache(fs);
   spiffs_cache_page *cp =  spiffs_cache_page_get(fs, SPIFFS_PADDR_TO_PAGE(fs, addr));
-  cache->last_access++;
   if (cp) {
     // we've already got one, you see
 #if SPIFFS_CACHE_STATS
     fs->cache_hits++;
 #endif
-    cp->last_access = cache->last_access;
     u8_t *mem =  spiffs_get_cache_page(fs, cache, cp->ix);
     _SPIFFS_MEMCPY(dst, &mem[SPIFFS_PADDR_TO_PAGE_OFFSET(fs, addr)], len);
   } else {
@@ -156,6 +229,7 @@ s32_t spiffs_phys_rd(
     if (cp) {
       cp->flags = SPIFFS_CACHE_FLAG_WRTHRU;
       cp->pix = SPIFFS_PADDR_TO_PAGE(fs, addr);
+      spiffs_cache_hash_insert(fs, cp);
       SPIFFS_CACHE_DBG("CACHE_ALLO: allocated cache page "_SPIPRIi" for pix "_SPIPRIpg "\n", cp->ix, cp->pix);
 
       s32_t res2 = SPIFFS_HAL_READ(fs,
@@ -189,6 +263,12 @@ s32_t spiffs_phys_wr(
     u32_t len,
     u8_t *src) {
   (void)fh;
+#if SPIFFS_RAM_DIRECT
+  if (fs->cfg.phys_mem) {
+    // reads are never cached for mapped flash, nothing to keep coherent
+    return SPIFFS_HAL_WRITE(fs, addr, len, src);
+  }
+#endif
   spiffs_page_ix pix = SPIFFS_PADDR_TO_PAGE(fs, addr);
   spiffs_cache *cache = spiffs_get_cache(fs);
   spiffs_cache_page *cp =  spiffs_cache_page_get(fs, pix);
@@ -207,9 +287,6 @@ s32_t spiffs_phys_wr(
     u8_t *mem =  spiffs_get_cache_page(fs, cache, cp->ix);
     _SPIFFS_MEMCPY(&mem[SPIFFS_PADDR_TO_PAGE_OFFSET(fs, addr)], src, len);
 
-    cache->last_access++;
-    cp->last_access = cache->last_access;
-
     if (cp->flags & SPIFFS_CACHE_FLAG_WRTHRU) {
       // page is being updated, no write-cache, just pass thru
       return SPIFFS_HAL_WRITE(fs, addr, len, src);
@@ -225,24 +302,7 @@ s32_t spiffs_phys_wr(
 #if SPIFFS_CACHE_WR
 // returns the cache page that this fd refers, or null if no cache page
 spiffs_cache_page *spiffs_cache_page_get_by_fd(spiffs *fs, spiffs_fd *fd) {
-  spiffs_cache *cache = spiffs_get_cache(fs);
-
-  if ((cache->cpage_use_map & cache->cpage_use_mask) == 0) {
-    // all cpages free, no cpage cannot be assigned to obj_id
-    return 0;
-  }
-
-  int i;
-  for (i = 0; i < cache->cpage_count; i++) {
-    spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, cache, i);
-    if ((cache->cpage_use_map & (1<<i)) &&
-        (cp->flags & SPIFFS_CACHE_FLAG_TYPE_WR) &&
-        cp->obj_id == fd->obj_id) {
-      return cp;
-    }
-  }
-
-  return 0;
+  return spiffs_cache_hash_find(fs, SPIFFS_CACHE_KEY_WR | fd->obj_id);
 }
 
 // allocates a new cache page and refers this to given fd - flushes an old cache
@@ -259,6 +319,7 @@ spiffs_cache_page *spiffs_cache_page_allocate_by_fd(spiffs *fs, spiffs_fd *fd) {
 
   cp->flags = SPIFFS_CACHE_FLAG_TYPE_WR;
   cp->obj_id = fd->obj_id;
+  spiffs_cache_hash_insert(fs, cp);
   fd->cache_page = cp;
   SPIFFS_CACHE_DBG("CACHE_ALLO: allocated cache page "_SPIPRIi" for fd "_SPIPRIfd ":"_SPIPRIid "\n", cp->ix, fd->file_nbr, fd->obj_id);
   return cp;
@@ -286,33 +347,46 @@ void spiffs_cache_fd_release(spiffs *fs, spiffs_cache_page *cp) {
 void spiffs_cache_init(spiffs *fs) {
   if (fs->cache == 0) return;
   u32_t sz = fs->cache_size;
-  u32_t cache_mask = 0;
-  int i;
-  int cache_entries =
-      (sz - sizeof(spiffs_cache)) / (SPIFFS_CACHE_PAGE_SIZE(fs));
-  if (cache_entries <= 0) return;
-
-  for (i = 0; i < cache_entries; i++) {
-    cache_mask <<= 1;
-    cache_mask |= 1;
+  if (sz < sizeof(spiffs_cache)) return;
+  u32_t cache_entries = (sz - sizeof(spiffs_cache)) / SPIFFS_CACHE_PAGE_SIZE(fs);
+  // make room for the hash buckets in front of the pages
+  while (cache_entries > 0 &&
+      sizeof(spiffs_cache) + SPIFFS_CACHE_BUCKETS(cache_entries) * sizeof(u32_t) +
+      cache_entries * SPIFFS_CACHE_PAGE_SIZE(fs) > sz) {
+    cache_entries--;
   }
 
   spiffs_cache cache;
   memset(&cache, 0, sizeof(spiffs_cache));
-  cache.cpage_count = cache_entries;
-  cache.cpages = (u8_t *)((u8_t *)fs->cache + sizeof(spiffs_cache));
+  cache.lru_head = SPIFFS_CACHE_NIL;
+  cache.lru_tail = SPIFFS_CACHE_NIL;
+  cache.free_head = SPIFFS_CACHE_NIL;
+  if (cache_entries == 0) {
+    // no room for a single page, every access goes to the hal
+    _SPIFFS_MEMCPY(fs->cache, &cache, sizeof(spiffs_cache));
+    return;
+  }
 
-  cache.cpage_use_map = 0xffffffff;
-  cache.cpage_use_mask = cache_mask;
+  u32_t bucket_count = SPIFFS_CACHE_BUCKETS(cache_entries);
+  cache.cpage_count = cache_entries;
+  cache.buckets = (u32_t *)((u8_t *)fs->cache + sizeof(spiffs_cache));
+  cache.bucket_mask = bucket_count - 1;
+  cache.cpages = (u8_t *)(cache.buckets + bucket_count);
+  cache.free_head = 0;
   _SPIFFS_MEMCPY(fs->cache, &cache, sizeof(spiffs_cache));
 
   spiffs_cache *c = spiffs_get_cache(fs);
 
+  memset(c->buckets, 0xff, bucket_count * sizeof(u32_t));
   memset(c->cpages, 0, c->cpage_count * SPIFFS_CACHE_PAGE_SIZE(fs));
 
-  c->cpage_use_map &= ~(c->cpage_use_mask);
+  u32_t i;
   for (i = 0; i < cache.cpage_count; i++) {
-    spiffs_get_cache_page_hdr(fs, c, i)->ix = i;
+    spiffs_cache_page *cp = spiffs_get_cache_page_hdr(fs, c, i);
+    cp->ix = i;
+    cp->hash_next = SPIFFS_CACHE_NIL;
+    cp->lru_prev = SPIFFS_CACHE_NIL;
+    cp->lru_next = (i + 1 < cache.cpage_count) ? i + 1 : SPIFFS_CACHE_NIL;
   }
 }
 
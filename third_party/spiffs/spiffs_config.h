@@ -48,6 +48,21 @@ typedef uint8_t u8_t;
 #define SPIFFS_CACHE_STATS 0
 #endif
 
+// Enables spiffs_config.phys_mem. When the whole spiffs area is addressable
+// memory, reads are served straight from it instead of going through the
+// HAL and the read cache, and lookup page scans work on it in place.
+#ifndef SPIFFS_RAM_DIRECT
+#define SPIFFS_RAM_DIRECT 1
+#endif
+
+// Enables name lookups through spiffs_name_index_find, which the integration
+// must provide together with spiffs_name_index_update. This replaces the
+// scan over all object index headers when opening, stating or removing by
+// name.
+#ifndef SPIFFS_NAME_INDEX
+#define SPIFFS_NAME_INDEX 1
+#endif
+
 #ifndef SPIFFS_TEMPORAL_FD_CACHE
 #define SPIFFS_TEMPORAL_FD_CACHE 1
 #endif
@@ -36,7 +36,7 @@ s32_t spiffs_gc_quick(
   spiffs_block_ix cur_block = 0;
   u32_t cur_block_addr = 0;
   int cur_entry = 0;
-  spiffs_obj_id *obj_lu_buf = (spiffs_obj_id *)fs->lu_work;
+  spiffs_obj_id *obj_lu_buf;
 
   SPIFFS_GC_DBG("gc_quick: running\n");
 #if SPIFFS_GC_STATS
@@ -55,8 +55,7 @@ s32_t spiffs_gc_quick(
     // check each object lookup page
     while (res == SPIFFS_OK && obj_lookup_page < (int)SPIFFS_OBJ_LOOKUP_PAGES(fs)) {
       int entry_offset = obj_lookup_page * entries_per_page;
-      res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU | SPIFFS_OP_C_READ,
-          0, cur_block_addr + SPIFFS_PAGE_TO_PADDR(fs, obj_lookup_page), SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->lu_work);
+      res = spiffs_obj_lu_load(fs, cur_block_addr + SPIFFS_PAGE_TO_PADDR(fs, obj_lookup_page), &obj_lu_buf);
       // check each entry
       while (res == SPIFFS_OK &&
           cur_entry - entry_offset < entries_per_page &&
@@ -202,7 +201,7 @@ s32_t spiffs_gc_erase_page_stats(
   s32_t res = SPIFFS_OK;
   int obj_lookup_page = 0;
   int entries_per_page = (SPIFFS_CFG_LOG_PAGE_SZ(fs) / sizeof(spiffs_obj_id));
-  spiffs_obj_id *obj_lu_buf = (spiffs_obj_id *)fs->lu_work;
+  spiffs_obj_id *obj_lu_buf;
   int cur_entry = 0;
   u32_t dele = 0;
   u32_t allo = 0;
@@ -210,8 +209,7 @@ s32_t spiffs_gc_erase_page_stats(
   // check each object lookup page
   while (res == SPIFFS_OK && obj_lookup_page < (int)SPIFFS_OBJ_LOOKUP_PAGES(fs)) {
     int entry_offset = obj_lookup_page * entries_per_page;
-    res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU | SPIFFS_OP_C_READ,
-        0, bix * SPIFFS_CFG_LOG_BLOCK_SZ(fs) + SPIFFS_PAGE_TO_PADDR(fs, obj_lookup_page), SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->lu_work);
+    res = spiffs_obj_lu_load(fs, bix * SPIFFS_CFG_LOG_BLOCK_SZ(fs) + SPIFFS_PAGE_TO_PADDR(fs, obj_lookup_page), &obj_lu_buf);
     // check each entry
     while (res == SPIFFS_OK &&
         cur_entry - entry_offset < entries_per_page && cur_entry < (int)(SPIFFS_PAGES_PER_BLOCK(fs)-SPIFFS_OBJ_LOOKUP_PAGES(fs))) {
@@ -242,7 +240,7 @@ s32_t spiffs_gc_find_candidate(
   u32_t blocks = fs->block_count;
   spiffs_block_ix cur_block = 0;
   u32_t cur_block_addr = 0;
-  spiffs_obj_id *obj_lu_buf = (spiffs_obj_id *)fs->lu_work;
+  spiffs_obj_id *obj_lu_buf;
   int cur_entry = 0;
 
   // using fs->work area as sorted candidate memory, (spiffs_block_ix)cand_bix/(s32_t)score
@@ -270,8 +268,7 @@ s32_t spiffs_gc_find_candidate(
     // check each object lookup page
     while (res == SPIFFS_OK && obj_lookup_page < (int)SPIFFS_OBJ_LOOKUP_PAGES(fs)) {
       int entry_offset = obj_lookup_page * entries_per_page;
-      res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU | SPIFFS_OP_C_READ,
-          0, cur_block_addr + SPIFFS_PAGE_TO_PADDR(fs, obj_lookup_page), SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->lu_work);
+      res = spiffs_obj_lu_load(fs, cur_block_addr + SPIFFS_PAGE_TO_PADDR(fs, obj_lookup_page), &obj_lu_buf);
       // check each entry
       while (res == SPIFFS_OK &&
           cur_entry - entry_offset < entries_per_page &&
@@ -443,6 +440,18 @@ s32_t spiffs_gc_clean(spiffs *fs, spiffs_block_ix bix) {
               SPIFFS_GC_DBG("gc_clean: MOVE_DATA no objix spix match, take in another run\n");
             } else {
               spiffs_page_ix new_data_pix;
+              spiffs_page_ix *ix_entries = gc.cur_objix_spix == 0
+                  ? (spiffs_page_ix *)((u8_t *)objix_hdr + sizeof(spiffs_page_object_ix_header))
+                  : (spiffs_page_ix *)((u8_t *)objix + sizeof(spiffs_page_object_ix));
+              if (ix_entries[SPIFFS_OBJ_IX_ENTRY(fs, p_hdr.span_ix)] != cur_pix) {
+                // a write that failed half way can leave data pages its index
+                // never took in - moving one would point the index at stale
+                // data, so scrap it like any other unreferenced page
+                SPIFFS_GC_DBG("gc_clean: MOVE_DATA wipe unreferenced "_SPIPRIid":"_SPIPRIsp" page "_SPIPRIpg"\n", obj_id, p_hdr.span_ix, cur_pix);
+                res = spiffs_page_delete(fs, cur_pix);
+                SPIFFS_CHECK_RES(res);
+                break;
+              }
               if (p_hdr.flags & SPIFFS_PH_FLAG_DELET) {
                 // move page
                 res = spiffs_page_move(fs, 0, 0, obj_id, &p_hdr, cur_pix, &new_data_pix);
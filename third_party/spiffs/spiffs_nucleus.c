@@ -66,6 +66,12 @@ s32_t spiffs_phys_rd(
     u32_t addr,
     u32_t len,
     u8_t *dst) {
+#if SPIFFS_RAM_DIRECT
+  if (fs->cfg.phys_mem) {
+    _SPIFFS_MEMCPY(dst, SPIFFS_PHYS_MEM(fs, addr), len);
+    return SPIFFS_OK;
+  }
+#endif
   return SPIFFS_HAL_READ(fs, addr, len, dst);
 }
 
@@ -79,6 +85,24 @@ s32_t spiffs_phys_wr(
 
 #endif
 
+// Makes the object lookup page at addr available in *obj_lu_buf. With mapped
+// flash this points into the mapping itself, which always reflects the latest
+// writes, otherwise the page is read into fs->lu_work.
+s32_t spiffs_obj_lu_load(
+    spiffs *fs,
+    u32_t addr,
+    spiffs_obj_id **obj_lu_buf) {
+#if SPIFFS_RAM_DIRECT
+  if (fs->cfg.phys_mem) {
+    *obj_lu_buf = (spiffs_obj_id *)SPIFFS_PHYS_MEM(fs, addr);
+    return SPIFFS_OK;
+  }
+#endif
+  *obj_lu_buf = (spiffs_obj_id *)fs->lu_work;
+  return _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU | SPIFFS_OP_C_READ,
+      0, addr, SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->lu_work);
+}
+
 #if !SPIFFS_READ_ONLY
 s32_t spiffs_phys_cpy(
     spiffs *fs,
@@ -137,7 +161,7 @@ s32_t spiffs_obj_lu_find_entry_visitor(
   spiffs_block_ix cur_block = starting_block;
   u32_t cur_block_addr = starting_block * SPIFFS_CFG_LOG_BLOCK_SZ(fs);
 
-  spiffs_obj_id *obj_lu_buf = (spiffs_obj_id *)fs->lu_work;
+  spiffs_obj_id *obj_lu_buf;
   int cur_entry = starting_lu_entry;
   int entries_per_page = (SPIFFS_CFG_LOG_PAGE_SZ(fs) / sizeof(spiffs_obj_id));
 
@@ -163,8 +187,7 @@ s32_t spiffs_obj_lu_find_entry_visitor(
     // check each object lookup page
     while (res == SPIFFS_OK && obj_lookup_page < (int)SPIFFS_OBJ_LOOKUP_PAGES(fs)) {
       int entry_offset = obj_lookup_page * entries_per_page;
-      res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU | SPIFFS_OP_C_READ,
-          0, cur_block_addr + SPIFFS_PAGE_TO_PADDR(fs, obj_lookup_page), SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->lu_work);
+      res = spiffs_obj_lu_load(fs, cur_block_addr + SPIFFS_PAGE_TO_PADDR(fs, obj_lookup_page), &obj_lu_buf);
       // check each entry
       while (res == SPIFFS_OK &&
           cur_entry - entry_offset < entries_per_page && // for non-last obj lookup pages
@@ -183,8 +206,7 @@ s32_t spiffs_obj_lu_find_entry_visitor(
                 user_var_p);
             if (res == SPIFFS_VIS_COUNTINUE || res == SPIFFS_VIS_COUNTINUE_RELOAD) {
               if (res == SPIFFS_VIS_COUNTINUE_RELOAD) {
-                res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU | SPIFFS_OP_C_READ,
-                    0, cur_block_addr + SPIFFS_PAGE_TO_PADDR(fs, obj_lookup_page), SPIFFS_CFG_LOG_PAGE_SZ(fs), fs->lu_work);
+                res = spiffs_obj_lu_load(fs, cur_block_addr + SPIFFS_PAGE_TO_PADDR(fs, obj_lookup_page), &obj_lu_buf);
                 SPIFFS_CHECK_RES(res);
               }
               res = SPIFFS_OK;
@@ -1160,6 +1182,20 @@ void spiffs_cb_object_event(
     }
     fs->file_cb_f(fs, op, obj_id, new_pix);
   }
+
+#if SPIFFS_NAME_INDEX
+  if (spix == 0 && (obj_id_raw & SPIFFS_OBJ_ID_IX_FLAG)) {
+    if (ev == SPIFFS_EV_IX_DEL) {
+      spiffs_name_index_update(fs, obj_id, new_pix, 0);
+    } else {
+      spiffs_page_object_ix_header objix_hdr;
+      if (_spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU2 | SPIFFS_OP_C_READ, 0,
+          SPIFFS_PAGE_TO_PADDR(fs, new_pix), sizeof(objix_hdr), (u8_t *)&objix_hdr) == SPIFFS_OK) {
+        spiffs_name_index_update(fs, obj_id, new_pix, objix_hdr.name);
+      }
+    }
+  }
+#endif
 }
 
 // Open object by id
@@ -1708,6 +1744,33 @@ s32_t spiffs_object_find_object_index_header_by_name(
   spiffs_block_ix bix;
   int entry;
 
+#if SPIFFS_NAME_INDEX
+  spiffs_page_ix hint;
+  res = spiffs_name_index_find(fs, name, &hint);
+  if (res == SPIFFS_ERR_NOT_FOUND) {
+    return res;
+  }
+  if (res == SPIFFS_OK && !SPIFFS_IS_LOOKUP_PAGE(fs, hint) && hint < SPIFFS_MAX_PAGES(fs)) {
+    spiffs_block_ix hint_bix = SPIFFS_BLOCK_FOR_PAGE(fs, hint);
+    int hint_entry = SPIFFS_OBJ_LOOKUP_ENTRY_FOR_PAGE(fs, hint);
+    spiffs_obj_id hint_id;
+    res = _spiffs_rd(fs, SPIFFS_OP_T_OBJ_LU | SPIFFS_OP_C_READ, 0,
+        SPIFFS_BLOCK_TO_PADDR(fs, hint_bix) + hint_entry * sizeof(spiffs_obj_id),
+        sizeof(spiffs_obj_id), (u8_t *)&hint_id);
+    SPIFFS_CHECK_RES(res);
+    res = spiffs_object_find_object_index_header_by_name_v(fs, hint_id, hint_bix, hint_entry, name, 0);
+    if (res == SPIFFS_OK) {
+      if (pix) {
+        *pix = hint;
+      }
+      return res;
+    }
+    if (res != SPIFFS_VIS_COUNTINUE) {
+      SPIFFS_CHECK_RES(res);
+    }
+  }
+#endif
+
   res = spiffs_obj_lu_find_entry_visitor(fs,
       fs->cursor_block_ix,
       fs->cursor_obj_lu_entry,
@@ -397,14 +397,21 @@
 #define spiffs_get_cache_page(fs, c, ix) \
   ((u8_t *)(&((c)->cpages[(ix) * SPIFFS_CACHE_PAGE_SIZE(fs)])) + sizeof(spiffs_cache_page))
 
+#define SPIFFS_CACHE_NIL              ((u32_t)-1)
+
 // cache page struct
 typedef struct {
   // cache flags
   u8_t flags;
+  // set while the page is on the lru list, clear while it is on the free list
+  u8_t used;
   // cache page index
-  u8_t ix;
-  // last access of this cache page
-  u32_t last_access;
+  u32_t ix;
+  // next page in the same hash bucket
+  u32_t hash_next;
+  // neighbours on the lru list (most recent first), lru_next links the free list
+  u32_t lru_prev;
+  u32_t lru_next;
   union {
     // type read cache
     struct {
@@ -427,13 +434,19 @@ typedef struct {
 
 // cache struct
 typedef struct {
-  u8_t cpage_count;
-  u32_t last_access;
-  u32_t cpage_use_map;
-  u32_t cpage_use_mask;
+  u32_t cpage_count;
+  // hash buckets, indexed by page index (read pages) or object id (write pages)
+  u32_t *buckets;
+  u32_t bucket_mask;
+  u32_t lru_head;
+  u32_t lru_tail;
+  u32_t free_head;
   u8_t *cpages;
 } spiffs_cache;
 
+#define SPIFFS_CACHE_BUCKETS(pages) \
+  ((pages) <= 1 ? 1 : (1u << (32 - __builtin_clz((u32_t)(pages) - 1))))
+
 #endif
 
 
@@ -534,6 +547,12 @@ typedef s32_t (*spiffs_visitor_f)(spiffs *fs, spiffs_obj_id id, spiffs_block_ix
     spiffs_phys_wr((fs), (addr), (len), (src))
 #endif
 
+#if SPIFFS_RAM_DIRECT
+// memory backing given physical address, only valid if cfg.phys_mem is set
+#define SPIFFS_PHYS_MEM(fs, addr) \
+  ((fs)->cfg.phys_mem + ((addr) - SPIFFS_CFG_PHYS_ADDR(fs)))
+#endif
+
 #ifndef MIN
 #define MIN(a,b) ((a) < (b) ? (a) : (b))
 #endif
@@ -563,6 +582,11 @@ s32_t spiffs_phys_wr(
     u32_t len,
     u8_t *src);
 
+s32_t spiffs_obj_lu_load(
+    spiffs *fs,
+    u32_t addr,
+    spiffs_obj_id **obj_lu_buf);
+
 s32_t spiffs_phys_cpy(
     spiffs *fs,
     spiffs_file fh,